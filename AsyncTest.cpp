@@ -0,0 +1,327 @@
+#include <gtest/gtest.h>
+
+#include "SplitterAsync.h"
+#include <deque>
+#include <future>
+#include <thread>
+
+// single thread executor
+class ThreadExecutor : public SplitterExecutor {
+public:
+    ThreadExecutor():
+      stop_(false),
+      thread_([this]() {
+          Run();
+      }) {
+    }
+
+    ~ThreadExecutor() {
+        {
+            std::lock_guard lck(mtx_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    void Post(std::coroutine_handle<> h) override {
+        {
+            std::lock_guard lck(mtx_);
+            queue_.push_back(h);
+        }
+        cv_.notify_all();
+    }
+
+    bool OnThread() const {
+        return std::this_thread::get_id() == thread_.get_id();
+    }
+
+private:
+    void Run() {
+        std::unique_lock lck(mtx_);
+        while (true) {
+            cv_.wait(lck, [this]() {
+                return stop_ || !queue_.empty();
+            });
+            if (queue_.empty()) {
+                return;
+            }
+            auto h = queue_.front();
+            queue_.pop_front();
+            lck.unlock();
+            h.resume();
+            lck.lock();
+        }
+    }
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::deque<std::coroutine_handle<>> queue_;
+    bool stop_;
+    std::thread thread_;
+};
+
+// resumes the posted coroutines when the test runs it
+class ManualExecutor : public SplitterExecutor {
+public:
+    void Post(std::coroutine_handle<> h) override {
+        std::lock_guard lck(mtx_);
+        queue_.push_back(h);
+    }
+
+    size_t Run() {
+        std::deque<std::coroutine_handle<>> queue;
+        {
+            std::lock_guard lck(mtx_);
+            queue.swap(queue_);
+        }
+        for (auto h : queue) {
+            h.resume();
+        }
+        return queue.size();
+    }
+
+private:
+    std::mutex mtx_;
+    std::deque<std::coroutine_handle<>> queue_;
+};
+
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() {
+            return {};
+        }
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+        void return_void() {
+        }
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+};
+
+static Detached AsyncGet(ISplitter& s, ClientID id, int32_t timeout, ThreadExecutor& executor,
+        std::promise<std::pair<ISplitterError, FrameBuffer>>& result) {
+    FrameBuffer fb;
+    auto res = co_await s.AsyncGet(id, fb, timeout, executor);
+    result.set_value({res, fb});
+}
+
+static Detached AsyncPut(ISplitter& s, FrameBuffer fb, int32_t timeout, SplitterExecutor& executor,
+        std::promise<ISplitterError>& result) {
+    result.set_value(co_await s.AsyncPut(fb, timeout, executor));
+}
+
+TEST(GetResumesOnPut, Async) {
+    ThreadExecutor executor;
+    for (auto engine : {SplitterEngine::QUEUE, SplitterEngine::RING}) {
+        SplitterOptions options;
+        options.engine = engine;
+        ISplitter s(2, 1, options);
+        ClientID client;
+        EXPECT_TRUE(s.ClientAdd(&client));
+
+        std::promise<std::pair<ISplitterError, FrameBuffer>> result;
+        auto future = result.get_future();
+        AsyncGet(s, client, 5000, executor, result);
+        EXPECT_EQ(future.wait_for(std::chrono::milliseconds(50)), std::future_status::timeout);
+
+        auto fb = std::make_shared<std::vector<uint8_t>>(100);
+        EXPECT_EQ(s.Put(fb, 0), ISplitterError::NO_ERROR);
+        auto [res, got] = future.get();
+        EXPECT_EQ(res, ISplitterError::NO_ERROR);
+        EXPECT_EQ(got, fb);
+    }
+}
+
+TEST(GetTimeout, Async) {
+    ThreadExecutor executor;
+    ISplitter s(2, 1);
+    ClientID client;
+    EXPECT_TRUE(s.ClientAdd(&client));
+
+    auto start = std::chrono::steady_clock::now();
+    std::promise<std::pair<ISplitterError, FrameBuffer>> result;
+    auto future = result.get_future();
+    AsyncGet(s, client, 50, executor, result);
+    EXPECT_EQ(future.get().first, ISplitterError::TIMEOUT);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+
+    std::promise<std::pair<ISplitterError, FrameBuffer>> unknown;
+    AsyncGet(s, client + 1, 50, executor, unknown);
+    EXPECT_EQ(unknown.get_future().get().first, ISplitterError::UNKNOWN_CLIENT);
+}
+
+TEST(GetEos, Async) {
+    ThreadExecutor executor;
+    ISplitter s(2, 1);
+    ClientID client;
+    EXPECT_TRUE(s.ClientAdd(&client));
+
+    std::promise<std::pair<ISplitterError, FrameBuffer>> result;
+    auto future = result.get_future();
+    AsyncGet(s, client, 5000, executor, result);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_TRUE(s.ClientRemove(client));
+    EXPECT_EQ(future.get().first, ISplitterError::EOS);
+}
+
+TEST(PutResumesOnGet, Async) {
+    ThreadExecutor executor;
+    for (auto engine : {SplitterEngine::QUEUE, SplitterEngine::RING}) {
+        SplitterOptions options;
+        options.engine = engine;
+        ISplitter s(1, 1, options);
+        ClientID client;
+        EXPECT_TRUE(s.ClientAdd(&client));
+
+        auto fb1 = std::make_shared<std::vector<uint8_t>>(100);
+        auto fb2 = std::make_shared<std::vector<uint8_t>>(100);
+        EXPECT_EQ(s.Put(fb1, 0), ISplitterError::NO_ERROR);
+
+        std::promise<ISplitterError> result;
+        auto future = result.get_future();
+        AsyncPut(s, fb2, 5000, executor, result);
+        EXPECT_EQ(future.wait_for(std::chrono::milliseconds(50)), std::future_status::timeout);
+
+        FrameBuffer got;
+        EXPECT_EQ(s.Get(client, got, 0), ISplitterError::NO_ERROR);
+        EXPECT_EQ(got, fb1);
+        EXPECT_EQ(future.get(), ISplitterError::NO_ERROR);
+        EXPECT_EQ(s.Get(client, got, 0), ISplitterError::NO_ERROR);
+        EXPECT_EQ(got, fb2);
+
+        std::vector<ClientStats> stats;
+        s.ClientsStatsGet(&stats);
+        EXPECT_EQ(stats[0].dropped, 0u);
+    }
+}
+
+TEST(PutOverlapsRing, Async) {
+    ThreadExecutor executor;
+    SplitterOptions options;
+    options.engine = SplitterEngine::RING;
+    ISplitter s(1, 1, options);
+    ClientID client;
+    EXPECT_TRUE(s.ClientAdd(&client));
+
+    std::vector<FrameBuffer> fbs;
+    for (uint8_t i = 0; i < 4; ++i) {
+        fbs.push_back(std::make_shared<std::vector<uint8_t>>(100, i));
+    }
+    EXPECT_EQ(s.Put(fbs[0], 0), ISplitterError::NO_ERROR);
+
+    // the first AsyncPut waits for the client, the rest for the ring
+    std::promise<ISplitterError> first;
+    std::promise<ISplitterError> second;
+    AsyncPut(s, fbs[1], 5000, executor, first);
+    AsyncPut(s, fbs[2], 5000, executor, second);
+    auto put = std::async(std::launch::async, [&]() {
+        return s.Put(fbs[3], 5000);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    for (uint64_t i = 0; i < fbs.size(); ++i) {
+        FrameBuffer got;
+        uint64_t seq;
+        EXPECT_EQ(s.Get(client, got, 5000, &seq), ISplitterError::NO_ERROR);
+        EXPECT_EQ(seq, i);
+        EXPECT_EQ(got, fbs[i]);
+    }
+    EXPECT_EQ(first.get_future().get(), ISplitterError::NO_ERROR);
+    EXPECT_EQ(second.get_future().get(), ISplitterError::NO_ERROR);
+    EXPECT_EQ(put.get(), ISplitterError::NO_ERROR);
+}
+
+TEST(PutTimeoutAndClose, Async) {
+    ThreadExecutor executor;
+    ISplitter s(1, 1);
+    ClientID client;
+    EXPECT_TRUE(s.ClientAdd(&client));
+    auto fb = std::make_shared<std::vector<uint8_t>>(100);
+    EXPECT_EQ(s.Put(fb, 0), ISplitterError::NO_ERROR);
+
+    std::promise<ISplitterError> timeout;
+    AsyncPut(s, fb, 50, executor, timeout);
+    EXPECT_EQ(timeout.get_future().get(), ISplitterError::TIMEOUT);
+    std::vector<ClientStats> stats;
+    s.ClientsStatsGet(&stats);
+    EXPECT_EQ(stats[0].dropped, 1u);
+
+    std::promise<ISplitterError> closed;
+    auto future = closed.get_future();
+    AsyncPut(s, fb, 5000, executor, closed);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    s.Close();
+    EXPECT_EQ(future.get(), ISplitterError::CLOSED);
+}
+
+TEST(PutBackgroundDelivery, Async) {
+    ManualExecutor executor;
+    SplitterOptions options;
+    options.background_delivery = true;
+    ISplitter s(1, 1, options);
+    ClientID client;
+    EXPECT_TRUE(s.ClientAdd(&client));
+    auto fb1 = std::make_shared<std::vector<uint8_t>>(100);
+    auto fb2 = std::make_shared<std::vector<uint8_t>>(100);
+    EXPECT_EQ(s.Put(fb1, 0), ISplitterError::NO_ERROR);
+
+    // like Put, the frame for the full client is set aside, no suspension
+    std::promise<ISplitterError> result;
+    auto future = result.get_future();
+    AsyncPut(s, fb2, 5000, executor, result);
+    EXPECT_EQ(future.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+    EXPECT_EQ(future.get(), ISplitterError::NO_ERROR);
+    EXPECT_EQ(executor.Run(), 0u);
+
+    FrameBuffer got;
+    EXPECT_EQ(s.Get(client, got, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(got, fb1);
+    EXPECT_EQ(s.Get(client, got, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(got, fb2);
+}
+
+// a Flush after the consumer woke the Put, but before it's resumed
+TEST(PutFlushedBeforeResume, Async) {
+    ManualExecutor executor;
+    ISplitter s(1, 1);
+    ClientID client;
+    EXPECT_TRUE(s.ClientAdd(&client));
+    auto fb = std::make_shared<std::vector<uint8_t>>(100);
+    EXPECT_EQ(s.Put(fb, 0), ISplitterError::NO_ERROR);
+
+    std::promise<ISplitterError> result;
+    auto future = result.get_future();
+    AsyncPut(s, fb, 5000, executor, result);
+    FrameBuffer got;
+    EXPECT_EQ(s.Get(client, got, 0), ISplitterError::NO_ERROR);
+    s.Flush();
+    EXPECT_EQ(executor.Run(), 1u);
+    EXPECT_EQ(future.get(), ISplitterError::FLUSHED);
+    EXPECT_EQ(s.Get(client, got, 0), ISplitterError::TIMEOUT);
+}
+
+TEST(ResumedOnExecutor, Async) {
+    ThreadExecutor executor;
+    ISplitter s(2, 1);
+    ClientID client;
+    EXPECT_TRUE(s.ClientAdd(&client));
+
+    std::promise<bool> on_executor;
+    auto future = on_executor.get_future();
+    [](ISplitter& s, ClientID client, ThreadExecutor& executor, std::promise<bool>& on_executor) -> Detached {
+        FrameBuffer fb;
+        co_await s.AsyncGet(client, fb, 5000, executor);
+        on_executor.set_value(executor.OnThread());
+    }(s, client, executor, on_executor);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    s.Put(std::make_shared<std::vector<uint8_t>>(100), 0);
+    EXPECT_TRUE(future.get());
+}
@@ -0,0 +1,1123 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Splitter.h"
+#include "Tracer.h"
+
+// Fixed capacity FIFO, the client queue of the splitters. With a Capacity
+// the slots are an std::array inside the queue, with std::dynamic_extent a
+// vector sized by Reserve and freed by Release; either way pushing and
+// popping frames never touches the allocator. size() may be read without
+// the lock of the queue's owner, the rest may not.
+template <typename T, size_t Capacity = std::dynamic_extent>
+class BasicQueue {
+public:
+    static constexpr bool kFixed = Capacity != std::dynamic_extent;
+
+    BasicQueue():
+      head_(0),
+      size_(0) {
+
+    }
+
+    void Reserve(size_t capacity) requires (!kFixed) {
+        assert(empty());
+        slots_.resize(capacity);
+        head_ = 0;
+    }
+
+    void Release() requires (!kFixed) {
+        assert(empty());
+        std::vector<T>().swap(slots_);
+    }
+
+    size_t capacity() const {
+        return slots_.size();
+    }
+
+    size_t size() const {
+        return size_.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    bool full() const {
+        return size() == capacity();
+    }
+
+    void push_back(T item) {
+        assert(!full());
+        slots_[Index(size())] = std::move(item);
+        size_.store(size() + 1, std::memory_order_release);
+    }
+
+    const T& front() const {
+        assert(size() > 0);
+        return slots_[head_];
+    }
+
+    const T& at(size_t i) const {
+        assert(i < size());
+        return slots_[Index(i)];
+    }
+
+    T pop_front() {
+        assert(size() > 0);
+        auto res = std::move(slots_[head_]);
+        head_ = Index(1);
+        size_.store(size() - 1, std::memory_order_release);
+        return res;
+    }
+
+private:
+    // a constant divisor with a fixed Capacity
+    size_t Index(size_t i) const {
+        return (head_ + i) % capacity();
+    }
+
+    std::conditional_t<kFixed, std::array<T, Capacity>, std::vector<T>> slots_;
+    size_t head_;
+    std::atomic<size_t> size_;
+};
+
+// Counters written only under the owner's lock, but read without it by
+// ClientsStatsGet. No read-modify-write is needed for a single writer.
+template <typename T>
+void Advance(std::atomic<T>& counter, T n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_release);
+}
+
+inline bool DecimationSet(const ClientOptions& options) {
+    return options.keyframes_only || (options.every_nth > 1) || (options.max_fps > 0);
+}
+
+// Overflow policies of BasicSplitter. A FixedPolicy is the OverflowPolicy of
+// every client, ClientOptions::overflow must name it. ClientPolicy takes
+// ClientOptions::overflow of each client, as ISplitter does.
+template <OverflowPolicy P>
+class FixedPolicy {
+public:
+    // of ClientAdd without ClientOptions
+    static constexpr OverflowPolicy kDefault = P;
+
+    static constexpr bool Accepts(OverflowPolicy policy) {
+        return policy == P;
+    }
+
+    static constexpr OverflowPolicy Get() {
+        return P;
+    }
+
+    void Set(OverflowPolicy) {
+    }
+};
+
+using DropOldestPolicy = FixedPolicy<OverflowPolicy::DROP_OLDEST>;
+using DropNewestPolicy = FixedPolicy<OverflowPolicy::DROP_NEWEST>;
+using BlockPolicy = FixedPolicy<OverflowPolicy::BLOCK>;
+
+// Set under the client lock, read by ClientsStatsGet without it
+class ClientPolicy {
+public:
+    static constexpr OverflowPolicy kDefault = OverflowPolicy::DROP_OLDEST;
+
+    static constexpr bool Accepts(OverflowPolicy) {
+        return true;
+    }
+
+    OverflowPolicy Get() const {
+        return policy_.load(std::memory_order_relaxed);
+    }
+
+    void Set(OverflowPolicy policy) {
+        policy_.store(policy, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<OverflowPolicy> policy_{kDefault};
+};
+
+// One slot of the client registry of BasicSplitter, the base of its client
+// types. A slot is reused by later clients. The generation is odd while a
+// client owns the slot and even while it's free. ClientID carries the
+// generation, so a stale ID never matches a reused slot. All methods except
+// the generation and statistics getters expect mtx_ to be held by the caller.
+class BasicClientBase {
+public:
+    static ClientID MakeId(size_t slot, uint32_t generation) {
+        return (static_cast<ClientID>(generation) << 32) | slot;
+    }
+
+    static bool IsActive(uint32_t generation) {
+        return generation & 1;
+    }
+
+    uint32_t Generation() const {
+        return generation_.load(std::memory_order_acquire);
+    }
+
+    bool Alive(uint32_t generation) const {
+        return Generation() == generation;
+    }
+
+    // Puts stalled on the client, each by the seq of the first frame it has
+    // yet to push. Frames go in seq order, so only the Put with the lowest
+    // may push.
+    bool InLine(uint64_t seq) const {
+        for (auto stalled : stalled_seqs_) {
+            if (stalled < seq) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void StallAdd(uint64_t seq) {
+        Tracer::AsyncBegin(TraceEvent::STALL, id_, seq);
+        stalled_seqs_.push_back(seq);
+        producer_waiting_ = true;
+    }
+
+    void StallMove(uint64_t seq, uint64_t next) {
+        *std::find(stalled_seqs_.begin(), stalled_seqs_.end(), seq) = next;
+        producer_waiting_ = true;
+    }
+
+    // true when other Puts are still stalled on the client
+    bool StallRemove(uint64_t seq) {
+        Tracer::AsyncEnd(TraceEvent::STALL, id_, seq);
+        std::erase(stalled_seqs_, seq);
+        producer_waiting_ = !stalled_seqs_.empty();
+        return producer_waiting_;
+    }
+
+    size_t GetDropped() const {
+        return drop_counter_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t GetDelivered() const {
+        return delivered_counter_.load(std::memory_order_relaxed);
+    }
+
+    // parks a consumer until ready() or the timeout, false on timeout. By the
+    // client's WaitStrategy it spins without the lock first, so ready() must
+    // be safe without it.
+    template <typename Ready>
+    bool WaitPull(std::unique_lock<std::mutex>& lck, int32_t timeout_msec, Ready ready) {
+        auto deadline = clock_->Now() + std::chrono::milliseconds(timeout_msec);
+        // a spin on a simulated clock would never time out
+        if ((wait_ == WaitStrategy::PARK) || !clock_->Realtime()) {
+            return Park(lck, deadline, ready);
+        }
+        auto start = Metrics::Now();
+        auto budget = std::min(SpinBudget(), int64_t(timeout_msec) * 1000000);
+        if (budget) {
+            lck.unlock();
+            Spin(start + budget, ready);
+            lck.lock();
+        }
+        bool res = ready() || Park(lck, deadline, ready);
+        wait_ewma_ns_ += ((Metrics::Now() - start) - wait_ewma_ns_) / 8;
+        return res;
+    }
+
+    std::mutex mtx_;
+    // Put found the queue full and waits for this client. Cleared by the Get
+    // that wakes it, so a stall costs one wakeup per retry of Put.
+    bool producer_waiting_;
+protected:
+    BasicClientBase():
+      producer_waiting_(false),
+      metrics_(nullptr),
+      clock_(nullptr),
+      slot_(0),
+      id_(0),
+      pull_waiters_(0),
+      generation_(0),
+      drop_counter_(0),
+      delivered_counter_(0),
+      wait_(WaitStrategy::PARK),
+      spin_ns_(0),
+      wait_ewma_ns_(0) {
+
+    }
+
+    void Setup(size_t slot, Metrics* metrics, SplitterClock* clock) {
+        slot_ = slot;
+        metrics_ = metrics;
+        clock_ = clock;
+    }
+
+    // starts a new client in the slot once the derived client is set up,
+    // returns its generation
+    uint32_t Activate(const ClientOptions& options) {
+        wait_ = options.wait;
+        spin_ns_ = int64_t(options.spin_usec) * 1000;
+        wait_ewma_ns_ = 0;
+        drop_counter_.store(0, std::memory_order_relaxed);
+        delivered_counter_.store(0, std::memory_order_relaxed);
+        auto generation = generation_.load(std::memory_order_relaxed) + 1;
+        id_ = MakeId(slot_, generation);
+        generation_.store(generation, std::memory_order_release);
+        return generation;
+    }
+
+    // frees the slot, a consumer waiting in Get gets EOS and the Puts stalled
+    // on the client go on without it
+    void Deactivate() {
+        for (auto seq : stalled_seqs_) {
+            Tracer::AsyncEnd(TraceEvent::STALL, id_, seq);
+        }
+        generation_.store(generation_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        stalled_seqs_.clear();
+        NotifyPull();
+    }
+
+    // only a parked consumer is notified, the condition variable is not
+    // touched while consumers keep up
+    void NotifyPull() {
+        if (pull_waiters_) {
+            clock_->NotifyAll(pull_cv_);
+            Metrics::CountWakeup(metrics_->pull_wakeups_);
+        }
+    }
+
+    void Drop(size_t n, OverflowPolicy policy) {
+        if (n) {
+            Tracer::Instant(TraceEvent::DROP, id_, n);
+        }
+        Advance<size_t>(drop_counter_, n);
+        metrics_->RecordDrops(static_cast<size_t>(policy), n);
+    }
+
+    void Delivered() {
+        Advance<uint64_t>(delivered_counter_);
+    }
+
+    Metrics* metrics_;
+    SplitterClock* clock_;
+    size_t slot_;
+    ClientID id_;            // of the active client, for the trace
+private:
+    template <typename Ready>
+    bool Park(std::unique_lock<std::mutex>& lck, SplitterClock::time_point deadline, Ready ready) {
+        ++pull_waiters_;
+        while (!ready() && clock_->WaitUntil(pull_cv_, lck, deadline)) {
+        }
+        --pull_waiters_;
+        return ready();
+    }
+
+    // ns to spin before parking. ADAPTIVE spins twice the average of the
+    // recent waits, so a frame due soon is caught spinning, and not at all
+    // once frames come further apart than spin_usec.
+    int64_t SpinBudget() const {
+        switch (wait_) {
+        case WaitStrategy::SPIN_THEN_PARK:
+            return spin_ns_;
+        case WaitStrategy::BUSY_POLL:
+            return INT64_MAX;
+        case WaitStrategy::ADAPTIVE:
+            return (wait_ewma_ns_ <= spin_ns_) ? std::min(spin_ns_, 2 * wait_ewma_ns_) : 0;
+        default:
+            return 0;
+        }
+    }
+
+    // spins until ready() or deadline. Yields now and then, so a producer on
+    // the same core gets to run.
+    template <typename Ready>
+    static void Spin(int64_t deadline, Ready ready) {
+        for (uint32_t i = 1;; ++i) {
+            if (ready()) {
+                return;
+            }
+            CpuRelax();
+            if (i % 64 == 0) {
+                if (Metrics::Now() >= deadline) {
+                    return;
+                }
+                if (i % 256 == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+
+    // spin-wait hint, lets the sibling hyperthread run
+    static void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    std::condition_variable pull_cv_;
+    size_t pull_waiters_;  // consumers parked on pull_cv_
+    std::atomic<uint32_t> generation_;
+    std::atomic<size_t> drop_counter_;
+    std::atomic<uint64_t> delivered_counter_;
+    std::vector<uint64_t> stalled_seqs_;
+    WaitStrategy wait_;
+    int64_t spin_ns_;
+    int64_t wait_ewma_ns_;   // ns waited by the recent WaitPull calls
+};
+
+// Client of small trivially copyable frames, telemetry structs say, the
+// client type of BasicSplitter by default. The queue is a BasicQueue<Frame,
+// Capacity> stored inline, so Put copies the frame into it and allocates
+// nothing. The frames carry no FrameHeader nor seq: KEYFRAME, decimation,
+// history seeds and the eventfd are refused, and the tracer sees the stalls
+// and drops but not every push and pop.
+template <typename Frame, size_t Capacity, typename Policy>
+class alignas(64) BasicClient : public BasicClientBase {
+    static_assert(std::is_trivially_copyable_v<Frame>, "frames are copied into the client queues");
+
+public:
+    void Setup(size_t slot, size_t max_buffers, Metrics* metrics, SplitterClock* clock) {
+        BasicClientBase::Setup(slot, metrics, clock);
+        max_buffers_ = max_buffers;
+    }
+
+    // returns the generation of the new client, 0 for options it can't serve
+    uint32_t Activate(const ClientOptions& options) {
+        if ((options.overflow == OverflowPolicy::KEYFRAME) || options.event_fd || DecimationSet(options) ||
+                (options.seed != HistorySeed::NONE)) {
+            return 0;
+        }
+        policy_.Set(options.overflow);
+        // a runtime capacity queue takes memory only while the slot is used
+        if constexpr (Capacity == std::dynamic_extent) {
+            frames_.Reserve(max_buffers_);
+        }
+        return BasicClientBase::Activate(options);
+    }
+
+    void Deactivate() {
+        BasicClientBase::Deactivate();
+        Clear();
+        if constexpr (Capacity == std::dynamic_extent) {
+            frames_.Release();
+        }
+    }
+
+    // no state of the client belongs to Put, ClientAdd doesn't hold it off
+    bool AddExclusive(const ClientOptions&) const {
+        return false;
+    }
+
+    bool Admit(const Frame&) const {
+        return true;
+    }
+
+    // push frames while the queue has room, or all of them by the policy when
+    // forced. Consumer is woken once. Returns number of frames done with.
+    size_t PushBuffers(std::span<const Frame> frames, bool force) {
+        size_t done = 0;
+        size_t pushed = 0;
+        for (; done < frames.size(); ++done) {
+            if (!frames_.full()) {
+                frames_.push_back(frames[done]);
+                ++pushed;
+            } else if (!force) {
+                break;
+            } else if (Overflow() == OverflowPolicy::DROP_OLDEST) {
+                frames_.pop_front();
+                frames_.push_back(frames[done]);
+                Drop(1, Overflow());
+                ++pushed;
+            } else {
+                Drop(1, Overflow());
+            }
+        }
+        if (pushed) {
+            NotifyPull();
+        }
+        return done;
+    }
+
+    // frames a Put can't push in order before its timeout
+    void DropBuffers(std::span<const Frame> frames) {
+        Drop(frames.size(), Overflow());
+    }
+
+    bool IsQueueEmpty() const {
+        return frames_.empty();
+    }
+
+    Frame PopBuffer() {
+        Delivered();
+        return frames_.pop_front();
+    }
+
+    void Flush() {
+        Drop(frames_.size(), Overflow());
+        Clear();
+    }
+
+    OverflowPolicy Overflow() const {
+        return policy_.Get();
+    }
+
+    size_t GetLatency() const {
+        return frames_.size();
+    }
+
+    void StatsGet(ClientStats* stats) const {
+        stats->latency = GetLatency();
+        stats->dropped = GetDropped();
+        stats->skipped = 0;
+        stats->delivered = GetDelivered();
+        stats->overflow = Overflow();
+        stats->bytes = stats->latency * sizeof(Frame);
+    }
+
+    // the frames carry no Put stamp
+    const Histogram* Residence() const {
+        return nullptr;
+    }
+
+private:
+    void Clear() {
+        while (!frames_.empty()) {
+            frames_.pop_front();
+        }
+    }
+
+    BasicQueue<Frame, Capacity> frames_;
+    size_t max_buffers_ = 0;
+    Policy policy_;
+};
+
+// What BasicSplitter does besides feeding the client queues, and the client
+// type it keeps. None of it for BasicClient.
+template <typename Frame, size_t Capacity, typename Policy>
+struct BasicHooks {
+    using Client = BasicClient<Frame, Capacity, Policy>;
+
+    void Setup(Client& client, size_t slot, size_t max_buffers, Metrics* metrics, SplitterClock* clock) {
+        client.Setup(slot, max_buffers, metrics, clock);
+    }
+
+    // stalled Puts were notified with reason, called with push_mtx_ held
+    void ProducersWoken(ISplitterError) {
+    }
+
+    // a Put waits for something else than room in a client queue
+    bool ProducerWaits() const {
+        return false;
+    }
+
+    // Flush and Close drop the frames kept outside the client queues, called
+    // with push_mtx_ held
+    void FramesClear() {
+    }
+};
+
+// Splitter engine over a Frame type. Each client owns a queue of Capacity
+// frames, std::dynamic_extent for a capacity set at run time; a splitter with
+// a capacity of 0 takes no clients and InfoGet fails. Put waits up to
+// its timeout for clients with a full queue, then the client's overflow
+// policy applies to them; frames put by any number of producers reach every
+// client in one order. Policy is FixedPolicy for one OverflowPolicy of every
+// client or ClientPolicy for a policy per client. Hooks picks the client type
+// and hooks the extras of the splitter in, see BasicHooks; ISplitter is this
+// engine with the client of Splitter.cpp. Lock order: registry_mtx_,
+// push_mtx_, client mtx_.
+//
+// Needs no library but for the event tracer: link Tracer.cpp, or build with
+// SPLITTER_TRACE=0 to compile the tracer out.
+template <typename Frame, size_t Capacity, typename Policy = DropOldestPolicy,
+    typename Hooks = BasicHooks<Frame, Capacity, Policy>>
+class BasicSplitter {
+    static_assert(Capacity > 0);
+
+public:
+    using Client = typename Hooks::Client;
+    static constexpr bool kFixed = Capacity != std::dynamic_extent;
+
+    explicit BasicSplitter(size_t max_clients, std::shared_ptr<SplitterClock> clock = nullptr,
+            Hooks hooks = Hooks()) requires kFixed:
+      BasicSplitter(Capacity, max_clients, std::move(clock), std::move(hooks), std::in_place) {
+
+    }
+
+    BasicSplitter(size_t max_buffers, size_t max_clients, std::shared_ptr<SplitterClock> clock = nullptr,
+            Hooks hooks = Hooks()) requires (!kFixed):
+      BasicSplitter(max_buffers, max_clients, std::move(clock), std::move(hooks), std::in_place) {
+
+    }
+
+    BasicSplitter(const BasicSplitter&) = delete;
+    BasicSplitter& operator=(const BasicSplitter&) = delete;
+
+    bool InfoGet(size_t* _pzMaxBuffers, size_t* _pzMaxClients) const {
+        *_pzMaxBuffers = max_buffers_;
+        *_pzMaxClients = max_clients_;
+        return max_buffers_ > 0;
+    }
+
+    ISplitterError Put(const Frame& _rFrame, int32_t _nTimeOutMsec) {
+        return PutBatch(std::span(&_rFrame, 1), _nTimeOutMsec);
+    }
+
+    // Put reporting the clients that timed out, TIMEOUT when there are any
+    ISplitterError Put(const Frame& _rFrame, int32_t _nTimeOutMsec, std::vector<ClientID>* _pvTimedOut) {
+        _pvTimedOut->clear();
+        return PutFrames(std::span(&_rFrame, 1), _nTimeOutMsec, _pvTimedOut);
+    }
+
+    // Put of a sequence of frames under one critical section per client
+    ISplitterError PutBatch(std::span<const Frame> _pFrames, int32_t _nTimeOutMsec) {
+        return PutFrames(_pFrames, _nTimeOutMsec, nullptr);
+    }
+
+    ISplitterError Get(ClientID _nClientID, Frame& _rFrame, int32_t _nTimeOutMsec) {
+        return Pull(_nClientID, _nTimeOutMsec, [&](Client& client) {
+            _rFrame = client.PopBuffer();
+        });
+    }
+
+    // Get that never waits, TIMEOUT when the queue is empty
+    ISplitterError TryGet(ClientID _nClientID, Frame& _rFrame) {
+        return Get(_nClientID, _rFrame, 0);
+    }
+
+    // replaces the content of _pFrames with up to _zMaxCount frames
+    ISplitterError GetBatch(ClientID _nClientID, std::vector<Frame>& _pFrames, size_t _zMaxCount,
+            int32_t _nTimeOutMsec) {
+        _pFrames.clear();
+        return Pull(_nClientID, _nTimeOutMsec, [&](Client& client) {
+            while (!client.IsQueueEmpty() && (_pFrames.size() < _zMaxCount)) {
+                _pFrames.push_back(client.PopBuffer());
+            }
+        });
+    }
+
+    bool ClientAdd(ClientID* _unClientID) {
+        ClientOptions options;
+        options.overflow = Policy::kDefault;
+        return ClientAdd(_unClientID, options);
+    }
+
+    // false for options the client type can't serve
+    bool ClientAdd(ClientID* _unClientID, const ClientOptions& _rOptions) {
+        return ClientAdd(_unClientID, _rOptions, false, []() {
+            return true;
+        }, [](Client&) {
+        });
+    }
+
+    bool ClientRemove(ClientID _unClientID) {
+        std::lock_guard lck(registry_mtx_);
+        uint32_t generation;
+        auto client = FindClient(_unClientID, &generation);
+        if (!client) {
+            return false;
+        }
+        Tracer::Instant(TraceEvent::CLIENT_REMOVE, _unClientID);
+        bool wake_producer;
+        {
+            std::lock_guard client_lck(client->mtx_);
+            client->Deactivate();
+            wake_producer = client->producer_waiting_ || hooks_.ProducerWaits();
+        }
+        --clients_count_;
+        auto clients_end = clients_end_.load(std::memory_order_relaxed);
+        while (clients_end && !Client::IsActive(clients_[clients_end - 1].Generation())) {
+            --clients_end;
+        }
+        clients_end_.store(clients_end, std::memory_order_release);
+
+        if (wake_producer) {
+            WakeProducer();
+        }
+        return true;
+    }
+
+    bool ClientGetCount(size_t* _pnCount) const {
+        *_pnCount = clients_count_;
+        return true;
+    }
+
+    // the lock keeps clients from being added and removed while they are
+    // scanned by index
+    std::unique_lock<std::mutex> BeginClientsIteration() {
+        return std::unique_lock(registry_mtx_);
+    }
+
+    bool ClientGetCount(size_t* _pnCount, [[maybe_unused]] std::unique_lock<std::mutex>& lock) const {
+        assert(lock.owns_lock());
+        *_pnCount = clients_count_;
+        return true;
+    }
+
+    bool ClientGetByIndex(size_t _zIndex, ClientID* _punClientID, size_t* _pzLatency, size_t* _pzDropped,
+            [[maybe_unused]] std::unique_lock<std::mutex>& lock) const {
+        assert(lock.owns_lock());
+
+        auto clients_end = clients_end_.load(std::memory_order_acquire);
+        for (size_t slot = 0; slot < clients_end; ++slot) {
+            auto& client = clients_[slot];
+            auto generation = client.Generation();
+            if (Client::IsActive(generation) && (_zIndex-- == 0)) {
+                *_punClientID = Client::MakeId(slot, generation);
+                *_pzLatency = client.GetLatency();
+                *_pzDropped = client.GetDropped();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Statistics of every client in one call. Takes no locks, so it doesn't
+    // block Put and Get; values of different clients aren't taken at the same
+    // instant.
+    bool ClientsStatsGet(std::vector<ClientStats>* _pvStats) const {
+        auto clients_end = clients_end_.load(std::memory_order_acquire);
+        _pvStats->clear();
+        _pvStats->reserve(clients_end);
+        for (size_t slot = 0; slot < clients_end; ++slot) {
+            auto& client = clients_[slot];
+            auto generation = client.Generation();
+            if (!Client::IsActive(generation)) {
+                continue;
+            }
+            ClientStats stats;
+            stats.id = Client::MakeId(slot, generation);
+            client.StatsGet(&stats);
+            // skip a client removed while it was read
+            if (client.Alive(generation)) {
+                _pvStats->push_back(stats);
+            }
+        }
+        return true;
+    }
+
+    // Histograms are only filled while enabled, disabled by default
+    void MetricsEnable(bool _bEnable) {
+        metrics_.Enable(_bEnable);
+    }
+
+    bool MetricsGet(SplitterMetrics* _pMetrics) const {
+        _pMetrics->put_stall = metrics_.put_stall_.Snapshot();
+        _pMetrics->lock_wait = metrics_.lock_wait_.Snapshot();
+        _pMetrics->drops_per_second = metrics_.drops_.Snapshot(Metrics::Now() / 1000000000);
+        _pMetrics->pull_wakeups = metrics_.pull_wakeups_.load(std::memory_order_relaxed);
+        _pMetrics->push_wakeups = metrics_.push_wakeups_.load(std::memory_order_relaxed);
+        _pMetrics->event_fd_syscalls = metrics_.event_fd_syscalls_.load(std::memory_order_relaxed);
+        for (size_t policy = 0; policy < kOverflowPolicies; ++policy) {
+            _pMetrics->policy_drops[policy] = metrics_.policy_drops_[policy].load(std::memory_order_relaxed);
+        }
+
+        auto clients_end = clients_end_.load(std::memory_order_acquire);
+        _pMetrics->residence.clear();
+        for (size_t slot = 0; slot < clients_end; ++slot) {
+            auto& client = clients_[slot];
+            auto generation = client.Generation();
+            if (!Client::IsActive(generation)) {
+                continue;
+            }
+            // the histogram goes with the client, it's freed on remove
+            std::lock_guard client_lck(client.mtx_);
+            if (client.Alive(generation) && client.Residence()) {
+                _pMetrics->residence.push_back({Client::MakeId(slot, generation), client.Residence()->Snapshot()});
+            }
+        }
+        return true;
+    }
+
+    // drops the queued frames of every client, the stalled Puts return FLUSHED
+    ISplitterError Flush() {
+        Tracer::Instant(TraceEvent::FLUSH);
+        std::lock_guard lck(push_mtx_);
+        auto clients_end = clients_end_.load(std::memory_order_acquire);
+        for (size_t slot = 0; slot < clients_end; ++slot) {
+            auto& client = clients_[slot];
+            std::lock_guard client_lck(client.mtx_);
+            if (Client::IsActive(client.Generation())) {
+                client.Flush();
+            }
+        }
+        hooks_.FramesClear();
+        ++abort_epoch_;
+        abort_reason_ = ISplitterError::FLUSHED;
+        NotifyProducer(ISplitterError::FLUSHED);
+        return ISplitterError::NO_ERROR;
+    }
+
+    // removes every client: their Get returns EOS, a stalled Put CLOSED
+    void Close() {
+        Tracer::Instant(TraceEvent::CLOSE);
+        std::lock_guard lck(registry_mtx_);
+        auto clients_end = clients_end_.load(std::memory_order_relaxed);
+        for (size_t slot = 0; slot < clients_end; ++slot) {
+            auto& client = clients_[slot];
+            std::lock_guard client_lck(client.mtx_);
+            if (Client::IsActive(client.Generation())) {
+                client.Deactivate();
+            }
+        }
+        clients_count_ = 0;
+        clients_end_.store(0, std::memory_order_release);
+
+        std::lock_guard push_lck(push_mtx_);
+        hooks_.FramesClear();
+        ++abort_epoch_;
+        abort_reason_ = ISplitterError::CLOSED;
+        NotifyProducer(ISplitterError::CLOSED);
+    }
+
+protected:
+    // stalled client and index of the first frame it didn't get yet
+    struct Stalled {
+        Client* client;
+        uint32_t generation;
+        size_t next;
+    };
+
+    Client* FindClient(ClientID _nClientID, uint32_t* _punGeneration) const {
+        auto slot = static_cast<size_t>(_nClientID & UINT32_MAX);
+        auto generation = static_cast<uint32_t>(_nClientID >> 32);
+        if ((slot >= max_clients_) || !Client::IsActive(generation) || !clients_[slot].Alive(generation)) {
+            return nullptr;
+        }
+        *_punGeneration = generation;
+        return &clients_[slot];
+    }
+
+    // ClientAdd that holds push_mtx_ when exclusive or the client type asks
+    // for it, so no Put runs while the client starts: accept() may still turn
+    // the client down before it's activated, start(client) runs after.
+    template <typename Accept, typename Start>
+    bool ClientAdd(ClientID* _unClientID, const ClientOptions& _rOptions, bool _bExclusive, Accept accept,
+            Start start) {
+        if (!max_buffers_ || !Policy::Accepts(_rOptions.overflow)) {
+            return false;
+        }
+        std::lock_guard lck(registry_mtx_);
+        if (clients_count_ >= max_clients_) {
+            return false;
+        }
+        // lowest free slot keeps the scanned range short
+        size_t slot = 0;
+        while (Client::IsActive(clients_[slot].Generation())) {
+            ++slot;
+        }
+        auto& client = clients_[slot];
+        uint32_t generation;
+        if (_bExclusive || client.AddExclusive(_rOptions)) {
+            std::lock_guard push_lck(push_mtx_);
+            if (!accept()) {
+                return false;
+            }
+            std::lock_guard client_lck(client.mtx_);
+            generation = client.Activate(_rOptions);
+            if (generation) {
+                start(client);
+            }
+        } else {
+            std::lock_guard client_lck(client.mtx_);
+            generation = client.Activate(_rOptions);
+        }
+        if (!generation) {
+            return false;
+        }
+        if (slot >= clients_end_) {
+            clients_end_.store(slot + 1, std::memory_order_release);
+        }
+        ++clients_count_;
+        *_unClientID = Client::MakeId(slot, generation);
+        Tracer::Instant(TraceEvent::CLIENT_ADD, *_unClientID);
+        return true;
+    }
+
+    // Get of whatever pop(client) takes from a client with frames
+    template <typename Pop>
+    ISplitterError Pull(ClientID _nClientID, int32_t _nTimeOutMsec, Pop pop) {
+        ISplitterError res = ISplitterError::NO_ERROR;
+
+        uint32_t generation;
+        auto client = FindClient(_nClientID, &generation);
+        if (!client) {
+            return ISplitterError::UNKNOWN_CLIENT;
+        }
+
+        auto lck = metrics_.Lock(client->mtx_);
+        auto ready = [&]() {
+            return !client->Alive(generation) || !client->IsQueueEmpty();
+        };
+        if (!ready() && ((_nTimeOutMsec <= 0) ||
+                !client->WaitPull(lck, _nTimeOutMsec, ready))) {
+            Tracer::Instant(TraceEvent::GET_TIMEOUT, _nClientID);
+            return ISplitterError::TIMEOUT;
+        }
+
+        if (!client->Alive(generation)) {
+            Tracer::Instant(TraceEvent::GET_EOS, _nClientID);
+            res = ISplitterError::EOS;
+        } else {
+            pop(*client);
+        }
+
+        // only a Put stalled on this client is interested in the freed slot
+        bool wake_producer = std::exchange(client->producer_waiting_, false) || hooks_.ProducerWaits();
+        lck.unlock();
+        if (wake_producer) {
+            WakeProducer();
+        }
+        return res;
+    }
+
+    void WakeProducer() {
+        // taking the lock orders this notify after Put has started to wait
+        std::lock_guard lck(push_mtx_);
+        NotifyProducer();
+    }
+
+    void NotifyProducer(ISplitterError reason = ISplitterError::NO_ERROR) {
+        ++push_wakeups_;
+        if (producers_parked_) {
+            clock_->NotifyAll(push_cv_);
+            Metrics::CountWakeup(metrics_.push_wakeups_);
+        }
+        hooks_.ProducersWoken(reason);
+    }
+
+    ISplitterError PutFrames(std::span<const Frame> frames, int32_t timeout_msec, std::vector<ClientID>* timed_out) {
+        Tracer::Begin(TraceEvent::PUT, 0, frames.size());
+        auto exit_time = clock_->Now() + std::chrono::milliseconds(timeout_msec);
+        auto lck = metrics_.Lock(push_mtx_);
+        auto seq = put_seq_;
+        put_seq_ += frames.size();
+        auto res = Deliver(lck, frames, seq, exit_time, timed_out);
+        lck.unlock();
+        Tracer::End(TraceEvent::PUT, 0, static_cast<uint64_t>(res));
+        return res;
+    }
+
+    // Delivers frames numbered from seq on, called with push_mtx_ held
+    ISplitterError Deliver(std::unique_lock<std::mutex>& lck, std::span<const Frame> frames, uint64_t seq,
+            SplitterClock::time_point exit_time, std::vector<ClientID>* timed_out) {
+        ISplitterError res = ISplitterError::NO_ERROR;
+        auto epoch = abort_epoch_;
+        std::vector<Stalled> stall;
+        DeliverFirst(frames, seq, stall);
+
+        auto stall_stamp = stall.empty() ? 0 : metrics_.Stamp();
+
+        // until we have time - try to put buffers to clients
+        while (stall.size() && (res != ISplitterError::TIMEOUT)) {
+            // a spent timeout only gets the retry below, no sleep
+            if (clock_->Now() >= exit_time) {
+                res = ISplitterError::TIMEOUT;
+            } else {
+                ++producers_parked_;
+                res = clock_->WaitUntil(push_cv_, lck, exit_time) ? res : ISplitterError::TIMEOUT;
+                --producers_parked_;
+            }
+
+            if (abort_epoch_ != epoch) {
+                res = abort_reason_;
+                DeliverAbort(frames, seq, stall);
+                break;
+            }
+
+            DeliverRetry(frames, seq, stall);
+        }
+
+        DeliverForce(frames, seq, stall, timed_out);
+
+        // BLOCK clients are left, they are waited for with no deadline
+        while (stall.size()) {
+            ++producers_parked_;
+            clock_->Wait(push_cv_, lck);
+            --producers_parked_;
+            if (abort_epoch_ != epoch) {
+                res = abort_reason_;
+                DeliverAbort(frames, seq, stall);
+                break;
+            }
+            DeliverRetry(frames, seq, stall);
+        }
+        Metrics::RecordSince(metrics_.put_stall_, stall_stamp);
+
+        return res;
+    }
+
+    // steps of Deliver, called with push_mtx_ held
+    void DeliverFirst(std::span<const Frame> frames, uint64_t seq, std::vector<Stalled>& stall) {
+        auto clients_end = clients_end_.load(std::memory_order_acquire);
+
+        // put buffers to clients than doesn't stall and collect stalled
+        for (size_t slot = 0; slot < clients_end; ++slot) {
+            auto& client = clients_[slot];
+            auto generation = client.Generation();
+            // a single frame the client skips doesn't need its lock
+            if (!Client::IsActive(generation) || ((frames.size() == 1) && !client.Admit(frames[0]))) {
+                continue;
+            }
+            auto client_lck = metrics_.Lock(client.mtx_);
+            if (!client.Alive(generation)) {
+                continue;
+            }
+            // an earlier Put stalled on the client goes first
+            auto pushed = client.InLine(seq) ? client.PushBuffers(frames, false) : 0;
+            if (pushed < frames.size()) {
+                client.StallAdd(seq + pushed);
+                stall.push_back({&client, generation, pushed});
+            }
+        }
+    }
+
+    // the stalled clients left are moved to the front of stall, erasing them
+    // one by one would take quadratic time with thousands stalled
+    void DeliverRetry(std::span<const Frame> frames, uint64_t seq, std::vector<Stalled>& stall) {
+        size_t kept = 0;
+        for (auto& stalled : stall) {
+            auto& [client, generation, next] = stalled;
+            std::lock_guard client_lck(client->mtx_);
+            bool alive = client->Alive(generation);
+            auto next_seq = seq + next;
+            if (alive && client->InLine(next_seq)) {
+                next += client->PushBuffers(frames.subspan(next), false);
+            }
+            if (!alive) {
+                continue;
+            } else if (next == frames.size()) {
+                Unstall(*client, next_seq);
+                continue;
+            }
+            client->StallMove(next_seq, seq + next);
+            stall[kept++] = stalled;
+        }
+        stall.resize(kept);
+    }
+
+    void DeliverForce(std::span<const Frame> frames, uint64_t seq, std::vector<Stalled>& stall,
+            std::vector<ClientID>* timed_out = nullptr) {
+        // now we can't wait - force push buffer to FIFO. it will drop old buffers
+        size_t kept = 0;
+        for (auto& stalled : stall) {
+            auto& [client, generation, next] = stalled;
+            std::lock_guard client_lck(client->mtx_);
+            if (!client->Alive(generation)) {
+                continue;
+            }
+            auto id = Client::MakeId(client - clients_.get(), generation);
+            if (timed_out && (std::find(timed_out->begin(), timed_out->end(), id) == timed_out->end())) {
+                timed_out->push_back(id);
+            }
+            if (client->Overflow() == OverflowPolicy::BLOCK) {
+                stall[kept++] = stalled;
+                continue;
+            }
+            // behind an earlier Put the frames can't go in without breaking
+            // the order, this Put's are dropped instead
+            auto next_seq = seq + next;
+            if (client->InLine(next_seq)) {
+                client->PushBuffers(frames.subspan(next), true);
+            } else {
+                client->DropBuffers(frames.subspan(next));
+            }
+            Unstall(*client, next_seq);
+        }
+        stall.resize(kept);
+    }
+
+    void DeliverAbort(std::span<const Frame> frames, uint64_t seq, std::vector<Stalled>& stall) {
+        (void)frames;
+        for (auto& [client, generation, next] : stall) {
+            std::lock_guard client_lck(client->mtx_);
+            if (client->Alive(generation)) {
+                Unstall(*client, seq + next);
+            }
+        }
+        stall.clear();
+    }
+
+    // takes a Put off the client at its frame seq, the next Put in line may
+    // go on. Called with push_mtx_ and the client lock held.
+    void Unstall(Client& client, uint64_t seq) {
+        if (client.StallRemove(seq)) {
+            NotifyProducer();
+        }
+    }
+
+    Hooks hooks_;
+    const std::shared_ptr<SplitterClock> clock_;
+    Metrics metrics_;
+    // Put, Flush and Close; Put waits on push_cv_ with it for stalled clients
+    mutable std::mutex push_mtx_;
+    std::condition_variable push_cv_;
+    // Flush and Close count up abort_epoch_ and stalled Puts that see it
+    // change return abort_reason_, all of them. Guarded by push_mtx_.
+    uint64_t abort_epoch_;
+    ISplitterError abort_reason_;
+    // counts wakeups of stalled producers, guarded by push_mtx_
+    uint64_t push_wakeups_;
+    // Put calls waiting on push_cv_, guarded by push_mtx_
+    size_t producers_parked_;
+    uint64_t put_seq_;  // frames put, guarded by push_mtx_
+    // serializes ClientAdd/ClientRemove/Close and clients iteration. Put and
+    // Get never take it, they check the generation of a client slot instead.
+    mutable std::mutex registry_mtx_;
+    // max_clients_ slots allocated once, slots from clients_end_ on are free
+    std::unique_ptr<Client[]> clients_;
+    std::atomic<size_t> clients_end_;
+    std::atomic<size_t> clients_count_;
+    const size_t max_buffers_;
+    const size_t max_clients_;
+
+private:
+    BasicSplitter(size_t max_buffers, size_t max_clients, std::shared_ptr<SplitterClock> clock, Hooks hooks,
+            std::in_place_t):
+      hooks_(std::move(hooks)),
+      clock_(clock ? std::move(clock) : SteadyClockGet()),
+      abort_epoch_(0),
+      abort_reason_(ISplitterError::NO_ERROR),
+      push_wakeups_(0),
+      producers_parked_(0),
+      put_seq_(0),
+      clients_(new Client[max_clients]),
+      clients_end_(0),
+      clients_count_(0),
+      max_buffers_(max_buffers),
+      max_clients_(max_clients) {
+        assert(max_clients_ <= UINT32_MAX);
+        for (size_t slot = 0; slot < max_clients_; ++slot) {
+            hooks_.Setup(clients_[slot], slot, max_buffers_, &metrics_, clock_.get());
+        }
+    }
+};
+
+template <typename Frame, size_t Capacity, typename Policy = DropOldestPolicy>
+inline std::shared_ptr<BasicSplitter<Frame, Capacity, Policy>> BasicSplitterCreate(size_t _zMaxClients,
+        std::shared_ptr<SplitterClock> _pClock = nullptr) requires (Capacity != std::dynamic_extent) {
+    return std::make_shared<BasicSplitter<Frame, Capacity, Policy>>(_zMaxClients, std::move(_pClock));
+}
+
+template <typename Frame, typename Policy = DropOldestPolicy>
+inline std::shared_ptr<BasicSplitter<Frame, std::dynamic_extent, Policy>> BasicSplitterCreate(size_t _zMaxBuffers,
+        size_t _zMaxClients, std::shared_ptr<SplitterClock> _pClock = nullptr) {
+    if (!_zMaxBuffers) {
+        return nullptr;
+    }
+    return std::make_shared<BasicSplitter<Frame, std::dynamic_extent, Policy>>(_zMaxBuffers, _zMaxClients,
+        std::move(_pClock));
+}
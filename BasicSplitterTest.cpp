@@ -0,0 +1,267 @@
+#include <gtest/gtest.h>
+
+#include "BasicSplitter.h"
+#include "SplitterSim.h"
+
+using namespace std::chrono_literals;
+
+struct Telemetry {
+    int64_t stamp;
+    uint32_t source;
+    uint32_t flags;
+    double values[6];
+};
+
+static_assert(sizeof(BasicQueue<Telemetry, 8>) <= 8 * sizeof(Telemetry) + 2 * sizeof(size_t));
+
+TEST(Fifo, BasicSplitter) {
+    BasicSplitter<Telemetry, 4> s(2);
+    size_t max_buffers, max_clients;
+    EXPECT_TRUE(s.InfoGet(&max_buffers, &max_clients));
+    EXPECT_EQ(max_buffers, 4u);
+    EXPECT_EQ(max_clients, 2u);
+
+    ClientID id1, id2;
+    ASSERT_TRUE(s.ClientAdd(&id1));
+    ASSERT_TRUE(s.ClientAdd(&id2));
+    for (int64_t i = 0; i < 4; ++i) {
+        EXPECT_EQ(s.Put({i, 7, 0, {}}, 0), ISplitterError::NO_ERROR);
+    }
+    for (auto id : {id1, id2}) {
+        for (int64_t i = 0; i < 4; ++i) {
+            Telemetry record;
+            EXPECT_EQ(s.Get(id, record, 1000), ISplitterError::NO_ERROR);
+            EXPECT_EQ(record.stamp, i);
+            EXPECT_EQ(record.source, 7u);
+        }
+        Telemetry record;
+        EXPECT_EQ(s.TryGet(id, record), ISplitterError::TIMEOUT);
+    }
+}
+
+TEST(DropOldest, BasicSplitter) {
+    BasicSplitter<int, 2> s(1);
+    ClientID id;
+    ASSERT_TRUE(s.ClientAdd(&id));
+    std::vector<ClientID> timed_out;
+    for (int i = 0; i < 4; ++i) {
+        s.Put(i, 0, &timed_out);
+    }
+    EXPECT_EQ(timed_out, std::vector<ClientID>{id});
+
+    int frame;
+    EXPECT_EQ(s.TryGet(id, frame), ISplitterError::NO_ERROR);
+    EXPECT_EQ(frame, 2);
+    EXPECT_EQ(s.TryGet(id, frame), ISplitterError::NO_ERROR);
+    EXPECT_EQ(frame, 3);
+
+    std::vector<ClientStats> stats;
+    EXPECT_TRUE(s.ClientsStatsGet(&stats));
+    ASSERT_EQ(stats.size(), 1u);
+    EXPECT_EQ(stats[0].id, id);
+    EXPECT_EQ(stats[0].dropped, 2u);
+    EXPECT_EQ(stats[0].delivered, 2u);
+    EXPECT_EQ(stats[0].latency, 0u);
+}
+
+TEST(DropNewest, BasicSplitter) {
+    BasicSplitter<int, 2, DropNewestPolicy> s(1);
+    ClientID id;
+    ASSERT_TRUE(s.ClientAdd(&id));
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(s.Put(i, 0), (i < 2) ? ISplitterError::NO_ERROR : ISplitterError::TIMEOUT);
+    }
+    int frame;
+    EXPECT_EQ(s.TryGet(id, frame), ISplitterError::NO_ERROR);
+    EXPECT_EQ(frame, 0);
+    EXPECT_EQ(s.TryGet(id, frame), ISplitterError::NO_ERROR);
+    EXPECT_EQ(frame, 1);
+}
+
+TEST(PutWaitsForConsumer, BasicSplitter) {
+    auto clock = SimClockCreate();
+    BasicSplitter<int, 1> s(1, clock);
+    ClientID id;
+    ASSERT_TRUE(s.ClientAdd(&id));
+
+    SimRun run(clock);
+    std::vector<SimRun::time_point> put;
+    run.Thread([&]() {
+        EXPECT_EQ(s.Put(0, 1000), ISplitterError::NO_ERROR);
+        EXPECT_EQ(s.Put(1, 1000), ISplitterError::NO_ERROR);
+        put.push_back(clock->Now());
+        EXPECT_EQ(s.Put(2, 1000), ISplitterError::TIMEOUT);
+        put.push_back(clock->Now());
+    });
+    run.At(SimRun::time_point(300ms), [&]() {
+        int frame;
+        EXPECT_EQ(s.TryGet(id, frame), ISplitterError::NO_ERROR);
+        EXPECT_EQ(frame, 0);
+    });
+    EXPECT_TRUE(run.Run());
+    EXPECT_EQ(put, (std::vector<SimRun::time_point>{SimRun::time_point(300ms), SimRun::time_point(1300ms)}));
+    int frame;
+    EXPECT_EQ(s.TryGet(id, frame), ISplitterError::NO_ERROR);
+    EXPECT_EQ(frame, 2);
+}
+
+TEST(BlockPastTimeout, BasicSplitter) {
+    auto clock = SimClockCreate();
+    BasicSplitter<int, 1, BlockPolicy> s(1, clock);
+    ClientID id;
+    ASSERT_TRUE(s.ClientAdd(&id));
+
+    SimRun run(clock);
+    run.Thread([&]() {
+        s.Put(0, 0);
+        std::vector<ClientID> timed_out;
+        EXPECT_EQ(s.Put(1, 100, &timed_out), ISplitterError::TIMEOUT);
+        EXPECT_EQ(timed_out, std::vector<ClientID>{id});
+        EXPECT_EQ(clock->Now(), SimRun::time_point(5s));
+    });
+    run.At(SimRun::time_point(5s), [&]() {
+        int frame;
+        EXPECT_EQ(s.TryGet(id, frame), ISplitterError::NO_ERROR);
+    });
+    EXPECT_TRUE(run.Run());
+    std::vector<ClientStats> stats;
+    s.ClientsStatsGet(&stats);
+    EXPECT_EQ(stats[0].dropped, 0u);
+    EXPECT_EQ(stats[0].latency, 1u);
+}
+
+TEST(RemoveAndClose, BasicSplitter) {
+    auto clock = SimClockCreate();
+    BasicSplitter<int, 1, BlockPolicy> s(2, clock);
+    ClientID id1, id2;
+    ASSERT_TRUE(s.ClientAdd(&id1));
+    ASSERT_TRUE(s.ClientAdd(&id2));
+    ClientID id3;
+    EXPECT_FALSE(s.ClientAdd(&id3));
+
+    SimRun run(clock);
+    run.Thread([&]() {
+        int frame;
+        EXPECT_EQ(s.Get(id1, frame, std::numeric_limits<int32_t>::max()), ISplitterError::EOS);
+    });
+    run.At(SimRun::time_point(1s), [&]() {
+        EXPECT_TRUE(s.ClientRemove(id1));
+    });
+    EXPECT_TRUE(run.Run());
+    EXPECT_FALSE(s.ClientRemove(id1));
+    int frame;
+    EXPECT_EQ(s.Get(id1, frame, 0), ISplitterError::UNKNOWN_CLIENT);
+
+    // the slot is reused, the old ID doesn't match it
+    ASSERT_TRUE(s.ClientAdd(&id3));
+    EXPECT_NE(id1, id3);
+    size_t count;
+    EXPECT_TRUE(s.ClientGetCount(&count));
+    EXPECT_EQ(count, 2u);
+
+    s.Put(0, 0);
+    run.Thread([&]() {
+        EXPECT_EQ(s.Put(1, std::numeric_limits<int32_t>::max()), ISplitterError::CLOSED);
+    });
+    run.At(SimRun::time_point(2s), [&]() {
+        s.Close();
+    });
+    EXPECT_TRUE(run.Run());
+    EXPECT_TRUE(s.ClientGetCount(&count));
+    EXPECT_EQ(count, 0u);
+    EXPECT_EQ(s.Put(2, 0), ISplitterError::NO_ERROR);
+}
+
+TEST(RuntimeCapacity, BasicSplitter) {
+    auto s = BasicSplitterCreate<Telemetry>(3, 1);
+    size_t max_buffers, max_clients;
+    EXPECT_TRUE(s->InfoGet(&max_buffers, &max_clients));
+    EXPECT_EQ(max_buffers, 3u);
+    EXPECT_EQ(max_clients, 1u);
+
+    ClientID id;
+    ASSERT_TRUE(s->ClientAdd(&id));
+    for (int64_t i = 0; i < 5; ++i) {
+        s->Put({i, 0, 0, {}}, 0);
+    }
+    std::vector<Telemetry> records;
+    EXPECT_EQ(s->GetBatch(id, records, 8, 0), ISplitterError::NO_ERROR);
+    ASSERT_EQ(records.size(), 3u);
+    EXPECT_EQ(records[0].stamp, 2);
+    EXPECT_EQ(records[2].stamp, 4);
+}
+
+TEST(ZeroCapacity, BasicSplitter) {
+    EXPECT_EQ(BasicSplitterCreate<Telemetry>(0, 1), nullptr);
+    BasicSplitter<Telemetry, std::dynamic_extent> s(0, 1);
+    size_t max_buffers, max_clients;
+    EXPECT_FALSE(s.InfoGet(&max_buffers, &max_clients));
+    ClientID id;
+    EXPECT_FALSE(s.ClientAdd(&id));
+    EXPECT_EQ(s.Put({0, 0, 0, {}}, 0), ISplitterError::NO_ERROR);
+
+    EXPECT_EQ(SplitterCreate(0, 1), nullptr);
+    ISplitter splitter(0, 1);
+    EXPECT_FALSE(splitter.ClientAdd(&id));
+    EXPECT_EQ(splitter.Put(std::make_shared<std::vector<uint8_t>>(16), 0), ISplitterError::NO_ERROR);
+}
+
+TEST(ClientPolicy, BasicSplitter) {
+    BasicSplitter<int, 1, ClientPolicy> s(2);
+    ClientOptions newest;
+    newest.overflow = OverflowPolicy::DROP_NEWEST;
+    ClientID oldest_id, newest_id;
+    ASSERT_TRUE(s.ClientAdd(&oldest_id));
+    ASSERT_TRUE(s.ClientAdd(&newest_id, newest));
+    s.Put(0, 0);
+    s.Put(1, 0);
+
+    int frame;
+    EXPECT_EQ(s.TryGet(oldest_id, frame), ISplitterError::NO_ERROR);
+    EXPECT_EQ(frame, 1);
+    EXPECT_EQ(s.TryGet(newest_id, frame), ISplitterError::NO_ERROR);
+    EXPECT_EQ(frame, 0);
+
+    // what a frame of its own can't carry is refused
+    ClientOptions keyframe;
+    keyframe.overflow = OverflowPolicy::KEYFRAME;
+    ClientID id;
+    EXPECT_TRUE(s.ClientRemove(oldest_id));
+    EXPECT_FALSE(s.ClientAdd(&id, keyframe));
+    BasicSplitter<int, 1, BlockPolicy> block(1);
+    EXPECT_FALSE(block.ClientAdd(&id, newest));
+}
+
+TEST(FlushAndIteration, BasicSplitter) {
+    BasicSplitter<int, 2, BlockPolicy> s(3);
+    ClientID ids[3];
+    for (auto& id : ids) {
+        ASSERT_TRUE(s.ClientAdd(&id));
+    }
+    EXPECT_TRUE(s.ClientRemove(ids[1]));
+    s.Put(0, 0);
+    s.Put(1, 0);
+
+    {
+        auto lock = s.BeginClientsIteration();
+        size_t count;
+        EXPECT_TRUE(s.ClientGetCount(&count, lock));
+        EXPECT_EQ(count, 2u);
+        ClientID id;
+        size_t latency, dropped;
+        EXPECT_TRUE(s.ClientGetByIndex(1, &id, &latency, &dropped, lock));
+        EXPECT_EQ(id, ids[2]);
+        EXPECT_EQ(latency, 2u);
+        EXPECT_EQ(dropped, 0u);
+        EXPECT_FALSE(s.ClientGetByIndex(2, &id, &latency, &dropped, lock));
+    }
+
+    EXPECT_EQ(s.Flush(), ISplitterError::NO_ERROR);
+    int frame;
+    EXPECT_EQ(s.TryGet(ids[0], frame), ISplitterError::TIMEOUT);
+    std::vector<ClientStats> stats;
+    s.ClientsStatsGet(&stats);
+    ASSERT_EQ(stats.size(), 2u);
+    EXPECT_EQ(stats[0].dropped, 2u);
+    EXPECT_EQ(stats[0].latency, 0u);
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#include "Splitter.h"
+#include <thread>
+
+static std::vector<FrameBuffer> MakeFrames(size_t count) {
+    std::vector<FrameBuffer> fbs;
+    for (size_t i = 0; i < count; ++i) {
+        fbs.push_back(std::make_shared<std::vector<uint8_t>>(100));
+    }
+    return fbs;
+}
+
+TEST(PutGetNoDrop, Batch) {
+    ISplitter s(4, 2);
+
+    ClientID client1;
+    EXPECT_TRUE(s.ClientAdd(&client1));
+
+    auto fbs = MakeFrames(4);
+    EXPECT_EQ(s.PutBatch(fbs, 1000), ISplitterError::NO_ERROR);
+
+    std::vector<FrameBuffer> got;
+    EXPECT_EQ(s.GetBatch(client1, got, 3, 1000), ISplitterError::NO_ERROR);
+    ASSERT_EQ(got.size(), 3);
+    EXPECT_EQ(got[0], fbs[0]);
+    EXPECT_EQ(got[2], fbs[2]);
+
+    EXPECT_EQ(s.GetBatch(client1, got, 3, 1000), ISplitterError::NO_ERROR);
+    ASSERT_EQ(got.size(), 1);
+    EXPECT_EQ(got[0], fbs[3]);
+
+    EXPECT_EQ(s.GetBatch(client1, got, 3, 100), ISplitterError::TIMEOUT);
+    EXPECT_TRUE(got.empty());
+}
+
+TEST(PutDrop, Batch) {
+    for (auto engine : {SplitterEngine::QUEUE, SplitterEngine::RING}) {
+        SplitterOptions options;
+        options.engine = engine;
+        ISplitter s(2, 2, options);
+
+        ClientID client1;
+        EXPECT_TRUE(s.ClientAdd(&client1));
+
+        auto fbs = MakeFrames(5);
+        EXPECT_EQ(s.PutBatch(fbs, 50), ISplitterError::TIMEOUT);
+
+        std::vector<FrameBuffer> got;
+        EXPECT_EQ(s.GetBatch(client1, got, 10, 1000), ISplitterError::NO_ERROR);
+        ASSERT_EQ(got.size(), 2);
+        EXPECT_EQ(got[0], fbs[3]);
+        EXPECT_EQ(got[1], fbs[4]);
+
+        auto lock = s.BeginClientsIteration();
+        ClientID id;
+        size_t latency;
+        size_t drops;
+        EXPECT_TRUE(s.ClientGetByIndex(0, &id, &latency, &drops, lock));
+        EXPECT_EQ(drops, 3);
+    }
+}
+
+TEST(StalledPutThreaded, Batch) {
+    int num_bufs = 10;
+    ISplitter s(2, 2);
+
+    ClientID client1;
+    EXPECT_TRUE(s.ClientAdd(&client1));
+
+    auto fbs = MakeFrames(num_bufs);
+
+    std::thread pop_thread([&]() {
+        std::vector<FrameBuffer> got;
+        for (int i = 0; i < num_bufs;) {
+            auto res = s.GetBatch(client1, got, 3, 1000);
+            EXPECT_EQ(res, ISplitterError::NO_ERROR);
+            for (auto& fb : got) {
+                EXPECT_EQ(fb, fbs[i++]);
+            }
+        }
+    });
+
+    EXPECT_EQ(s.PutBatch(fbs, 1000), ISplitterError::NO_ERROR);
+
+    pop_thread.join();
+}
@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+
+#include "Splitter.h"
+#include "TestFrames.h"
+#include <future>
+
+static size_t BytesHeld(const ISplitter& s) {
+    size_t bytes = 0;
+    EXPECT_TRUE(s.BytesHeldGet(&bytes));
+    return bytes;
+}
+
+TEST(SharedFrameCountedOnce, ByteBudget) {
+    SplitterOptions options;
+    options.max_bytes = 1000;
+    ISplitter s(4, 3, options);
+    std::vector<ClientID> clients(3);
+    for (auto& client : clients) {
+        EXPECT_TRUE(s.ClientAdd(&client));
+    }
+
+    s.Put(MakeFrame(0, 100), 0);
+    s.Put(MakeFrame(0, 50), 0);
+    EXPECT_EQ(BytesHeld(s), 150u);
+
+    std::vector<ClientStats> stats;
+    EXPECT_TRUE(s.ClientsStatsGet(&stats));
+    for (auto& client_stats : stats) {
+        EXPECT_EQ(client_stats.bytes, 150u);
+    }
+
+    // the first frame is held until the last client takes it
+    FrameBuffer fb;
+    EXPECT_EQ(s.Get(clients[0], fb, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(s.Get(clients[1], fb, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(BytesHeld(s), 150u);
+    EXPECT_EQ(s.Get(clients[2], fb, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(BytesHeld(s), 50u);
+
+    EXPECT_TRUE(s.ClientsStatsGet(&stats));
+    EXPECT_EQ(stats[0].bytes, 50u);
+
+    s.Flush();
+    EXPECT_EQ(BytesHeld(s), 0u);
+}
+
+TEST(NotCountedWithoutBudget, ByteBudget) {
+    ISplitter s(4, 1);
+    size_t bytes;
+    EXPECT_FALSE(s.BytesHeldGet(&bytes));
+}
+
+TEST(BatchLargerThanPool, ByteBudget) {
+    SplitterOptions options;
+    options.max_bytes = 1000;
+    ISplitter s(1, 1, options);
+    ClientID client;
+    EXPECT_TRUE(s.ClientAdd(&client));
+
+    // the pool has records for the queue and a batch of max_buffers + 1
+    std::vector<FrameBuffer> batch;
+    for (int i = 0; i < 5; ++i) {
+        batch.push_back(MakeFrame(0, 100));
+    }
+    s.PutBatch(batch, 0);
+    EXPECT_EQ(BytesHeld(s), 100u);
+
+    FrameBuffer fb;
+    EXPECT_EQ(s.Get(client, fb, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(fb, batch.back());
+    EXPECT_EQ(BytesHeld(s), 0u);
+}
+
+TEST(ClientBudget, ByteBudget) {
+    SplitterOptions options;
+    options.max_client_bytes = 250;
+    ISplitter s(10, 1, options);
+    ClientID client;
+    EXPECT_TRUE(s.ClientAdd(&client));
+
+    std::vector<FrameBuffer> bufs = {MakeFrame(0, 100), MakeFrame(0, 100), MakeFrame(0, 100)};
+    EXPECT_EQ(s.Put(bufs[0], 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(s.Put(bufs[1], 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(s.Put(bufs[2], 0), ISplitterError::TIMEOUT);
+
+    std::vector<ClientStats> stats;
+    EXPECT_TRUE(s.ClientsStatsGet(&stats));
+    EXPECT_EQ(stats[0].bytes, 200u);
+    EXPECT_EQ(stats[0].dropped, 1u);
+
+    FrameBuffer fb;
+    EXPECT_EQ(s.Get(client, fb, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(fb, bufs[1]);
+    EXPECT_EQ(s.Get(client, fb, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(fb, bufs[2]);
+
+    // a frame over the budget still gets into an empty queue
+    EXPECT_EQ(s.Put(MakeFrame(0, 1000), 0), ISplitterError::NO_ERROR);
+    EXPECT_TRUE(s.ClientsStatsGet(&stats));
+    EXPECT_EQ(stats[0].bytes, 1000u);
+}
+
+TEST(GlobalBudgetEvictsOldest, ByteBudget) {
+    SplitterOptions options;
+    options.max_bytes = 300;
+    ISplitter s(10, 2, options);
+    ClientID client1;
+    ClientID client2;
+    EXPECT_TRUE(s.ClientAdd(&client1));
+    EXPECT_TRUE(s.ClientAdd(&client2));
+
+    std::vector<FrameBuffer> bufs;
+    for (int i = 0; i < 5; ++i) {
+        bufs.push_back(MakeFrame(0, 100));
+        auto res = s.Put(bufs.back(), 0);
+        EXPECT_EQ(res, i < 3 ? ISplitterError::NO_ERROR : ISplitterError::TIMEOUT);
+        EXPECT_LE(BytesHeld(s), 300u);
+    }
+
+    for (auto client : {client1, client2}) {
+        std::vector<FrameBuffer> got;
+        EXPECT_EQ(s.GetBatch(client, got, 10, 0), ISplitterError::NO_ERROR);
+        EXPECT_EQ(got, std::vector<FrameBuffer>(bufs.begin() + 2, bufs.end()));
+    }
+    EXPECT_EQ(BytesHeld(s), 0u);
+}
+
+TEST(GlobalBudgetWaitsForConsumer, ByteBudget) {
+    SplitterOptions options;
+    options.max_bytes = 200;
+    ISplitter s(10, 1, options);
+    ClientID client;
+    EXPECT_TRUE(s.ClientAdd(&client));
+
+    s.Put(MakeFrame(0, 100), 0);
+    s.Put(MakeFrame(0, 100), 0);
+    auto put = std::async(std::launch::async, [&]() {
+        return s.Put(MakeFrame(0, 100), 5000);
+    });
+    EXPECT_EQ(put.wait_for(std::chrono::milliseconds(50)), std::future_status::timeout);
+
+    FrameBuffer fb;
+    EXPECT_EQ(s.Get(client, fb, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(put.get(), ISplitterError::NO_ERROR);
+    EXPECT_EQ(BytesHeld(s), 200u);
+
+    std::vector<ClientStats> stats;
+    EXPECT_TRUE(s.ClientsStatsGet(&stats));
+    EXPECT_EQ(stats[0].dropped, 0u);
+}
+
+TEST(RingBytes, ByteBudget) {
+    SplitterOptions options;
+    options.engine = SplitterEngine::RING;
+    ISplitter s(2, 1, options);
+    ClientID client;
+    EXPECT_TRUE(s.ClientAdd(&client));
+
+    s.Put(MakeFrame(0, 100), 0);
+    s.Put(MakeFrame(0, 50), 0);
+    EXPECT_EQ(BytesHeld(s), 150u);
+
+    std::vector<ClientStats> stats;
+    EXPECT_TRUE(s.ClientsStatsGet(&stats));
+    EXPECT_EQ(stats[0].bytes, 150u);
+
+    FrameBuffer fb;
+    EXPECT_EQ(s.Get(client, fb, 0), ISplitterError::NO_ERROR);
+    EXPECT_TRUE(s.ClientsStatsGet(&stats));
+    EXPECT_EQ(stats[0].bytes, 50u);
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include "Splitter.h"
+#include "SplitterSim.h"
 #include <thread>
 
 TEST(Add, Clients) {
@@ -103,7 +104,10 @@ TEST(ClosePull, Clients) {
 
 
 TEST(StopUntillPull, Clients) {
-    ISplitter s(1, 1);
+    auto clock = SimClockCreate();
+    SplitterOptions options;
+    options.clock = clock;
+    ISplitter s(1, 1, options);
 
     ClientID client1;
     EXPECT_TRUE(s.ClientAdd(&client1));
@@ -111,7 +115,8 @@ TEST(StopUntillPull, Clients) {
     FrameBuffer fb0 = std::make_shared<std::vector<uint8_t>>(100);
     FrameBuffer fb1 = std::make_shared<std::vector<uint8_t>>(100);
 
-    std::thread pull_thread([&]() {
+    SimRun run(clock);
+    run.Thread([&]() {
         FrameBuffer fb;
         auto res = s.Get(client1, fb, std::numeric_limits<int32_t>::max());
         EXPECT_EQ(fb, fb0);
@@ -123,26 +128,30 @@ TEST(StopUntillPull, Clients) {
         res = s.Get(client1, fb, std::numeric_limits<int32_t>::max());
         EXPECT_EQ(res, ISplitterError::EOS);
     });
+    run.Thread([&]() {
+        auto res = s.Put(fb0, std::numeric_limits<int32_t>::max());
+        EXPECT_EQ(res, ISplitterError::NO_ERROR);
 
-    auto res = s.Put(fb0, std::numeric_limits<int32_t>::max());
-    EXPECT_EQ(res, ISplitterError::NO_ERROR);
-
-    res = s.Put(fb1, std::numeric_limits<int32_t>::max());
-    EXPECT_EQ(res, ISplitterError::NO_ERROR);
-
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000)); //test may be flaky
-    s.Close();
-
-    pull_thread.join();
+        res = s.Put(fb1, std::numeric_limits<int32_t>::max());
+        EXPECT_EQ(res, ISplitterError::NO_ERROR);
+    });
+    run.At(SimRun::time_point(std::chrono::seconds(1)), [&]() {
+        s.Close();
+    });
+    EXPECT_TRUE(run.Run());
 }
 
 TEST(StopUntillPush, Clients) {
-    ISplitter s(1, 1);
+    auto clock = SimClockCreate();
+    SplitterOptions options;
+    options.clock = clock;
+    ISplitter s(1, 1, options);
 
     ClientID client1;
     EXPECT_TRUE(s.ClientAdd(&client1));
 
-    std::thread push_thread([&]() {
+    SimRun run(clock);
+    run.Thread([&]() {
         FrameBuffer fb0 = std::make_shared<std::vector<uint8_t>>(100);
         FrameBuffer fb1 = std::make_shared<std::vector<uint8_t>>(100);
         FrameBuffer fb2 = std::make_shared<std::vector<uint8_t>>(100);
@@ -155,13 +164,59 @@ TEST(StopUntillPush, Clients) {
         res = s.Put(fb2, std::numeric_limits<int32_t>::max());
         EXPECT_EQ(res, ISplitterError::CLOSED);
     });
+    run.Thread([&]() {
+        FrameBuffer fb;
+        auto res = s.Get(client1, fb, std::numeric_limits<int32_t>::max());
+        EXPECT_EQ(res, ISplitterError::NO_ERROR);
+    });
+    run.At(SimRun::time_point(std::chrono::seconds(1)), [&]() {
+        s.Close();
+    });
+    EXPECT_TRUE(run.Run());
+}
 
-    FrameBuffer fb;
-    auto res = s.Get(client1, fb, std::numeric_limits<int32_t>::max());
-    EXPECT_EQ(res, ISplitterError::NO_ERROR);
+TEST(StaleId, Clients) {
+    ISplitter s(1, 1);
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000)); //test may be flaky
-    s.Close();
+    ClientID client1;
+    ClientID client2;
+    EXPECT_TRUE(s.ClientAdd(&client1));
+    EXPECT_TRUE(s.ClientRemove(client1));
+    // same slot is reused, old ID must not match it
+    EXPECT_TRUE(s.ClientAdd(&client2));
+    EXPECT_NE(client1, client2);
+
+    auto fb = std::make_shared<std::vector<uint8_t>>(100);
+    EXPECT_EQ(s.Put(fb, 0), ISplitterError::NO_ERROR);
 
-    push_thread.join();
-}
\ No newline at end of file
+    FrameBuffer got;
+    EXPECT_EQ(s.Get(client1, got, 0), ISplitterError::UNKNOWN_CLIENT);
+    EXPECT_FALSE(s.ClientRemove(client1));
+    EXPECT_EQ(s.Get(client2, got, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(got, fb);
+
+    EXPECT_EQ(s.Get(0, got, 0), ISplitterError::UNKNOWN_CLIENT);
+    EXPECT_EQ(s.Get(~ClientID(0), got, 0), ISplitterError::UNKNOWN_CLIENT);
+}
+
+TEST(IterateAfterRemove, Clients) {
+    ISplitter s(1, 3);
+
+    ClientID client1;
+    ClientID client2;
+    ClientID client3;
+    EXPECT_TRUE(s.ClientAdd(&client1));
+    EXPECT_TRUE(s.ClientAdd(&client2));
+    EXPECT_TRUE(s.ClientAdd(&client3));
+    EXPECT_TRUE(s.ClientRemove(client2));
+
+    auto lock = s.BeginClientsIteration();
+    ClientID id;
+    size_t latency;
+    size_t drops;
+    EXPECT_TRUE(s.ClientGetByIndex(0, &id, &latency, &drops, lock));
+    EXPECT_EQ(id, client1);
+    EXPECT_TRUE(s.ClientGetByIndex(1, &id, &latency, &drops, lock));
+    EXPECT_EQ(id, client3);
+    EXPECT_FALSE(s.ClientGetByIndex(2, &id, &latency, &drops, lock));
+}
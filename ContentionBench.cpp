@@ -0,0 +1,115 @@
+#include <benchmark/benchmark.h>
+
+#include "Splitter.h"
+#include <thread>
+
+// Get throughput against the number of consumer threads. Every benchmark
+// thread is one client; a background producer keeps all queues non-empty,
+// dropping frames for clients that fall behind instead of stalling.
+//
+// Put throughput against the number of producer threads, every benchmark
+// thread is a producer and background consumers drain a few clients.
+
+namespace {
+
+std::shared_ptr<ISplitter> splitter;
+std::atomic_bool producing;
+std::thread producer;
+
+void StartProducer(const benchmark::State& state) {
+    SplitterOptions options;
+    options.engine = static_cast<SplitterEngine>(state.range(0));
+    splitter = SplitterCreate(64, 1024, options);
+    producing = true;
+    producer = std::thread([]() {
+        auto fb = std::make_shared<std::vector<uint8_t>>(64);
+        while (producing) {
+            splitter->Put(fb, 0);
+        }
+    });
+}
+
+void StopProducer(const benchmark::State&) {
+    producing = false;
+    producer.join();
+    splitter.reset();
+}
+
+void BM_GetContention(benchmark::State& state) {
+    ClientID id;
+    if (!splitter->ClientAdd(&id)) {
+        state.SkipWithError("ClientAdd failed");
+        return;
+    }
+
+    FrameBuffer fb;
+    for (auto _ : state) {
+        auto res = splitter->Get(id, fb, 1000);
+        benchmark::DoNotOptimize(res);
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    splitter->ClientRemove(id);
+}
+
+constexpr size_t kPutClients = 4;
+std::atomic_bool consuming;
+std::vector<std::thread> consumers;
+
+void StartConsumers(const benchmark::State& state) {
+    SplitterOptions options;
+    options.engine = static_cast<SplitterEngine>(state.range(0));
+    splitter = SplitterCreate(64, kPutClients, options);
+    consuming = true;
+    for (size_t i = 0; i < kPutClients; ++i) {
+        ClientID id;
+        splitter->ClientAdd(&id);
+        consumers.emplace_back([id]() {
+            std::vector<FrameBuffer> fbs;
+            while (consuming) {
+                splitter->GetBatch(id, fbs, 64, 10);
+            }
+        });
+    }
+}
+
+void StopConsumers(const benchmark::State&) {
+    consuming = false;
+    for (auto& consumer : consumers) {
+        consumer.join();
+    }
+    consumers.clear();
+    splitter.reset();
+}
+
+void BM_PutContention(benchmark::State& state) {
+    auto fb = std::make_shared<std::vector<uint8_t>>(64);
+    int64_t timeouts = 0;
+    for (auto _ : state) {
+        if (splitter->Put(fb, 1000) == ISplitterError::TIMEOUT) {
+            ++timeouts;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["timeouts"] = static_cast<double>(timeouts);
+}
+
+}
+
+BENCHMARK(BM_PutContention)
+    ->ArgName("engine")
+    ->Arg(static_cast<int64_t>(SplitterEngine::QUEUE))
+    ->Arg(static_cast<int64_t>(SplitterEngine::RING))
+    ->Setup(StartConsumers)
+    ->Teardown(StopConsumers)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+BENCHMARK(BM_GetContention)
+    ->ArgName("engine")
+    ->Arg(static_cast<int64_t>(SplitterEngine::QUEUE))
+    ->Arg(static_cast<int64_t>(SplitterEngine::RING))
+    ->Setup(StartProducer)
+    ->Teardown(StopProducer)
+    ->ThreadRange(1, 32)
+    ->UseRealTime();
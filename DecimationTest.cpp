@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+
+#include "Splitter.h"
+#include "TestFrames.h"
+#include <thread>
+
+static ClientStats StatsOf(ISplitter& s, ClientID client) {
+    std::vector<ClientStats> stats;
+    s.ClientsStatsGet(&stats);
+    for (auto& client_stats : stats) {
+        if (client_stats.id == client) {
+            return client_stats;
+        }
+    }
+    ADD_FAILURE() << "no client " << client;
+    return {};
+}
+
+TEST(EveryNth, Decimation) {
+    ISplitter s(16, 2);
+    ClientOptions options;
+    options.every_nth = 3;
+    ClientID thumb;
+    ClientID all;
+    ASSERT_TRUE(s.ClientAdd(&thumb, options));
+    ASSERT_TRUE(s.ClientAdd(&all));
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(s.Put(MakeFrame(i), 0), ISplitterError::NO_ERROR);
+    }
+    EXPECT_EQ(DrainValues(s, thumb), (std::vector<uint8_t>{0, 3, 6, 9}));
+    EXPECT_EQ(DrainValues(s, all).size(), 10u);
+
+    auto stats = StatsOf(s, thumb);
+    EXPECT_EQ(stats.skipped, 6u);
+    EXPECT_EQ(stats.dropped, 0u);
+    EXPECT_EQ(StatsOf(s, all).skipped, 0u);
+}
+
+TEST(KeyFramesOnly, Decimation) {
+    ISplitter s(16, 1);
+    ClientOptions options;
+    options.keyframes_only = true;
+    ClientID client;
+    ASSERT_TRUE(s.ClientAdd(&client, options));
+    std::vector<FrameBuffer> batch;
+    for (int i = 0; i < 8; ++i) {
+        batch.push_back(MakeFrame(i, 16, i % 4 == 0));
+    }
+    EXPECT_EQ(s.PutBatch(batch, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(DrainValues(s, client), (std::vector<uint8_t>{0, 4}));
+    EXPECT_EQ(StatsOf(s, client).skipped, 6u);
+}
+
+TEST(MaxFps, Decimation) {
+    ISplitter s(64, 1);
+    ClientOptions options;
+    options.max_fps = 20;
+    options.max_fps_burst = 2;
+    ClientID client;
+    ASSERT_TRUE(s.ClientAdd(&client, options));
+    // a burst of two, then one frame per 50 ms
+    for (int i = 0; i < 5; ++i) {
+        s.Put(MakeFrame(i), 0);
+    }
+    EXPECT_EQ(DrainValues(s, client), (std::vector<uint8_t>{0, 1}));
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    for (int i = 5; i < 10; ++i) {
+        s.Put(MakeFrame(i), 0);
+    }
+    EXPECT_EQ(DrainValues(s, client), (std::vector<uint8_t>{5}));
+    EXPECT_EQ(StatsOf(s, client).skipped, 7u);
+}
+
+TEST(SkippedFramesDontStall, Decimation) {
+    ISplitter s(2, 1);
+    ClientOptions options;
+    options.every_nth = 4;
+    ClientID client;
+    ASSERT_TRUE(s.ClientAdd(&client, options));
+    // the queue of two takes eight frames put, nothing is dropped
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_EQ(s.Put(MakeFrame(i), 0), ISplitterError::NO_ERROR);
+    }
+    auto stats = StatsOf(s, client);
+    EXPECT_EQ(stats.dropped, 0u);
+    EXPECT_EQ(stats.skipped, 6u);
+    EXPECT_EQ(s.Put(MakeFrame(8), 0), ISplitterError::TIMEOUT);
+    EXPECT_EQ(StatsOf(s, client).dropped, 1u);
+}
+
+TEST(StalledBatchDecidedOnce, Decimation) {
+    ISplitter s(2, 1);
+    ClientOptions options;
+    options.every_nth = 2;
+    ClientID client;
+    ASSERT_TRUE(s.ClientAdd(&client, options));
+    std::vector<FrameBuffer> batch;
+    for (int i = 0; i < 8; ++i) {
+        batch.push_back(MakeFrame(i));
+    }
+    // frames 0 and 2 fill the queue, the consumer frees room for 4 and 6
+    auto consumer = std::thread([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        FrameBuffer fb;
+        for (int i = 0; i < 2; ++i) {
+            EXPECT_EQ(s.Get(client, fb, 1000), ISplitterError::NO_ERROR);
+        }
+    });
+    EXPECT_EQ(s.PutBatch(batch, 1000), ISplitterError::NO_ERROR);
+    consumer.join();
+    EXPECT_EQ(DrainValues(s, client), (std::vector<uint8_t>{4, 6}));
+    EXPECT_EQ(StatsOf(s, client).skipped, 4u);
+}
+
+TEST(SlotReusedWithout, Decimation) {
+    ISplitter s(16, 1);
+    ClientOptions options;
+    options.every_nth = 2;
+    ClientID client;
+    ASSERT_TRUE(s.ClientAdd(&client, options));
+    s.Put(MakeFrame(0), 0);
+    s.Put(MakeFrame(1), 0);
+    ASSERT_TRUE(s.ClientRemove(client));
+    ASSERT_TRUE(s.ClientAdd(&client));
+    s.Put(MakeFrame(2), 0);
+    s.Put(MakeFrame(3), 0);
+    EXPECT_EQ(DrainValues(s, client), (std::vector<uint8_t>{2, 3}));
+    EXPECT_EQ(StatsOf(s, client).skipped, 0u);
+}
+
+TEST(BackgroundDelivery, Decimation) {
+    SplitterOptions splitter_options;
+    splitter_options.background_delivery = true;
+    ISplitter s(2, 1, splitter_options);
+    ClientOptions options;
+    options.every_nth = 2;
+    ClientID client;
+    ASSERT_TRUE(s.ClientAdd(&client, options));
+    for (int i = 0; i < 6; ++i) {
+        s.Put(MakeFrame(i), 1000);
+    }
+    // 0 and 2 queued, 4 set aside
+    EXPECT_EQ(DrainValues(s, client), (std::vector<uint8_t>{0, 2, 4}));
+    EXPECT_EQ(StatsOf(s, client).skipped, 3u);
+}
+
+TEST(RingEngineRejects, Decimation) {
+    SplitterOptions splitter_options;
+    splitter_options.engine = SplitterEngine::RING;
+    ISplitter s(4, 1, splitter_options);
+    ClientOptions options;
+    options.keyframes_only = true;
+    ClientID client;
+    EXPECT_FALSE(s.ClientAdd(&client, options));
+}
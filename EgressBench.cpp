@@ -0,0 +1,108 @@
+#include <benchmark/benchmark.h>
+
+#include "FramePool.h"
+#include "SplitterEgress.h"
+#include <thread>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Loopback TCP fan-out through SplitterEgress. Every iteration puts one frame
+// for all viewers; Put waits for the egress, so the rate is what the sockets
+// take. Reports Gbit/s received by all viewers together and CPU of the egress
+// workers per viewer, in % of a core.
+
+namespace {
+
+constexpr size_t kFrameSize = 64 * 1024;
+
+// viewers connected over 127.0.0.1, each drained by its own thread
+class Viewers {
+public:
+    Viewers(SplitterEgress& egress, size_t count):
+      received_(0) {
+        int listener = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addr_len = sizeof(addr);
+        bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        listen(listener, static_cast<int>(count));
+        getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+
+        for (size_t i = 0; i < count; ++i) {
+            int viewer = socket(AF_INET, SOCK_STREAM, 0);
+            connect(viewer, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            ClientID id;
+            egress.SocketAdd(accept(listener, nullptr, nullptr), &id);
+            threads_.emplace_back([this, viewer]() {
+                std::vector<uint8_t> buf(1 << 20);
+                ssize_t n;
+                while ((n = read(viewer, buf.data(), buf.size())) > 0) {
+                    received_ += n;
+                }
+                close(viewer);
+            });
+        }
+        close(listener);
+    }
+
+    // the viewers see EOF once the splitter is closed
+    ~Viewers() {
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    uint64_t Received() const {
+        return received_;
+    }
+
+private:
+    std::atomic<uint64_t> received_;
+    std::vector<std::thread> threads_;
+};
+
+void BM_EgressLoopback(benchmark::State& state) {
+    auto viewer_count = static_cast<size_t>(state.range(0));
+    auto splitter = SplitterCreate(64, viewer_count);
+    EgressOptions options;
+    options.threads = std::min<size_t>(viewer_count, 2);
+    options.zerocopy = state.range(1);
+    auto egress = SplitterEgressCreate(splitter, options);
+    auto pool = FramePoolCreate(kFrameSize, 256);
+    {
+        Viewers viewers(*egress, viewer_count);
+
+        std::chrono::nanoseconds cpu_start;
+        egress->CpuTimeGet(&cpu_start);
+        auto received_start = viewers.Received();
+        auto start = std::chrono::steady_clock::now();
+        for (auto _ : state) {
+            splitter->Put(pool->Acquire(), 1000);
+        }
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::chrono::nanoseconds cpu_end;
+        egress->CpuTimeGet(&cpu_end);
+        auto cpu_seconds = std::chrono::duration<double>(cpu_end - cpu_start).count();
+
+        state.counters["Gbit/s"] = (viewers.Received() - received_start) * 8 / seconds / 1e9;
+        state.counters["cpu_per_viewer_%"] = cpu_seconds / seconds / viewer_count * 100;
+        std::vector<ClientStats> stats;
+        splitter->ClientsStatsGet(&stats);
+        size_t dropped = 0;
+        for (auto& client_stats : stats) {
+            dropped += client_stats.dropped;
+        }
+        state.counters["dropped"] = static_cast<double>(dropped);
+        splitter->Close();
+    }
+    state.SetBytesProcessed(state.iterations() * kFrameSize * viewer_count);
+}
+
+}
+
+BENCHMARK(BM_EgressLoopback)
+    ->ArgNames({"viewers", "zerocopy"})
+    ->ArgsProduct({{1, 4, 16}, {0, 1}})
+    ->UseRealTime();
@@ -0,0 +1,224 @@
+#include <gtest/gtest.h>
+
+#include "SplitterEgress.h"
+#include "TestFrames.h"
+#include <algorithm>
+#include <thread>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// reads until nothing comes for timeout_msec or the peer closes
+static std::vector<uint8_t> ReadAll(int fd, int timeout_msec = 200) {
+    std::vector<uint8_t> res;
+    uint8_t buf[65536];
+    pollfd pfd = {fd, POLLIN, 0};
+    while (poll(&pfd, 1, timeout_msec) > 0) {
+        auto n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        res.insert(res.end(), buf, buf + n);
+    }
+    return res;
+}
+
+template <typename Pred>
+static bool WaitFor(Pred pred) {
+    for (int i = 0; i < 1000; ++i) {
+        if (pred()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return false;
+}
+
+TEST(SendsFramesInOrder, Egress) {
+    auto s = SplitterCreate(16, 2);
+    auto egress = SplitterEgressCreate(s);
+    int sv[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+    ClientID id;
+    ASSERT_TRUE(egress->SocketAdd(sv[0], &id));
+
+    std::vector<uint8_t> expected;
+    for (int i = 0; i < 10; ++i) {
+        auto fb = MakeFrame(i, 1000 + i);
+        expected.insert(expected.end(), fb->begin(), fb->end());
+        EXPECT_EQ(s->Put(fb, 1000), ISplitterError::NO_ERROR);
+    }
+    EXPECT_EQ(ReadAll(sv[1]), expected);
+
+    std::vector<EgressStats> stats;
+    EXPECT_TRUE(egress->StatsGet(&stats));
+    ASSERT_EQ(stats.size(), 1u);
+    EXPECT_EQ(stats[0].id, id);
+    EXPECT_EQ(stats[0].frames, 10u);
+    EXPECT_EQ(stats[0].bytes, expected.size());
+    EXPECT_FALSE(stats[0].zerocopy);
+    close(sv[1]);
+}
+
+// epoll refuses a regular file, the fd comes back unchanged
+TEST(AddFailsFdUnchanged, Egress) {
+    auto s = SplitterCreate(4, 1);
+    auto egress = SplitterEgressCreate(s);
+    FILE* file = tmpfile();
+    ASSERT_TRUE(file);
+    int fd = fileno(file);
+    int flags = fcntl(fd, F_GETFL);
+    ClientID id;
+    EXPECT_FALSE(egress->SocketAdd(fd, &id));
+    EXPECT_EQ(fcntl(fd, F_GETFL), flags);
+    size_t count;
+    EXPECT_TRUE(s->ClientGetCount(&count));
+    EXPECT_EQ(count, 0u);
+    fclose(file);
+}
+
+TEST(BackpressureDropsWholeFrames, Egress) {
+    constexpr size_t kFrameSize = 64 * 1024;
+    constexpr int kFrames = 100;
+    auto s = SplitterCreate(4, 1);
+    auto egress = SplitterEgressCreate(s);
+    int sv[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+    ClientID id;
+    ASSERT_TRUE(egress->SocketAdd(sv[0], &id));
+
+    // nobody reads, the socket fills up and then the client queue
+    for (int i = 0; i < kFrames; ++i) {
+        s->Put(MakeFrame(i, kFrameSize), 0);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    auto received = ReadAll(sv[1]);
+
+    std::vector<ClientStats> client_stats;
+    EXPECT_TRUE(s->ClientsStatsGet(&client_stats));
+    ASSERT_EQ(client_stats.size(), 1u);
+    EXPECT_GT(client_stats[0].dropped, 0u);
+    EXPECT_EQ(client_stats[0].dropped + client_stats[0].delivered, size_t(kFrames));
+
+    std::vector<EgressStats> stats;
+    EXPECT_TRUE(egress->StatsGet(&stats));
+    EXPECT_GT(stats[0].blocked, 0u);
+    EXPECT_EQ(stats[0].frames, client_stats[0].delivered);
+
+    // frames come whole and in order
+    ASSERT_EQ(received.size(), stats[0].frames * kFrameSize);
+    int last = -1;
+    for (size_t offset = 0; offset < received.size(); offset += kFrameSize) {
+        EXPECT_GT(int(received[offset]), last);
+        last = received[offset];
+        EXPECT_EQ(std::count(received.begin() + offset, received.begin() + offset + kFrameSize, received[offset]),
+            ptrdiff_t(kFrameSize));
+    }
+    close(sv[1]);
+}
+
+TEST(PeerGone, Egress) {
+    auto s = SplitterCreate(4, 2);
+    auto egress = SplitterEgressCreate(s, EgressOptions{2, false});
+    int sv1[2];
+    int sv2[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv1), 0);
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv2), 0);
+    ClientID id1;
+    ClientID id2;
+    ASSERT_TRUE(egress->SocketAdd(sv1[0], &id1));
+    ASSERT_TRUE(egress->SocketAdd(sv2[0], &id2));
+
+    close(sv1[1]);
+    EXPECT_EQ(s->Put(MakeFrame(1, 100), 0), ISplitterError::NO_ERROR);
+    EXPECT_TRUE(WaitFor([&]() {
+        size_t count;
+        s->ClientGetCount(&count);
+        return count == 1;
+    }));
+    EXPECT_EQ(ReadAll(sv2[1]).size(), 100u);
+
+    // removing the client closes its socket
+    EXPECT_TRUE(egress->SocketRemove(id2));
+    EXPECT_TRUE(WaitFor([&]() {
+        size_t count;
+        egress->SocketGetCount(&count);
+        return count == 0;
+    }));
+    char c;
+    EXPECT_EQ(read(sv2[1], &c, 1), 0);
+    close(sv2[1]);
+}
+
+TEST(RemoveBlocked, Egress) {
+    auto s = SplitterCreate(4, 1);
+    auto egress = SplitterEgressCreate(s);
+    int sv[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+    ClientID id;
+    ASSERT_TRUE(egress->SocketAdd(sv[0], &id));
+
+    // the peer never reads, the connection waits for the socket
+    EXPECT_TRUE(WaitFor([&]() {
+        s->Put(MakeFrame(1, 64 * 1024), 0);
+        std::vector<EgressStats> stats;
+        egress->StatsGet(&stats);
+        return stats[0].blocked > 0;
+    }));
+
+    EXPECT_TRUE(egress->SocketRemove(id));
+    EXPECT_TRUE(WaitFor([&]() {
+        size_t count;
+        egress->SocketGetCount(&count);
+        return count == 0;
+    }));
+    // the socket was closed, the peer reads what was sent up to the end
+    ASSERT_EQ(fcntl(sv[1], F_SETFL, O_NONBLOCK), 0);
+    ReadAll(sv[1]);
+    char c;
+    EXPECT_EQ(read(sv[1], &c, 1), 0);
+    close(sv[1]);
+}
+
+TEST(ZeroCopyTcp, Egress) {
+    constexpr size_t kFrameSize = 256 * 1024;
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    ASSERT_EQ(bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    ASSERT_EQ(listen(listener, 1), 0);
+    ASSERT_EQ(getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &addr_len), 0);
+    int viewer = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_EQ(connect(viewer, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    int conn = accept(listener, nullptr, nullptr);
+    close(listener);
+
+    auto s = SplitterCreate(8, 1);
+    auto egress = SplitterEgressCreate(s, EgressOptions{1, true});
+    ClientID id;
+    ASSERT_TRUE(egress->SocketAdd(conn, &id));
+
+    std::vector<uint8_t> expected;
+    std::vector<FrameBuffer> frames;
+    for (int i = 0; i < 20; ++i) {
+        frames.push_back(MakeFrame(i, kFrameSize));
+        expected.insert(expected.end(), frames.back()->begin(), frames.back()->end());
+    }
+    auto reader = std::thread([&]() {
+        EXPECT_EQ(ReadAll(viewer, 500), expected);
+    });
+    for (auto& fb : frames) {
+        EXPECT_EQ(s->Put(fb, 5000), ISplitterError::NO_ERROR);
+    }
+    reader.join();
+
+    std::vector<EgressStats> stats;
+    EXPECT_TRUE(egress->StatsGet(&stats));
+    EXPECT_EQ(stats[0].frames, 20u);
+    EXPECT_TRUE(stats[0].zerocopy);
+    close(viewer);
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include "Splitter.h"
+#include <poll.h>
+#include <thread>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+static bool Readable(int fd) {
+    pollfd pfd = {fd, POLLIN, 0};
+    return (poll(&pfd, 1, 0) == 1) && (pfd.revents & POLLIN);
+}
+
+TEST(Readiness, EventFd) {
+    for (auto engine : {SplitterEngine::QUEUE, SplitterEngine::RING}) {
+        SplitterOptions options;
+        options.engine = engine;
+        ISplitter s(2, 2, options);
+
+        ClientOptions client_options;
+        client_options.event_fd = true;
+        ClientID client1;
+        ClientID client2;
+        EXPECT_TRUE(s.ClientAdd(&client1, client_options));
+        EXPECT_TRUE(s.ClientAdd(&client2));
+        EXPECT_EQ(s.ClientEventFdGet(client2), -1);
+
+        int fd = s.ClientEventFdGet(client1);
+        ASSERT_GE(fd, 0);
+        EXPECT_FALSE(Readable(fd));
+
+        auto fb = std::make_shared<std::vector<uint8_t>>(100);
+        s.Put(fb, 0);
+        s.Put(fb, 0);
+        EXPECT_TRUE(Readable(fd));
+
+        FrameBuffer got;
+        EXPECT_EQ(s.TryGet(client1, got), ISplitterError::NO_ERROR);
+        EXPECT_TRUE(Readable(fd));
+        EXPECT_EQ(s.TryGet(client1, got), ISplitterError::NO_ERROR);
+        EXPECT_FALSE(Readable(fd));
+        EXPECT_EQ(s.TryGet(client1, got), ISplitterError::TIMEOUT);
+
+        s.Put(fb, 0);
+        EXPECT_TRUE(Readable(fd));
+        s.Flush();
+        EXPECT_FALSE(Readable(fd));
+
+        EXPECT_TRUE(s.ClientRemove(client1));
+        EXPECT_TRUE(Readable(fd));
+        EXPECT_EQ(s.TryGet(client1, got), ISplitterError::UNKNOWN_CLIENT);
+        close(fd);
+    }
+}
+
+TEST(Reactor, EventFd) {
+    const int num_clients = 8;
+    const int num_bufs = 100;
+    ISplitter s(4, num_clients);
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    ASSERT_GE(epfd, 0);
+
+    ClientOptions client_options;
+    client_options.event_fd = true;
+    std::vector<ClientID> clients(num_clients);
+    std::vector<int> fds(num_clients);
+    std::vector<int> received(num_clients, 0);
+    for (int i = 0; i < num_clients; ++i) {
+        EXPECT_TRUE(s.ClientAdd(&clients[i], client_options));
+        fds[i] = s.ClientEventFdGet(clients[i]);
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        EXPECT_EQ(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev), 0);
+    }
+
+    std::thread producer([&]() {
+        auto fb = std::make_shared<std::vector<uint8_t>>(100);
+        for (int i = 0; i < num_bufs; ++i) {
+            EXPECT_EQ(s.Put(fb, 1000), ISplitterError::NO_ERROR);
+        }
+    });
+
+    // one thread serves every client
+    int total = 0;
+    while (total < num_clients * num_bufs) {
+        epoll_event events[num_clients];
+        int n = epoll_wait(epfd, events, num_clients, 1000);
+        ASSERT_GT(n, 0);
+        for (int e = 0; e < n; ++e) {
+            auto i = events[e].data.u32;
+            FrameBuffer got;
+            while (s.TryGet(clients[i], got) == ISplitterError::NO_ERROR) {
+                ++received[i];
+                ++total;
+            }
+        }
+    }
+    producer.join();
+
+    for (int i = 0; i < num_clients; ++i) {
+        EXPECT_EQ(received[i], num_bufs);
+        close(fds[i]);
+    }
+    close(epfd);
+}
@@ -0,0 +1,190 @@
+#include "FramePool.h"
+
+#include <cassert>
+#include <utility>
+
+namespace {
+
+// big enough for libstdc++/libc++ control block with our deleter and allocator
+constexpr size_t kControlBlockSize = 128;
+
+struct alignas(std::max_align_t) ControlBlock {
+    uint8_t storage[kControlBlockSize];
+};
+
+}
+
+class FramePoolImpl {
+public:
+    FramePoolImpl(size_t frame_size, size_t count):
+      hits_(0),
+      misses_(0) {
+        for (size_t i = 0; i < count; ++i) {
+            Grow(frame_size);
+        }
+    }
+
+    // miss is set when the pool was empty or the frame was too small
+    std::vector<uint8_t>* TakeFrame(size_t size, bool* miss) {
+        std::vector<uint8_t>* frame = nullptr;
+        bool grown = false;
+        {
+            std::lock_guard lck(mtx_);
+            if (free_frames_.empty()) {
+                Grow(size);
+                grown = true;
+            }
+            frame = free_frames_.back();
+            free_frames_.pop_back();
+        }
+        *miss = grown || (frame->capacity() < size);
+        frame->resize(size);
+        return frame;
+    }
+
+    void ReturnFrame(std::vector<uint8_t>* frame) {
+        std::lock_guard lck(mtx_);
+        free_frames_.push_back(frame);
+    }
+
+    // grown is set when no block was free and one was allocated
+    void* TakeBlock(bool* grown) {
+        std::lock_guard lck(mtx_);
+        // a block comes back after its frame, and only once weak_ptrs to the
+        // frame are gone, so the frame may be taken again before that
+        *grown = free_blocks_.empty();
+        if (*grown) {
+            GrowBlock();
+        }
+        auto block = free_blocks_.back();
+        free_blocks_.pop_back();
+        return block;
+    }
+
+    void ReturnBlock(void* block) {
+        std::lock_guard lck(mtx_);
+        free_blocks_.push_back(static_cast<ControlBlock*>(block));
+    }
+
+    size_t Count() const {
+        std::lock_guard lck(mtx_);
+        return frames_.size();
+    }
+
+    size_t Free() const {
+        std::lock_guard lck(mtx_);
+        return free_frames_.size();
+    }
+
+    std::atomic<size_t> hits_;
+    std::atomic<size_t> misses_;
+
+private:
+    // every frame gets its control block, so a frame taken from the free list
+    // usually has a block available. Free lists are reserved up front to never
+    // reallocate on return.
+    void Grow(size_t size) {
+        frames_.push_back(std::make_unique<std::vector<uint8_t>>(size));
+        free_frames_.reserve(frames_.size());
+        free_frames_.push_back(frames_.back().get());
+        GrowBlock();
+    }
+
+    void GrowBlock() {
+        blocks_.push_back(std::make_unique<ControlBlock>());
+        free_blocks_.reserve(blocks_.size());
+        free_blocks_.push_back(blocks_.back().get());
+    }
+
+    mutable std::mutex mtx_;
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> frames_;
+    std::vector<std::unique_ptr<ControlBlock>> blocks_;
+    std::vector<std::vector<uint8_t>*> free_frames_;
+    std::vector<ControlBlock*> free_blocks_;
+};
+
+namespace {
+
+// Hands the block taken from the pool by Acquire to the shared_ptr control
+// block. It holds the pool alive while the control block is destroyed, the
+// deleter runs before that.
+template <typename T>
+struct BlockAllocator {
+    using value_type = T;
+
+    BlockAllocator(std::shared_ptr<FramePoolImpl> pool, void* block):
+      pool_(std::move(pool)),
+      block_(block) {
+    }
+
+    template <typename U>
+    BlockAllocator(const BlockAllocator<U>& other):
+      pool_(other.pool_),
+      block_(other.block_) {
+    }
+
+    T* allocate(size_t n) {
+        static_assert(sizeof(T) <= kControlBlockSize, "control block doesn't fit pool block");
+        assert((n == 1) && block_);
+        (void)n;
+        return static_cast<T*>(std::exchange(block_, nullptr));
+    }
+
+    void deallocate(T* p, size_t) {
+        pool_->ReturnBlock(p);
+    }
+
+    template <typename U>
+    bool operator==(const BlockAllocator<U>& other) const {
+        return pool_ == other.pool_;
+    }
+
+    std::shared_ptr<FramePoolImpl> pool_;
+    void* block_;
+};
+
+struct FrameRecycler {
+    void operator()(std::vector<uint8_t>* frame) const {
+        pool_->ReturnFrame(frame);
+    }
+
+    FramePoolImpl* pool_;
+};
+
+}
+
+FramePool::FramePool(size_t frame_size, size_t count):
+  frame_size_(frame_size),
+  impl_(std::make_shared<FramePoolImpl>(frame_size, count)) {
+}
+
+FrameBuffer FramePool::Acquire(size_t _zSize) {
+    bool frame_miss;
+    auto frame = impl_->TakeFrame(_zSize, &frame_miss);
+    // taken here rather than in allocate, so a grown block counts as a miss
+    bool block_grown;
+    auto block = impl_->TakeBlock(&block_grown);
+    if (frame_miss || block_grown) {
+        ++impl_->misses_;
+    } else {
+        ++impl_->hits_;
+    }
+    return FrameBuffer(frame, FrameRecycler{impl_.get()}, BlockAllocator<uint8_t>(impl_, block));
+}
+
+FrameBuffer FramePool::Acquire() {
+    return Acquire(frame_size_);
+}
+
+bool FramePool::InfoGet(size_t* _pzFrameSize, size_t* _pzCount, size_t* _pzFree) const {
+    *_pzFrameSize = frame_size_;
+    *_pzCount = impl_->Count();
+    *_pzFree = impl_->Free();
+    return true;
+}
+
+bool FramePool::StatsGet(size_t* _pzHits, size_t* _pzMisses) const {
+    *_pzHits = impl_->hits_;
+    *_pzMisses = impl_->misses_;
+    return true;
+}
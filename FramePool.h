@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Splitter.h"
+
+// Pool of frame payloads. Frames handed out by Acquire go back to the pool
+// when the last reference is released, wherever that happens: after a
+// client's Get, on queue eviction or on Flush. The shared_ptr control block
+// is recycled too, so a pool hit doesn't allocate at all.
+class FramePool {
+public:
+    FramePool(size_t frame_size, size_t count);
+
+    // Frame of _zSize bytes. Content of a recycled frame is not cleared.
+    FrameBuffer Acquire(size_t _zSize);
+    FrameBuffer Acquire();
+
+    bool InfoGet(size_t* _pzFrameSize, size_t* _pzCount, size_t* _pzFree) const;
+    // hit - frame served without allocation, miss - pool was empty, the
+    // recycled frame was too small or its control block was still held by a
+    // weak_ptr
+    bool StatsGet(size_t* _pzHits, size_t* _pzMisses) const;
+
+private:
+    const size_t frame_size_;
+    // frames keep it alive, so the pool may be destroyed before them
+    std::shared_ptr<class FramePoolImpl> impl_;
+};
+
+inline std::shared_ptr<FramePool> FramePoolCreate(size_t _zFrameSize, size_t _zCount) {
+    return std::make_shared<FramePool>(_zFrameSize, _zCount);
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+
+#include "FramePool.h"
+#include <thread>
+
+TEST(HitMiss, FramePool) {
+    auto pool = FramePoolCreate(100, 2);
+
+    size_t hits;
+    size_t misses;
+    {
+        auto fb0 = pool->Acquire();
+        auto fb1 = pool->Acquire();
+        auto fb2 = pool->Acquire();
+        EXPECT_EQ(fb0->size(), 100);
+        EXPECT_TRUE(pool->StatsGet(&hits, &misses));
+        EXPECT_EQ(hits, 2);
+        EXPECT_EQ(misses, 1);
+    }
+
+    size_t frame_size;
+    size_t count;
+    size_t free;
+    EXPECT_TRUE(pool->InfoGet(&frame_size, &count, &free));
+    EXPECT_EQ(frame_size, 100);
+    EXPECT_EQ(count, 3);
+    EXPECT_EQ(free, 3);
+
+    auto fb = pool->Acquire(50);
+    EXPECT_EQ(fb->size(), 50);
+    EXPECT_TRUE(pool->StatsGet(&hits, &misses));
+    EXPECT_EQ(hits, 3);
+    EXPECT_EQ(misses, 1);
+}
+
+TEST(RecycleOnDropAndFlush, FramePool) {
+    auto pool = FramePoolCreate(100, 4);
+    ISplitter s(2, 1);
+
+    ClientID client1;
+    EXPECT_TRUE(s.ClientAdd(&client1));
+
+    // third frame evicts the first one
+    for (int i = 0; i < 3; ++i) {
+        s.Put(pool->Acquire(), 0);
+    }
+
+    size_t frame_size;
+    size_t count;
+    size_t free;
+    EXPECT_TRUE(pool->InfoGet(&frame_size, &count, &free));
+    EXPECT_EQ(free, 2);
+
+    s.Flush();
+    EXPECT_TRUE(pool->InfoGet(&frame_size, &count, &free));
+    EXPECT_EQ(free, 4);
+}
+
+TEST(FrameOutlivesPool, FramePool) {
+    auto pool = FramePoolCreate(100, 1);
+    auto fb = pool->Acquire();
+    pool.reset();
+    EXPECT_EQ(fb->size(), 100);
+}
+
+TEST(WeakRefHoldsBlock, FramePool) {
+    auto pool = FramePoolCreate(100, 1);
+    auto fb = pool->Acquire();
+    std::weak_ptr<std::vector<uint8_t>> weak = fb;
+    // the frame is back, its control block stays with the weak_ptr
+    fb.reset();
+    auto again = pool->Acquire();
+    EXPECT_EQ(again->size(), 100);
+    EXPECT_TRUE(weak.expired());
+
+    size_t hits;
+    size_t misses;
+    EXPECT_TRUE(pool->StatsGet(&hits, &misses));
+    // the second Acquire had to allocate a control block
+    EXPECT_EQ(hits, 1);
+    EXPECT_EQ(misses, 1);
+}
+
+TEST(ConcurrentAcquireRelease, FramePool) {
+    auto pool = FramePoolCreate(100, 2);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&pool]() {
+            for (int i = 0; i < 20000; ++i) {
+                auto fb = pool->Acquire();
+                (*fb)[0] = static_cast<uint8_t>(i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    size_t frame_size;
+    size_t count;
+    size_t free;
+    EXPECT_TRUE(pool->InfoGet(&frame_size, &count, &free));
+    EXPECT_EQ(free, count);
+}
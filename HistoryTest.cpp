@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include "Splitter.h"
+#include "TestFrames.h"
+#include <poll.h>
+#include <unistd.h>
+
+TEST(LastFrames, History) {
+    for (auto engine : {SplitterEngine::QUEUE, SplitterEngine::RING}) {
+        SplitterOptions options;
+        options.engine = engine;
+        // the ring keeps up to max_buffers
+        options.history = (engine == SplitterEngine::RING) ? 3 : 5;
+        ISplitter s(3, 4, options);
+
+        std::vector<FrameBuffer> bufs;
+        for (int i = 0; i < 6; ++i) {
+            bufs.push_back(MakeFrame(0, 100));
+            EXPECT_EQ(s.Put(bufs.back(), 0), ISplitterError::NO_ERROR);
+        }
+        auto two = AddClient(s, {.seed = HistorySeed::LAST_FRAMES, .seed_frames = 2});
+        auto all = AddClient(s, {.seed = HistorySeed::LAST_FRAMES, .seed_frames = 10});
+        auto none = AddClient(s, {.seed = HistorySeed::NONE});
+
+        // seeded frames come before the ones put after the client joined. The
+        // queue of all is full, the oldest seeded frame makes room.
+        auto next = MakeFrame(0, 100);
+        EXPECT_EQ(s.Put(next, 0), ISplitterError::TIMEOUT);
+        EXPECT_EQ(Drain(s, two), std::vector<FrameBuffer>({bufs[4], bufs[5], next}));
+        EXPECT_EQ(Drain(s, none), std::vector<FrameBuffer>({next}));
+        EXPECT_EQ(Drain(s, all), std::vector<FrameBuffer>({bufs[4], bufs[5], next}));
+    }
+}
+
+TEST(NoHistory, History) {
+    ISplitter s(3, 1);
+    s.Put(MakeFrame(0, 100), 0);
+    auto client = AddClient(s, {.seed = HistorySeed::LAST_FRAMES, .seed_frames = 2});
+    EXPECT_TRUE(Drain(s, client).empty());
+}
+
+TEST(LastKeyFrame, History) {
+    for (auto engine : {SplitterEngine::QUEUE, SplitterEngine::RING}) {
+        SplitterOptions options;
+        options.engine = engine;
+        options.history = (engine == SplitterEngine::RING) ? 3 : 10;
+        ISplitter s(3, 2, options);
+
+        std::vector<FrameBuffer> bufs = {MakeFrame(0, 100), MakeFrame(0, 100, false), MakeFrame(0, 100), MakeFrame(0, 100, false)};
+        for (auto& fb : bufs) {
+            s.Put(fb, 0);
+        }
+        auto client = AddClient(s, {.seed = HistorySeed::LAST_KEYFRAME});
+        EXPECT_EQ(Drain(s, client), std::vector<FrameBuffer>({bufs[2], bufs[3]}));
+        EXPECT_TRUE(s.ClientRemove(client));
+
+        // the run from the last keyframe is longer than the queue
+        for (int i = 0; i < 3; ++i) {
+            s.Put(MakeFrame(0, 100, false), 0);
+        }
+        client = AddClient(s, {.seed = HistorySeed::LAST_KEYFRAME});
+        EXPECT_TRUE(Drain(s, client).empty());
+    }
+}
+
+TEST(FlushClears, History) {
+    for (auto engine : {SplitterEngine::QUEUE, SplitterEngine::RING}) {
+        SplitterOptions options;
+        options.engine = engine;
+        options.history = 3;
+        ISplitter s(3, 1, options);
+        s.Put(MakeFrame(0, 100), 0);
+        s.Put(MakeFrame(0, 100), 0);
+        s.Flush();
+        auto client = AddClient(s, {.seed = HistorySeed::LAST_FRAMES, .seed_frames = 3});
+        EXPECT_TRUE(Drain(s, client).empty());
+    }
+}
+
+TEST(ByteBudget, History) {
+    SplitterOptions options;
+    options.history = 10;
+    options.max_bytes = 300;
+    ISplitter s(10, 1, options);
+
+    // no clients, the history alone holds the frames
+    for (int i = 0; i < 3; ++i) {
+        s.Put(MakeFrame(0, 100), 0);
+    }
+    size_t bytes;
+    EXPECT_TRUE(s.BytesHeldGet(&bytes));
+    EXPECT_EQ(bytes, 300u);
+
+    // over the budget the history lets go first, Put doesn't wait
+    auto last = MakeFrame(0, 100);
+    EXPECT_EQ(s.Put(last, 1000), ISplitterError::NO_ERROR);
+    EXPECT_TRUE(s.BytesHeldGet(&bytes));
+    EXPECT_EQ(bytes, 300u);
+
+    // a seeded frame is counted once
+    auto client = AddClient(s, {.seed = HistorySeed::LAST_FRAMES, .seed_frames = 1});
+    EXPECT_TRUE(s.BytesHeldGet(&bytes));
+    EXPECT_EQ(bytes, 300u);
+    EXPECT_EQ(Drain(s, client), std::vector<FrameBuffer>({last}));
+}
+
+TEST(EventFdReadable, History) {
+    SplitterOptions options;
+    options.history = 2;
+    ISplitter s(2, 1, options);
+    s.Put(MakeFrame(0, 100), 0);
+
+    ClientOptions client_options;
+    client_options.event_fd = true;
+    client_options.seed = HistorySeed::LAST_FRAMES;
+    client_options.seed_frames = 1;
+    ClientID client;
+    EXPECT_TRUE(s.ClientAdd(&client, client_options));
+    int fd = s.ClientEventFdGet(client);
+    ASSERT_GE(fd, 0);
+    pollfd pfd = {fd, POLLIN, 0};
+    EXPECT_EQ(poll(&pfd, 1, 0), 1);
+    close(fd);
+}
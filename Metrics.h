@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Copy of a Histogram. Bucket i counts values in [BucketLower(i), BucketUpper(i)].
+struct HistogramSnapshot {
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+
+    static uint64_t BucketLower(size_t i);
+    static uint64_t BucketUpper(size_t i);
+    // upper bound of the bucket holding the p-th fraction of values, 0 if empty
+    uint64_t Percentile(double p) const;
+};
+
+// Log-linear histogram of non-negative values (HDR style, 4 sub-buckets per
+// power of two, so ~25% precision). Record is a single relaxed atomic add
+// and may be called from any thread.
+class Histogram {
+public:
+    static constexpr size_t kSubBits = 2;
+    static constexpr size_t kBuckets = (64 - kSubBits + 1) << kSubBits;
+
+    Histogram();
+
+    void Record(uint64_t value) {
+        counts_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    HistogramSnapshot Snapshot() const;
+    void Reset();
+
+    static size_t BucketIndex(uint64_t value);
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> counts_;
+};
+
+// Events per wall second over the last kSeconds seconds
+class RateWindow {
+public:
+    static constexpr size_t kSeconds = 60;
+
+    RateWindow();
+
+    void Add(uint64_t n, int64_t now_sec);
+    // oldest second first, the last element is the current second
+    std::vector<uint64_t> Snapshot(int64_t now_sec) const;
+
+private:
+    mutable std::mutex mtx_;
+    std::array<int64_t, kSeconds> seconds_;
+    std::array<uint64_t, kSeconds> counts_;
+};
+
+// Instrumentation shared by a splitter and its clients. Everything is a no-op
+// until enabled, disabled instrumentation doesn't read the clock.
+class Metrics {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Metrics();
+
+    void Enable(bool enable) {
+        enabled_.store(enable, std::memory_order_relaxed);
+    }
+
+    bool Enabled() const {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    // nanoseconds since the clock epoch, 0 when disabled
+    int64_t Stamp() const {
+        return Enabled() ? Now() : 0;
+    }
+
+    static int64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    // records elapsed time since a Stamp, if there was one
+    static void RecordSince(Histogram& histogram, int64_t stamp) {
+        if (stamp) {
+            histogram.Record(static_cast<uint64_t>(std::max<int64_t>(Now() - stamp, 0)));
+        }
+    }
+
+    // locks mtx, recording the wait when it was contended
+    std::unique_lock<std::mutex> Lock(std::mutex& mtx) {
+        std::unique_lock lck(mtx, std::try_to_lock);
+        if (!lck.owns_lock()) {
+            auto stamp = Stamp();
+            lck.lock();
+            RecordSince(lock_wait_, stamp);
+        }
+        return lck;
+    }
+
+    // policy indexes policy_drops_, counted while disabled too
+    void RecordDrops(size_t policy, uint64_t n) {
+        policy_drops_[policy].fetch_add(n, std::memory_order_relaxed);
+        if (n && Enabled()) {
+            drops_.Add(n, Now() / 1000000000);
+        }
+    }
+
+    // counts a wakeup or an eventfd syscall. Unlike the rest it's counted
+    // while disabled too, the syscall costs far more than the add.
+    static void CountWakeup(std::atomic<uint64_t>& counter) {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Histogram put_stall_;
+    Histogram lock_wait_;
+    RateWindow drops_;
+    std::atomic<uint64_t> pull_wakeups_;      // notifies of parked Get calls
+    std::atomic<uint64_t> push_wakeups_;      // notifies of a parked Put
+    std::atomic<uint64_t> event_fd_syscalls_; // eventfd reads and writes
+    std::array<std::atomic<uint64_t>, 4> policy_drops_;  // by OverflowPolicy
+
+private:
+    std::atomic_bool enabled_;
+};
+
+inline uint64_t HistogramSnapshot::BucketLower(size_t i) {
+    constexpr size_t sub_count = 1 << Histogram::kSubBits;
+    if (i < sub_count) {
+        return i;
+    }
+    size_t shift = i / sub_count - 1;
+    return (sub_count + i % sub_count) << shift;
+}
+
+inline uint64_t HistogramSnapshot::BucketUpper(size_t i) {
+    if (i + 1 == Histogram::kBuckets) {
+        return UINT64_MAX;
+    }
+    return BucketLower(i + 1) - 1;
+}
+
+inline uint64_t HistogramSnapshot::Percentile(double p) const {
+    if (!total) {
+        return 0;
+    }
+    auto rank = static_cast<uint64_t>(p * static_cast<double>(total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return BucketUpper(i);
+        }
+    }
+    return BucketUpper(counts.size() - 1);
+}
+
+inline Histogram::Histogram() {
+    Reset();
+}
+
+inline void Histogram::Reset() {
+    for (auto& count : counts_) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+inline size_t Histogram::BucketIndex(uint64_t value) {
+    constexpr uint64_t sub_count = 1 << kSubBits;
+    if (value < sub_count) {
+        return value;
+    }
+    size_t msb = std::bit_width(value) - 1;
+    size_t shift = msb - kSubBits;
+    return (shift + 1) * sub_count + ((value >> shift) & (sub_count - 1));
+}
+
+inline HistogramSnapshot Histogram::Snapshot() const {
+    HistogramSnapshot res;
+    res.counts.resize(kBuckets);
+    for (size_t i = 0; i < kBuckets; ++i) {
+        res.counts[i] = counts_[i].load(std::memory_order_relaxed);
+        res.total += res.counts[i];
+    }
+    return res;
+}
+
+inline RateWindow::RateWindow() {
+    seconds_.fill(-1);
+    counts_.fill(0);
+}
+
+inline void RateWindow::Add(uint64_t n, int64_t now_sec) {
+    std::lock_guard lck(mtx_);
+    auto slot = static_cast<size_t>(now_sec) % kSeconds;
+    if (seconds_[slot] != now_sec) {
+        seconds_[slot] = now_sec;
+        counts_[slot] = 0;
+    }
+    counts_[slot] += n;
+}
+
+inline std::vector<uint64_t> RateWindow::Snapshot(int64_t now_sec) const {
+    std::lock_guard lck(mtx_);
+    std::vector<uint64_t> res(kSeconds, 0);
+    for (size_t i = 0; i < kSeconds; ++i) {
+        auto sec = now_sec - static_cast<int64_t>(kSeconds - 1 - i);
+        auto slot = static_cast<size_t>(sec) % kSeconds;
+        if (seconds_[slot] == sec) {
+            res[i] = counts_[slot];
+        }
+    }
+    return res;
+}
+
+inline Metrics::Metrics():
+  pull_wakeups_(0),
+  push_wakeups_(0),
+  event_fd_syscalls_(0),
+  enabled_(false) {
+    for (auto& drops : policy_drops_) {
+        drops.store(0, std::memory_order_relaxed);
+    }
+}
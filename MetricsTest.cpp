@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include "Splitter.h"
+#include <numeric>
+
+TEST(Buckets, Histogram) {
+    for (uint64_t value : std::initializer_list<uint64_t>{0, 1, 3, 4, 7, 8, 1000, 123456789, UINT64_MAX}) {
+        auto i = Histogram::BucketIndex(value);
+        EXPECT_LE(HistogramSnapshot::BucketLower(i), value);
+        EXPECT_GE(HistogramSnapshot::BucketUpper(i), value);
+    }
+
+    Histogram h;
+    for (uint64_t value = 1; value <= 100; ++value) {
+        h.Record(value);
+    }
+    auto snapshot = h.Snapshot();
+    EXPECT_EQ(snapshot.total, 100);
+    auto p50 = snapshot.Percentile(0.5);
+    EXPECT_GE(p50, 50);
+    EXPECT_LE(p50, 63);
+    EXPECT_GE(snapshot.Percentile(1.0), 100);
+}
+
+TEST(Disabled, Metrics) {
+    ISplitter s(1, 1);
+
+    ClientID client1;
+    EXPECT_TRUE(s.ClientAdd(&client1));
+
+    auto fb = std::make_shared<std::vector<uint8_t>>(100);
+    s.Put(fb, 0);
+    s.Put(fb, 10);
+    FrameBuffer got;
+    EXPECT_EQ(s.Get(client1, got, 0), ISplitterError::NO_ERROR);
+
+    SplitterMetrics metrics;
+    EXPECT_TRUE(s.MetricsGet(&metrics));
+    EXPECT_EQ(metrics.put_stall.total, 0);
+    EXPECT_EQ(std::accumulate(metrics.drops_per_second.begin(), metrics.drops_per_second.end(), 0ull), 0);
+    ASSERT_EQ(metrics.residence.size(), 1);
+    EXPECT_EQ(metrics.residence[0].second.total, 0);
+}
+
+TEST(StallDropResidence, Metrics) {
+    for (auto engine : {SplitterEngine::QUEUE, SplitterEngine::RING}) {
+        SplitterOptions options;
+        options.engine = engine;
+        ISplitter s(1, 2, options);
+        s.MetricsEnable(true);
+
+        ClientID client1;
+        ClientID client2;
+        EXPECT_TRUE(s.ClientAdd(&client1));
+        EXPECT_TRUE(s.ClientAdd(&client2));
+
+        auto fb = std::make_shared<std::vector<uint8_t>>(100);
+        EXPECT_EQ(s.Put(fb, 0), ISplitterError::NO_ERROR);
+        EXPECT_EQ(s.Put(fb, 20), ISplitterError::TIMEOUT);
+
+        FrameBuffer got;
+        EXPECT_EQ(s.Get(client1, got, 0), ISplitterError::NO_ERROR);
+
+        SplitterMetrics metrics;
+        EXPECT_TRUE(s.MetricsGet(&metrics));
+        EXPECT_EQ(metrics.put_stall.total, 1);
+        EXPECT_GE(metrics.put_stall.Percentile(1.0), 20000000);
+        EXPECT_EQ(std::accumulate(metrics.drops_per_second.begin(), metrics.drops_per_second.end(), 0ull), 2);
+        ASSERT_EQ(metrics.residence.size(), 2);
+        EXPECT_EQ(metrics.residence[0].first, client1);
+        EXPECT_EQ(metrics.residence[0].second.total, 1);
+        EXPECT_EQ(metrics.residence[1].second.total, 0);
+    }
+}
@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+
+#include "Splitter.h"
+#include "TestFrames.h"
+#include <map>
+#include <thread>
+
+// producer and index in the payload
+static FrameBuffer OriginFrame(uint32_t producer, uint32_t index) {
+    auto fb = MakeFrame(0, 8);
+    memcpy(fb->data(), &producer, sizeof(producer));
+    memcpy(fb->data() + 4, &index, sizeof(index));
+    return fb;
+}
+
+static std::pair<uint32_t, uint32_t> FrameOrigin(const FrameBuffer& fb) {
+    std::pair<uint32_t, uint32_t> res;
+    memcpy(&res.first, fb->data(), sizeof(res.first));
+    memcpy(&res.second, fb->data() + 4, sizeof(res.second));
+    return res;
+}
+
+TEST(TotalOrder, MultiProducer) {
+    constexpr uint32_t kProducers = 8;
+    constexpr uint32_t kFrames = 300;
+    constexpr size_t kClients = 4;
+    ISplitter s(4, kClients);
+
+    std::vector<ClientID> ids(kClients);
+    for (auto& id : ids) {
+        ASSERT_TRUE(s.ClientAdd(&id));
+    }
+    // seq -> frame, per client
+    std::vector<std::vector<std::pair<uint64_t, std::pair<uint32_t, uint32_t>>>> got(kClients);
+    std::vector<std::thread> consumers;
+    for (size_t c = 0; c < kClients; ++c) {
+        consumers.emplace_back([&, c]() {
+            FrameBuffer fb;
+            uint64_t seq;
+            while (true) {
+                auto res = s.Get(ids[c], fb, 20, &seq);
+                if (res == ISplitterError::EOS) {
+                    return;
+                } else if (res == ISplitterError::NO_ERROR) {
+                    got[c].push_back({seq, FrameOrigin(fb)});
+                    // the odd clients are slow, so Puts stall on them
+                    if (c % 2) {
+                        std::this_thread::sleep_for(std::chrono::microseconds(200));
+                    }
+                }
+            }
+        });
+    }
+    std::vector<std::thread> producers;
+    for (uint32_t p = 0; p < kProducers; ++p) {
+        producers.emplace_back([&, p]() {
+            for (uint32_t i = 0; i < kFrames; ++i) {
+                s.Put(OriginFrame(p, i), 1);
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    s.Close();
+    for (auto& consumer : consumers) {
+        consumer.join();
+    }
+
+    std::map<uint64_t, std::pair<uint32_t, uint32_t>> order;
+    for (size_t c = 0; c < kClients; ++c) {
+        ASSERT_FALSE(got[c].empty());
+        std::vector<uint32_t> last(kProducers, 0);
+        for (size_t i = 0; i < got[c].size(); ++i) {
+            auto& [seq, origin] = got[c][i];
+            // one order for all clients, and within it every producer's own
+            if (i) {
+                EXPECT_GT(seq, got[c][i - 1].first);
+            }
+            auto [it, inserted] = order.insert({seq, origin});
+            EXPECT_EQ(it->second, origin);
+            EXPECT_GE(origin.second, last[origin.first]);
+            last[origin.first] = origin.second + 1;
+        }
+    }
+    EXPECT_LE(order.size(), size_t(kProducers * kFrames));
+}
+
+TEST(LaterPutWaitsForEarlierStall, MultiProducer) {
+    ISplitter s(1, 1);
+    ClientID slow;
+    ASSERT_TRUE(s.ClientAdd(&slow));
+    EXPECT_EQ(s.Put(OriginFrame(0, 0), 0), ISplitterError::NO_ERROR);
+
+    // A stalls on the full slow client, B comes after it
+    auto a = std::thread([&]() {
+        EXPECT_EQ(s.Put(OriginFrame(1, 0), 2000), ISplitterError::NO_ERROR);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto b = std::thread([&]() {
+        EXPECT_EQ(s.Put(OriginFrame(2, 0), 2000), ISplitterError::NO_ERROR);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    std::vector<std::pair<uint64_t, uint32_t>> slow_got;
+    FrameBuffer fb;
+    uint64_t seq;
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQ(s.Get(slow, fb, 1000, &seq), ISplitterError::NO_ERROR);
+        slow_got.push_back({seq, FrameOrigin(fb).first});
+    }
+    a.join();
+    b.join();
+    EXPECT_EQ(slow_got, (std::vector<std::pair<uint64_t, uint32_t>>{{0, 0}, {1, 1}, {2, 2}}));
+}
+
+TEST(LaterTimeoutDropsInsteadOfReordering, MultiProducer) {
+    ISplitter s(1, 1);
+    ClientID client;
+    ASSERT_TRUE(s.ClientAdd(&client));
+    EXPECT_EQ(s.Put(OriginFrame(0, 0), 0), ISplitterError::NO_ERROR);
+
+    auto a = std::thread([&]() {
+        EXPECT_EQ(s.Put(OriginFrame(1, 0), 300), ISplitterError::NO_ERROR);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    // B times out while A still waits, B's frame is dropped for the client
+    EXPECT_EQ(s.Put(OriginFrame(2, 0), 10), ISplitterError::TIMEOUT);
+
+    FrameBuffer fb;
+    uint64_t seq;
+    ASSERT_EQ(s.Get(client, fb, 0, &seq), ISplitterError::NO_ERROR);
+    EXPECT_EQ(seq, 0u);
+    ASSERT_EQ(s.Get(client, fb, 1000, &seq), ISplitterError::NO_ERROR);
+    EXPECT_EQ(seq, 1u);
+    a.join();
+    EXPECT_EQ(s.TryGet(client, fb), ISplitterError::TIMEOUT);
+    std::vector<ClientStats> stats;
+    s.ClientsStatsGet(&stats);
+    EXPECT_EQ(stats[0].dropped, 1u);
+}
+
+TEST(FlushReachesEveryStalledPut, MultiProducer) {
+    ISplitter s(1, 1);
+    ClientID client;
+    ASSERT_TRUE(s.ClientAdd(&client));
+    s.Put(OriginFrame(0, 0), 0);
+    std::vector<std::thread> producers;
+    for (uint32_t p = 1; p <= 3; ++p) {
+        producers.emplace_back([&, p]() {
+            EXPECT_EQ(s.Put(OriginFrame(p, 0), 5000), ISplitterError::FLUSHED);
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    auto start = std::chrono::steady_clock::now();
+    s.Flush();
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+}
+
+TEST(FlushDoesntAbortLaterPut, MultiProducer) {
+    ISplitter s(1, 1);
+    ClientID client;
+    ASSERT_TRUE(s.ClientAdd(&client));
+    s.Flush();
+    s.Put(OriginFrame(0, 0), 0);
+    EXPECT_EQ(s.Put(OriginFrame(1, 0), 20), ISplitterError::TIMEOUT);
+}
+
+TEST(RingSequence, MultiProducer) {
+    SplitterOptions options;
+    options.engine = SplitterEngine::RING;
+    ISplitter s(8, 1, options);
+    ClientID client;
+    ASSERT_TRUE(s.ClientAdd(&client));
+    std::vector<std::thread> producers;
+    for (uint32_t p = 0; p < 4; ++p) {
+        producers.emplace_back([&, p]() {
+            s.Put(OriginFrame(p, 0), 1000);
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    FrameBuffer fb;
+    uint64_t seq;
+    for (uint64_t i = 0; i < 4; ++i) {
+        ASSERT_EQ(s.Get(client, fb, 0, &seq), ISplitterError::NO_ERROR);
+        EXPECT_EQ(seq, i);
+    }
+}
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include "FramePool.h"
+#include <cstdlib>
+#include <new>
+
+// Replaces the global operator new/delete, so it is an executable of its
+// own: the other suites don't run on this allocator. noinline keeps GCC from
+// pairing an inlined free() with a new expression at -O1 and up.
+
+// allocations made by the current thread, to check the steady state is malloc free
+static thread_local size_t allocations = 0;
+static thread_local size_t allocated_bytes = 0;
+
+[[gnu::noinline]] void* operator new(size_t size) {
+    ++allocations;
+    allocated_bytes += size;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+TEST(SteadyStateNoMalloc, FramePool) {
+    for (auto engine : {SplitterEngine::QUEUE, SplitterEngine::RING}) {
+        SplitterOptions options;
+        options.engine = engine;
+        ISplitter s(4, 2, options);
+        auto pool = FramePoolCreate(4096, 8);
+
+        ClientID client1;
+        ClientID client2;
+        EXPECT_TRUE(s.ClientAdd(&client1));
+        EXPECT_TRUE(s.ClientAdd(&client2));
+
+        FrameBuffer fb;
+        auto before = allocations;
+        for (int i = 0; i < 1000; ++i) {
+            EXPECT_EQ(s.Put(pool->Acquire(), 0), ISplitterError::NO_ERROR);
+            EXPECT_EQ(s.Get(client1, fb, 0), ISplitterError::NO_ERROR);
+            EXPECT_EQ(s.Get(client2, fb, 0), ISplitterError::NO_ERROR);
+        }
+        EXPECT_EQ(allocations, before);
+
+        size_t hits;
+        size_t misses;
+        EXPECT_TRUE(pool->StatsGet(&hits, &misses));
+        EXPECT_EQ(hits, 1000);
+        EXPECT_EQ(misses, 0);
+    }
+}
+
+// client queues and histograms are allocated by ClientAdd, not for every slot
+TEST(IdleSlotsTakeNoQueues, ISplitter) {
+    for (bool background : {false, true}) {
+        SplitterOptions options;
+        options.background_delivery = background;
+        auto before = allocated_bytes;
+        { ISplitter s(2, 1000, options); }
+        auto small = allocated_bytes - before;
+        before = allocated_bytes;
+        { ISplitter s(256, 1000, options); }
+        // not even a buffer per slot, whatever the first splitter set up once
+        EXPECT_LT(allocated_bytes - before, small + 1000 * sizeof(FrameBuffer));
+
+        ISplitter s(256, 1000, options);
+        ClientID client;
+        before = allocated_bytes;
+        EXPECT_TRUE(s.ClientAdd(&client));
+        EXPECT_GE(allocated_bytes - before, 256 * sizeof(FrameBuffer));
+        EXPECT_TRUE(s.ClientRemove(client));
+    }
+}
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include "Splitter.h"
+#include "TestFrames.h"
+#include <future>
+#include <thread>
+
+TEST(KeyFrame, FrameHeader) {
+    auto raw = std::make_shared<std::vector<uint8_t>>(100);
+    FrameHeader header;
+    EXPECT_FALSE(FrameHeaderGet(raw, &header));
+    EXPECT_TRUE(FrameIsKeyFrame(raw));
+
+    EXPECT_TRUE(FrameHeaderSet(raw, 0));
+    EXPECT_TRUE(FrameHeaderGet(raw, &header));
+    EXPECT_FALSE(FrameIsKeyFrame(raw));
+    EXPECT_TRUE(FrameIsKeyFrame(MakeFrame(0, 100)));
+
+    EXPECT_FALSE(FrameHeaderSet(std::make_shared<std::vector<uint8_t>>(4), 0));
+}
+
+TEST(DropNewest, OverflowPolicy) {
+    ISplitter s(2, 2);
+    auto newest = AddClient(s, {.overflow = OverflowPolicy::DROP_NEWEST});
+    auto oldest = AddClient(s, {.overflow = OverflowPolicy::DROP_OLDEST});
+
+    std::vector<FrameBuffer> bufs = {MakeFrame(0, 100), MakeFrame(0, 100), MakeFrame(0, 100)};
+    for (auto& fb : bufs) {
+        s.Put(fb, 0);
+    }
+    EXPECT_EQ(Drain(s, newest), std::vector<FrameBuffer>({bufs[0], bufs[1]}));
+    EXPECT_EQ(Drain(s, oldest), std::vector<FrameBuffer>({bufs[1], bufs[2]}));
+
+    SplitterMetrics metrics;
+    EXPECT_TRUE(s.MetricsGet(&metrics));
+    EXPECT_EQ(metrics.policy_drops[size_t(OverflowPolicy::DROP_NEWEST)], 1u);
+    EXPECT_EQ(metrics.policy_drops[size_t(OverflowPolicy::DROP_OLDEST)], 1u);
+
+    std::vector<ClientStats> stats;
+    EXPECT_TRUE(s.ClientsStatsGet(&stats));
+    EXPECT_EQ(stats[0].overflow, OverflowPolicy::DROP_NEWEST);
+    EXPECT_EQ(stats[1].overflow, OverflowPolicy::DROP_OLDEST);
+}
+
+TEST(SkipToQueuedKeyFrame, OverflowPolicy) {
+    ISplitter s(3, 1);
+    auto client = AddClient(s, {.overflow = OverflowPolicy::KEYFRAME});
+
+    std::vector<FrameBuffer> bufs = {MakeFrame(0, 100), MakeFrame(0, 100, false), MakeFrame(0, 100), MakeFrame(0, 100, false)};
+    for (auto& fb : bufs) {
+        s.Put(fb, 0);
+    }
+    // the dropped keyframe takes its delta frame along
+    EXPECT_EQ(Drain(s, client), std::vector<FrameBuffer>({bufs[2], bufs[3]}));
+
+    std::vector<ClientStats> stats;
+    EXPECT_TRUE(s.ClientsStatsGet(&stats));
+    EXPECT_EQ(stats[0].dropped, 2u);
+}
+
+TEST(WaitForNextKeyFrame, OverflowPolicy) {
+    ISplitter s(3, 1);
+    auto client = AddClient(s, {.overflow = OverflowPolicy::KEYFRAME});
+
+    std::vector<FrameBuffer> bufs = {MakeFrame(0, 100), MakeFrame(0, 100, false), MakeFrame(0, 100, false),
+        MakeFrame(0, 100, false), MakeFrame(0, 100, false), MakeFrame(0, 100), MakeFrame(0, 100, false)};
+    for (auto& fb : bufs) {
+        s.Put(fb, 0);
+    }
+    EXPECT_EQ(Drain(s, client), std::vector<FrameBuffer>({bufs[5], bufs[6]}));
+
+    SplitterMetrics metrics;
+    EXPECT_TRUE(s.MetricsGet(&metrics));
+    EXPECT_EQ(metrics.policy_drops[size_t(OverflowPolicy::KEYFRAME)], 5u);
+}
+
+TEST(Block, OverflowPolicy) {
+    ISplitter s(1, 1);
+    auto client = AddClient(s, {.overflow = OverflowPolicy::BLOCK});
+
+    auto fb1 = MakeFrame(0, 100);
+    auto fb2 = MakeFrame(0, 100);
+    EXPECT_EQ(s.Put(fb1, 0), ISplitterError::NO_ERROR);
+
+    auto put = std::async(std::launch::async, [&]() {
+        return s.Put(fb2, 10);
+    });
+    EXPECT_EQ(put.wait_for(std::chrono::milliseconds(100)), std::future_status::timeout);
+
+    FrameBuffer got;
+    EXPECT_EQ(s.Get(client, got, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(got, fb1);
+    EXPECT_EQ(put.get(), ISplitterError::TIMEOUT);
+    EXPECT_EQ(s.Get(client, got, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(got, fb2);
+
+    std::vector<ClientStats> stats;
+    EXPECT_TRUE(s.ClientsStatsGet(&stats));
+    EXPECT_EQ(stats[0].dropped, 0u);
+
+    // Close releases a Put blocked on the client
+    EXPECT_EQ(s.Put(fb1, 0), ISplitterError::NO_ERROR);
+    put = std::async(std::launch::async, [&]() {
+        return s.Put(fb2, 0);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    s.Close();
+    EXPECT_EQ(put.get(), ISplitterError::CLOSED);
+}
+
+TEST(RingEngine, OverflowPolicy) {
+    SplitterOptions options;
+    options.engine = SplitterEngine::RING;
+    ISplitter s(2, 4, options);
+
+    ClientOptions client_options;
+    ClientID client;
+    client_options.overflow = OverflowPolicy::DROP_NEWEST;
+    EXPECT_FALSE(s.ClientAdd(&client, client_options));
+    client_options.overflow = OverflowPolicy::KEYFRAME;
+    EXPECT_FALSE(s.ClientAdd(&client, client_options));
+    client_options.overflow = OverflowPolicy::BLOCK;
+    EXPECT_TRUE(s.ClientAdd(&client, client_options));
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+
+#include "Splitter.h"
+#include <thread>
+
+static SplitterOptions RingOptions() {
+    SplitterOptions options;
+    options.engine = SplitterEngine::RING;
+    return options;
+}
+
+TEST(FifoTestNoDrop, RingEngine) {
+    int num_bufs = 4;
+    ISplitter s(num_bufs, 2, RingOptions());
+
+    ClientID client1;
+    ClientID client2;
+    EXPECT_TRUE(s.ClientAdd(&client1));
+    EXPECT_TRUE(s.ClientAdd(&client2));
+
+    std::vector<FrameBuffer> fbs;
+    for (int i = 0; i < num_bufs; ++i) {
+        FrameBuffer fb = std::make_shared<std::vector<uint8_t>>(100);
+        auto res = s.Put(fb, 1000);
+        EXPECT_EQ(res, ISplitterError::NO_ERROR);
+        fbs.push_back(fb);
+    }
+
+    for (auto client : {client1, client2}) {
+        for (int i = 0; i < num_bufs; ++i) {
+            FrameBuffer fb;
+            auto res = s.Get(client, fb, 1000);
+            EXPECT_EQ(res, ISplitterError::NO_ERROR);
+            EXPECT_EQ(fb, fbs[i]);
+        }
+    }
+}
+
+TEST(FifoTestDrop, RingEngine) {
+    int num_bufs = 4;
+    ISplitter s(2, 2, RingOptions());
+
+    ClientID client1;
+    EXPECT_TRUE(s.ClientAdd(&client1));
+
+    std::vector<FrameBuffer> fbs;
+    for (int i = 0; i < num_bufs; ++i) {
+        FrameBuffer fb = std::make_shared<std::vector<uint8_t>>(100);
+        auto res = s.Put(fb, 100);
+        EXPECT_EQ(res, i < 2 ? ISplitterError::NO_ERROR : ISplitterError::TIMEOUT);
+        fbs.push_back(fb);
+    }
+
+    for (int i = 2; i < num_bufs; ++i) {
+        FrameBuffer fb;
+        auto res = s.Get(client1, fb, 1000);
+        EXPECT_EQ(res, ISplitterError::NO_ERROR);
+        EXPECT_EQ(fb, fbs[i]);
+    }
+    {
+        ClientID id;
+        size_t latency;
+        size_t drops;
+        auto lock = s.BeginClientsIteration();
+        s.ClientGetByIndex(0, &id, &latency, &drops, lock);
+        EXPECT_EQ(id, client1);
+        EXPECT_EQ(latency, 0);
+        EXPECT_EQ(drops, 2);
+    }
+}
+
+TEST(StalledPutDelivers, RingEngine) {
+    ISplitter s(1, 1, RingOptions());
+
+    ClientID client1;
+    EXPECT_TRUE(s.ClientAdd(&client1));
+
+    FrameBuffer fb0 = std::make_shared<std::vector<uint8_t>>(100);
+    FrameBuffer fb1 = std::make_shared<std::vector<uint8_t>>(100);
+    EXPECT_EQ(s.Put(fb0, 1000), ISplitterError::NO_ERROR);
+
+    std::thread pull_thread([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        FrameBuffer fb;
+        EXPECT_EQ(s.Get(client1, fb, 1000), ISplitterError::NO_ERROR);
+        EXPECT_EQ(fb, fb0);
+        EXPECT_EQ(s.Get(client1, fb, 1000), ISplitterError::NO_ERROR);
+        EXPECT_EQ(fb, fb1);
+    });
+
+    EXPECT_EQ(s.Put(fb1, std::numeric_limits<int32_t>::max()), ISplitterError::NO_ERROR);
+    pull_thread.join();
+}
+
+TEST(Flush, RingEngine) {
+    ISplitter s(2, 1, RingOptions());
+
+    ClientID client1;
+    EXPECT_TRUE(s.ClientAdd(&client1));
+
+    FrameBuffer fb0 = std::make_shared<std::vector<uint8_t>>(100);
+    EXPECT_EQ(s.Put(fb0, 1000), ISplitterError::NO_ERROR);
+    EXPECT_EQ(s.Flush(), ISplitterError::NO_ERROR);
+    EXPECT_EQ(fb0.use_count(), 1);
+
+    FrameBuffer fb;
+    EXPECT_EQ(s.Get(client1, fb, 100), ISplitterError::TIMEOUT);
+}
+
+TEST(UnsupportedOptions, RingEngine) {
+    auto background = RingOptions();
+    background.background_delivery = true;
+    auto history = RingOptions();
+    history.history = 5;
+    auto bytes = RingOptions();
+    bytes.max_bytes = 1000;
+    auto client_bytes = RingOptions();
+    client_bytes.max_client_bytes = 1000;
+    for (auto& options : {background, history, bytes, client_bytes}) {
+        ISplitter s(4, 2, options);
+        size_t max_buffers, max_clients;
+        EXPECT_FALSE(s.InfoGet(&max_buffers, &max_clients));
+        ClientID client;
+        EXPECT_FALSE(s.ClientAdd(&client));
+        EXPECT_EQ(SplitterCreate(4, 2, options), nullptr);
+    }
+
+    history.history = 4;
+    EXPECT_NE(SplitterCreate(4, 2, history), nullptr);
+}
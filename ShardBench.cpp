@@ -0,0 +1,41 @@
+#include <benchmark/benchmark.h>
+
+#include "FramePool.h"
+#include "ShardedSplitter.h"
+#include <thread>
+
+// Put latency of ShardedSplitter against the number of shards, with nobody
+// reading like BM_Put: every Put drops the oldest frame of every client. The
+// workers are pinned one per CPU, so shards past the CPU count share them.
+
+namespace {
+
+void BM_ShardedPut(benchmark::State& state) {
+    auto clients = static_cast<size_t>(state.range(0));
+    ShardOptions options;
+    options.shards = static_cast<size_t>(state.range(1));
+    for (unsigned cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); ++cpu) {
+        options.cpus.push_back(static_cast<int>(cpu));
+    }
+    ShardedSplitter s(4, clients, options);
+    auto pool = FramePoolCreate(64, 8);
+    for (size_t i = 0; i < clients; ++i) {
+        ClientID id;
+        s.ClientAdd(&id);
+    }
+
+    for (auto _ : state) {
+        s.Put(pool->Acquire(), 0);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["deliveries_per_second"] = benchmark::Counter(
+        static_cast<double>(state.iterations() * clients), benchmark::Counter::kIsRate);
+    state.counters["cpus"] = static_cast<double>(options.cpus.size());
+}
+
+}
+
+BENCHMARK(BM_ShardedPut)
+    ->ArgNames({"clients", "shards"})
+    ->ArgsProduct({{1000, 5000, 20000}, {1, 2, 4, 8, 16, 32}})
+    ->UseRealTime();
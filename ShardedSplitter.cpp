@@ -0,0 +1,338 @@
+#include "ShardedSplitter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <pthread.h>
+
+namespace {
+
+// the worst result of the shards: a closed or flushed splitter, then a
+// timeout
+ISplitterError Merge(ISplitterError res, ISplitterError shard_res) {
+    auto rank = [](ISplitterError e) {
+        switch (e) {
+        case ISplitterError::NO_ERROR:
+            return 0;
+        case ISplitterError::TIMEOUT:
+            return 1;
+        default:
+            return 2;
+        }
+    };
+    return rank(shard_res) > rank(res) ? shard_res : res;
+}
+
+// timeout of a shard Put that ends by exit_time, 0 once it's passed
+int32_t RemainingMsec(SplitterClock& clock, SplitterClock::time_point exit_time) {
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(exit_time - clock.Now()).count();
+    return static_cast<int32_t>(std::clamp<int64_t>(left, 0, INT32_MAX));
+}
+
+}
+
+// A frame of ShardedSplitter::Put handed to the workers, on the stack of the
+// Put that waits for them
+struct ShardPut {
+    const FrameBuffer& fb;
+    const SplitterClock::time_point exit_time;
+    std::atomic<ISplitterError> res;
+
+    void Merge(ISplitterError shard_res) {
+        auto old = res.load();
+        while (!res.compare_exchange_weak(old, ::Merge(old, shard_res))) {
+        }
+    }
+};
+
+// Puts the frames handed over by ShardedSplitter::Put into one shard, in the
+// order they were posted. A Put still behind earlier ones when it times out
+// abandons its job, the worker skips it.
+class ShardWorker {
+public:
+    ShardWorker(ISplitter& shard, std::shared_ptr<SplitterClock> clock, int cpu):
+      shard_(shard),
+      clock_(std::move(clock)),
+      next_(0),
+      posted_(0),
+      done_(0),
+      stop_(false),
+      thread_([this]() {
+          Run();
+      }) {
+        if (cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(thread_.native_handle(), sizeof(set), &set);
+        }
+    }
+
+    ~ShardWorker() {
+        {
+            std::lock_guard lck(mtx_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    // ticket of the frame for Wait
+    uint64_t Post(ShardPut* put) {
+        uint64_t ticket;
+        {
+            std::lock_guard lck(mtx_);
+            jobs_.push_back(put);
+            ticket = posted_++;
+        }
+        cv_.notify_all();
+        return ticket;
+    }
+
+    // false when earlier jobs still weren't done by the exit_time of put, the
+    // job is abandoned then; once it's next its shard Put gets the time left
+    bool Wait(uint64_t ticket, const ShardPut& put) {
+        std::unique_lock lck(mtx_);
+        while (done_ <= ticket) {
+            if (done_ == ticket) {
+                clock_->Wait(done_cv_, lck);
+            } else if (!clock_->WaitUntil(done_cv_, lck, put.exit_time) && (done_ < ticket)) {
+                // not taken, only the job of done_ may be under way
+                jobs_[jobs_.size() - (posted_ - ticket)] = nullptr;
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    void Run() {
+        std::unique_lock lck(mtx_);
+        while (true) {
+            cv_.wait(lck, [this]() {
+                return stop_ || (next_ != jobs_.size());
+            });
+            if (stop_) {
+                return;
+            }
+            auto put = jobs_[next_++];
+            // keeps the capacity, Put doesn't allocate once it's grown
+            if (next_ == jobs_.size()) {
+                jobs_.clear();
+                next_ = 0;
+            }
+            if (put) {
+                lck.unlock();
+                put->Merge(shard_.Put(put->fb, RemainingMsec(*clock_, put->exit_time)));
+                lck.lock();
+            }
+            ++done_;
+            clock_->NotifyAll(done_cv_);
+        }
+    }
+
+    ISplitter& shard_;
+    const std::shared_ptr<SplitterClock> clock_;
+    std::mutex mtx_;
+    // Post wakes the worker on cv_, Puts wait for it on done_cv_
+    std::condition_variable cv_;
+    std::condition_variable done_cv_;
+    std::vector<ShardPut*> jobs_;  // nullptr once abandoned
+    size_t next_;  // first job not taken yet
+    uint64_t posted_;
+    uint64_t done_;
+    bool stop_;
+    std::thread thread_;
+};
+
+ShardedSplitter::ShardedSplitter(size_t max_buffers, size_t max_clients, const ShardOptions& options):
+  max_buffers_(max_buffers),
+  max_clients_(max_clients),
+  clock_(options.splitter.clock ? options.splitter.clock : SteadyClockGet()),
+  next_ticket_(0) {
+    auto shard_count = std::max<size_t>(options.shards, 1);
+    auto shard_clients = (max_clients + shard_count - 1) / shard_count;
+    // shard and slot share the slot bits of a ClientID
+    assert(shard_clients * shard_count <= UINT32_MAX);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.push_back(std::make_shared<ISplitter>(max_buffers, shard_clients, options.splitter));
+    }
+    turns_.resize(shard_count);
+    skipped_.resize(shard_count);
+    if (options.workers) {
+        for (size_t i = 1; i < shard_count; ++i) {
+            auto cpu = options.cpus.empty() ? -1 : options.cpus[(i - 1) % options.cpus.size()];
+            workers_.push_back(std::make_unique<ShardWorker>(*shards_[i], clock_, cpu));
+        }
+    }
+}
+
+ShardedSplitter::~ShardedSplitter() {
+}
+
+bool ShardedSplitter::InfoGet(size_t* _pzMaxBuffers, size_t* _pzMaxClients) const {
+    *_pzMaxBuffers = max_buffers_;
+    *_pzMaxClients = max_clients_;
+    // the shards share the options
+    size_t max_buffers, max_clients;
+    return shards_.front()->InfoGet(&max_buffers, &max_clients);
+}
+
+size_t ShardedSplitter::ShardCount() const {
+    return shards_.size();
+}
+
+ClientID ShardedSplitter::GlobalId(size_t shard, ClientID local) const {
+    auto slot = local & UINT32_MAX;
+    return (local & ~ClientID(UINT32_MAX)) | (slot * shards_.size() + shard);
+}
+
+ISplitter* ShardedSplitter::FindShard(ClientID _nClientID, ClientID* _punLocalID) const {
+    auto slot = _nClientID & UINT32_MAX;
+    auto shard = slot % shards_.size();
+    *_punLocalID = (_nClientID & ~ClientID(UINT32_MAX)) | (slot / shards_.size());
+    return shards_[shard].get();
+}
+
+ISplitterError ShardedSplitter::PutShard(size_t shard, uint64_t ticket, const FrameBuffer& _pVecPut,
+        SplitterClock::time_point exit_time) {
+    std::unique_lock lck(order_mtx_);
+    while (turns_[shard] != ticket) {
+        if (!clock_->WaitUntil(turn_cv_, lck, exit_time) && (turns_[shard] != ticket)) {
+            // the Put before it passes the turn on past the ticket
+            skipped_[shard].push_back(ticket);
+            return ISplitterError::TIMEOUT;
+        }
+    }
+    lck.unlock();
+    auto res = shards_[shard]->Put(_pVecPut, RemainingMsec(*clock_, exit_time));
+    lck.lock();
+    ++turns_[shard];
+    while (std::erase(skipped_[shard], turns_[shard]) != 0) {
+        ++turns_[shard];
+    }
+    clock_->NotifyAll(turn_cv_);
+    return res;
+}
+
+ISplitterError ShardedSplitter::Put(const FrameBuffer& _pVecPut, int32_t _nTimeOutMsec) {
+    // the ticket orders the frame the same in every shard, a shard takes the
+    // next Put while the others still work on this one. Every Put posts to
+    // every worker, so the ticket is the one of the workers too. One
+    // deadline holds for all the shards.
+    auto exit_time = clock_->Now() + std::chrono::milliseconds(_nTimeOutMsec);
+    ShardPut put = {_pVecPut, exit_time, ISplitterError::NO_ERROR};
+    uint64_t ticket;
+    {
+        std::lock_guard lck(order_mtx_);
+        ticket = next_ticket_++;
+        for (auto& worker : workers_) {
+            worker->Post(&put);
+        }
+    }
+    put.Merge(PutShard(0, ticket, _pVecPut, exit_time));
+    if (workers_.empty()) {
+        for (size_t i = 1; i < shards_.size(); ++i) {
+            put.Merge(PutShard(i, ticket, _pVecPut, exit_time));
+        }
+    }
+    for (auto& worker : workers_) {
+        if (!worker->Wait(ticket, put)) {
+            put.Merge(ISplitterError::TIMEOUT);
+        }
+    }
+    return put.res;
+}
+
+ISplitterError ShardedSplitter::Get(ClientID _nClientID, FrameBuffer& _pVecGet, int32_t _nTimeOutMsec) {
+    ClientID local;
+    return FindShard(_nClientID, &local)->Get(local, _pVecGet, _nTimeOutMsec);
+}
+
+ISplitterError ShardedSplitter::TryGet(ClientID _nClientID, FrameBuffer& _pVecGet) {
+    ClientID local;
+    return FindShard(_nClientID, &local)->TryGet(local, _pVecGet);
+}
+
+ISplitterError ShardedSplitter::GetBatch(ClientID _nClientID, std::vector<FrameBuffer>& _pVecsGet,
+        size_t _zMaxCount, int32_t _nTimeOutMsec) {
+    ClientID local;
+    return FindShard(_nClientID, &local)->GetBatch(local, _pVecsGet, _zMaxCount, _nTimeOutMsec);
+}
+
+bool ShardedSplitter::ClientAdd(ClientID* _unClientID) {
+    return ClientAdd(_unClientID, ClientOptions());
+}
+
+bool ShardedSplitter::ClientAdd(ClientID* _unClientID, const ClientOptions& _rOptions) {
+    std::lock_guard lck(registry_mtx_);
+    size_t best = 0;
+    size_t best_count = SIZE_MAX;
+    size_t total = 0;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        size_t count;
+        shards_[i]->ClientGetCount(&count);
+        total += count;
+        if (count < best_count) {
+            best = i;
+            best_count = count;
+        }
+    }
+    // shard limits are rounded up, max_clients is over all of them; only
+    // ClientAdd raises the total and it runs under registry_mtx_
+    if (total >= max_clients_) {
+        return false;
+    }
+    ClientID local;
+    if (!shards_[best]->ClientAdd(&local, _rOptions)) {
+        return false;
+    }
+    *_unClientID = GlobalId(best, local);
+    return true;
+}
+
+int ShardedSplitter::ClientEventFdGet(ClientID _nClientID) const {
+    ClientID local;
+    return FindShard(_nClientID, &local)->ClientEventFdGet(local);
+}
+
+bool ShardedSplitter::ClientRemove(ClientID _unClientID) {
+    ClientID local;
+    return FindShard(_unClientID, &local)->ClientRemove(local);
+}
+
+bool ShardedSplitter::ClientGetCount(size_t* _pnCount) const {
+    *_pnCount = 0;
+    for (auto& shard : shards_) {
+        size_t count;
+        shard->ClientGetCount(&count);
+        *_pnCount += count;
+    }
+    return true;
+}
+
+bool ShardedSplitter::ClientsStatsGet(std::vector<ClientStats>* _pvStats) const {
+    _pvStats->clear();
+    std::vector<ClientStats> shard_stats;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        shards_[i]->ClientsStatsGet(&shard_stats);
+        for (auto& stats : shard_stats) {
+            stats.id = GlobalId(i, stats.id);
+            _pvStats->push_back(stats);
+        }
+    }
+    return true;
+}
+
+ISplitterError ShardedSplitter::Flush() {
+    auto res = ISplitterError::NO_ERROR;
+    for (auto& shard : shards_) {
+        res = Merge(res, shard->Flush());
+    }
+    return res;
+}
+
+void ShardedSplitter::Close() {
+    for (auto& shard : shards_) {
+        shard->Close();
+    }
+}
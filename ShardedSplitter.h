@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Splitter.h"
+
+// Splitter for very many clients. The clients are spread over shards, each
+// an ISplitter with its own locks, and Put feeds all shards at once: the
+// caller delivers to the first shard while a worker thread per other shard
+// delivers to its own. A Put costs the slowest shard rather than all the
+// clients one after another.
+//
+// Client IDs tell the shard, Get and the rest of the client calls go straight
+// to it. Semantics are those of ISplitter per shard, a Put returns the worst
+// result of its shards. Puts may come from several threads: every shard
+// takes the frames in the same order, one Put at a time, while the other
+// shards may already work on the next one.
+//
+// The timeout of Put holds over all the shards, each gets the time left. A
+// shard still busy with earlier Puts when it runs out doesn't get the frame,
+// and Put returns TIMEOUT.
+
+struct ShardOptions {
+    size_t shards = 1;
+    // a worker thread per shard but the first, which the caller of Put serves.
+    // Without, Put serves the shards one after the other.
+    bool workers = true;
+    // CPUs the workers are pinned to round robin, none when empty. CPUs of
+    // one NUMA node keep the shards in the memory of that node.
+    std::vector<int> cpus;
+    SplitterOptions splitter;
+};
+
+class ShardedSplitter {
+public:
+    // max_clients over all shards
+    ShardedSplitter(size_t max_buffers, size_t max_clients, const ShardOptions& options = ShardOptions());
+    ~ShardedSplitter();
+
+    ShardedSplitter(const ShardedSplitter&) = delete;
+    ShardedSplitter& operator=(const ShardedSplitter&) = delete;
+
+    bool InfoGet(size_t* _pzMaxBuffers, size_t* _pzMaxClients) const;
+    size_t ShardCount() const;
+
+    ISplitterError Put(const FrameBuffer& _pVecPut, int32_t _nTimeOutMsec);
+    ISplitterError Get(ClientID _nClientID, FrameBuffer& _pVecGet, int32_t _nTimeOutMsec);
+    ISplitterError TryGet(ClientID _nClientID, FrameBuffer& _pVecGet);
+    ISplitterError GetBatch(ClientID _nClientID, std::vector<FrameBuffer>& _pVecsGet, size_t _zMaxCount,
+        int32_t _nTimeOutMsec);
+
+    // the client goes to the shard with the fewest clients
+    bool ClientAdd(ClientID* _unClientID);
+    bool ClientAdd(ClientID* _unClientID, const ClientOptions& _rOptions);
+    int ClientEventFdGet(ClientID _nClientID) const;
+    bool ClientRemove(ClientID _unClientID);
+    bool ClientGetCount(size_t* _pnCount) const;
+    bool ClientsStatsGet(std::vector<ClientStats>* _pvStats) const;
+
+    ISplitterError Flush();
+    void Close();
+
+private:
+    // shard of a client and its ID there, nullptr for an unknown client
+    ISplitter* FindShard(ClientID _nClientID, ClientID* _punLocalID) const;
+    ClientID GlobalId(size_t shard, ClientID local) const;
+    // Put of ticket into a shard the caller serves, after the Puts of the
+    // tickets before it; TIMEOUT without the Put when its turn doesn't come
+    // by exit_time
+    ISplitterError PutShard(size_t shard, uint64_t ticket, const FrameBuffer& _pVecPut,
+        SplitterClock::time_point exit_time);
+
+    const size_t max_buffers_;
+    const size_t max_clients_;
+    std::shared_ptr<SplitterClock> clock_;  // of the shards
+    std::vector<std::shared_ptr<ISplitter>> shards_;
+    // workers_[i] serves shards_[i + 1]
+    std::vector<std::unique_ptr<class ShardWorker>> workers_;
+    // hands out the tickets of Put and posts them to the workers in that
+    // order; turns_[i] is the ticket shard i takes next, when the caller
+    // serves it, skipped_[i] the later tickets that gave up their turn
+    std::mutex order_mtx_;
+    std::condition_variable turn_cv_;
+    uint64_t next_ticket_;
+    std::vector<uint64_t> turns_;
+    std::vector<std::vector<uint64_t>> skipped_;
+    // picking a shard and adding the client to it
+    std::mutex registry_mtx_;
+};
+
+inline std::shared_ptr<ShardedSplitter> ShardedSplitterCreate(size_t _zMaxBuffers, size_t _zMaxClients,
+        const ShardOptions& _rOptions = ShardOptions()) {
+    auto splitter = std::make_shared<ShardedSplitter>(_zMaxBuffers, _zMaxClients, _rOptions);
+    size_t max_buffers, max_clients;
+    return splitter->InfoGet(&max_buffers, &max_clients) ? splitter : nullptr;
+}
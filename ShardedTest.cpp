@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+
+#include "ShardedSplitter.h"
+#include "TestFrames.h"
+#include <set>
+#include <thread>
+
+TEST(ClientsSpreadOverShards, Sharded) {
+    ShardOptions options;
+    options.shards = 4;
+    ShardedSplitter s(4, 10, options);
+    EXPECT_EQ(s.ShardCount(), 4u);
+    std::set<ClientID> ids;
+    for (int i = 0; i < 12; ++i) {
+        ClientID id;
+        if (s.ClientAdd(&id)) {
+            ids.insert(id);
+        }
+    }
+    // the least loaded shard takes the next client, the shard of the client
+    // is in its slot bits
+    EXPECT_EQ(ids.size(), 10u);
+    std::array<size_t, 4> per_shard = {};
+    for (auto id : ids) {
+        ++per_shard[(id & UINT32_MAX) % 4];
+    }
+    EXPECT_EQ(per_shard, (std::array<size_t, 4>{3, 3, 2, 2}));
+    size_t count;
+    s.ClientGetCount(&count);
+    EXPECT_EQ(count, 10u);
+}
+
+TEST(MaxClientsOverShards, Sharded) {
+    ShardOptions options;
+    options.shards = 4;
+    ShardedSplitter s(4, 5, options);
+    std::vector<ClientID> ids(5);
+    for (auto& id : ids) {
+        EXPECT_TRUE(s.ClientAdd(&id));
+    }
+    // shards have room for 8, the splitter for 5
+    ClientID id;
+    EXPECT_FALSE(s.ClientAdd(&id));
+    size_t count;
+    s.ClientGetCount(&count);
+    EXPECT_EQ(count, 5u);
+
+    EXPECT_TRUE(s.ClientRemove(ids[0]));
+    EXPECT_TRUE(s.ClientAdd(&id));
+    EXPECT_FALSE(s.ClientAdd(&id));
+}
+
+TEST(PutReachesEveryClient, Sharded) {
+    for (bool workers : {true, false}) {
+        ShardOptions options;
+        options.shards = 3;
+        options.workers = workers;
+        options.cpus = {0};
+        ShardedSplitter s(16, 9, options);
+        std::vector<ClientID> ids(9);
+        for (auto& id : ids) {
+            ASSERT_TRUE(s.ClientAdd(&id));
+        }
+        for (int i = 0; i < 10; ++i) {
+            EXPECT_EQ(s.Put(MakeFrame(i), 0), ISplitterError::NO_ERROR);
+        }
+        for (auto id : ids) {
+            std::vector<FrameBuffer> frames;
+            EXPECT_EQ(s.GetBatch(id, frames, 16, 0), ISplitterError::NO_ERROR);
+            ASSERT_EQ(frames.size(), 10u);
+            for (int i = 0; i < 10; ++i) {
+                EXPECT_EQ(frames[i]->front(), i);
+            }
+        }
+
+        std::vector<ClientStats> stats;
+        EXPECT_TRUE(s.ClientsStatsGet(&stats));
+        ASSERT_EQ(stats.size(), 9u);
+        for (auto& client_stats : stats) {
+            EXPECT_NE(std::find(ids.begin(), ids.end(), client_stats.id), ids.end());
+            EXPECT_EQ(client_stats.delivered, 10u);
+        }
+    }
+}
+
+// concurrent Puts reach all shards, every shard in the same order
+TEST(ConcurrentPutsSameOrder, Sharded) {
+    for (bool workers : {true, false}) {
+        ShardOptions options;
+        options.shards = 3;
+        options.workers = workers;
+        ShardedSplitter s(2000, 3, options);
+        std::vector<ClientID> ids(3);
+        for (auto& id : ids) {
+            ASSERT_TRUE(s.ClientAdd(&id));
+        }
+        std::vector<std::thread> producers;
+        for (int p = 0; p < 4; ++p) {
+            producers.emplace_back([&s, p]() {
+                for (int i = 0; i < 400; ++i) {
+                    EXPECT_EQ(s.Put(MakeFrame(p), 10000), ISplitterError::NO_ERROR);
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+
+        std::vector<FrameBuffer> first;
+        EXPECT_EQ(s.GetBatch(ids[0], first, 2000, 0), ISplitterError::NO_ERROR);
+        EXPECT_EQ(first.size(), 1600u);
+        for (size_t i = 1; i < ids.size(); ++i) {
+            std::vector<FrameBuffer> frames;
+            EXPECT_EQ(s.GetBatch(ids[i], frames, 2000, 0), ISplitterError::NO_ERROR);
+            EXPECT_EQ(frames, first);
+        }
+    }
+}
+
+TEST(TimeoutOfOneShard, Sharded) {
+    ShardOptions options;
+    options.shards = 2;
+    ShardedSplitter s(1, 2, options);
+    ClientID a;
+    ClientID b;
+    ASSERT_TRUE(s.ClientAdd(&a));
+    ASSERT_TRUE(s.ClientAdd(&b));
+    EXPECT_EQ(s.Put(MakeFrame(0), 0), ISplitterError::NO_ERROR);
+    FrameBuffer fb;
+    EXPECT_EQ(s.TryGet(a, fb), ISplitterError::NO_ERROR);
+    // b is full
+    EXPECT_EQ(s.Put(MakeFrame(1), 0), ISplitterError::TIMEOUT);
+    EXPECT_EQ(s.TryGet(a, fb), ISplitterError::NO_ERROR);
+    EXPECT_EQ(fb->front(), 1);
+    EXPECT_EQ(s.TryGet(b, fb), ISplitterError::NO_ERROR);
+    EXPECT_EQ(fb->front(), 1);
+}
+
+// a Put behind a stuck one times out by its deadline, the shards of both
+// kinds skip it
+TEST(TimeoutWaitingForTurn, Sharded) {
+    for (bool workers : {true, false}) {
+        ShardOptions options;
+        options.shards = 2;
+        options.workers = workers;
+        ShardedSplitter s(1, 2, options);
+        ClientID a;
+        ClientID b;
+        ASSERT_TRUE(s.ClientAdd(&a));
+        ASSERT_TRUE(s.ClientAdd(&b));
+        EXPECT_EQ(s.Put(MakeFrame(0), 0), ISplitterError::NO_ERROR);
+        // both full, the Put of 1 holds both shards
+        auto producer = std::thread([&s]() {
+            EXPECT_EQ(s.Put(MakeFrame(1), 5000), ISplitterError::NO_ERROR);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        auto start = std::chrono::steady_clock::now();
+        EXPECT_EQ(s.Put(MakeFrame(2), 50), ISplitterError::TIMEOUT);
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+
+        FrameBuffer fb;
+        EXPECT_EQ(s.TryGet(a, fb), ISplitterError::NO_ERROR);
+        EXPECT_EQ(fb->front(), 0);
+        EXPECT_EQ(s.TryGet(b, fb), ISplitterError::NO_ERROR);
+        EXPECT_EQ(fb->front(), 0);
+        producer.join();
+        // 2 gave up its turns, neither shard got it
+        for (auto id : {a, b}) {
+            EXPECT_EQ(s.TryGet(id, fb), ISplitterError::NO_ERROR);
+            EXPECT_EQ(fb->front(), 1);
+        }
+        EXPECT_EQ(s.Put(MakeFrame(3), 0), ISplitterError::NO_ERROR);
+        for (auto id : {a, b}) {
+            EXPECT_EQ(s.TryGet(id, fb), ISplitterError::NO_ERROR);
+            EXPECT_EQ(fb->front(), 3);
+        }
+    }
+}
+
+TEST(RemoveAndClose, Sharded) {
+    ShardOptions options;
+    options.shards = 2;
+    ShardedSplitter s(4, 4, options);
+    ClientID a;
+    ClientID b;
+    ASSERT_TRUE(s.ClientAdd(&a));
+    ASSERT_TRUE(s.ClientAdd(&b));
+    EXPECT_TRUE(s.ClientRemove(a));
+    EXPECT_FALSE(s.ClientRemove(a));
+    FrameBuffer fb;
+    EXPECT_EQ(s.TryGet(a, fb), ISplitterError::UNKNOWN_CLIENT);
+
+    auto consumer = std::thread([&]() {
+        EXPECT_EQ(s.Get(b, fb, 5000), ISplitterError::EOS);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    s.Close();
+    consumer.join();
+}
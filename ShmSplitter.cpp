@@ -0,0 +1,511 @@
+#include "ShmSplitter.h"
+
+#include <cassert>
+#include <climits>
+#include <cstdio>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+    "atomics shared between processes must be lock free");
+
+namespace {
+
+constexpr uint32_t kShmMagic = 0x53484d53;  // "SHMS"
+constexpr uint32_t kShmVersion = 1;
+// seq of a frame slot while Put overwrites it
+constexpr uint64_t kWriting = ~uint64_t(0);
+// a stalled Put looks for dead readers at least this often
+constexpr int32_t kLivenessPollMsec = 20;
+
+size_t RoundUp(size_t n) {
+    return (n + 63) & ~size_t(63);
+}
+
+// not FUTEX_PRIVATE_FLAG, the words are shared between processes
+void FutexWait(std::atomic<uint32_t>& word, uint32_t value, int32_t timeout_msec) {
+    timespec timeout = {timeout_msec / 1000, (timeout_msec % 1000) * 1000000L};
+    syscall(SYS_futex, &word, FUTEX_WAIT, value, &timeout, nullptr, 0);
+}
+
+void FutexWake(std::atomic<uint32_t>& word, int count) {
+    word.fetch_add(1);
+    syscall(SYS_futex, &word, FUTEX_WAKE, count, nullptr, nullptr, 0);
+}
+
+// the byte of a client slot in the mapping fd, locked by its reader
+struct flock SlotLock(size_t slot, short type) {
+    struct flock lock = {};
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = static_cast<off_t>(slot);
+    lock.l_len = 1;
+    return lock;
+}
+
+}
+
+// Layout of the mapping: the header, max_clients client slots and
+// max_buffers + 1 frame slots. Like FrameRing the ring has one slot more than
+// a client window, so a frame is published while stalled clients still hold
+// a full window.
+
+// Read cursor of a client. The generation is odd while a reader owns the
+// slot, like the slots of ISplitter.
+struct alignas(64) ShmClientSlot {
+    std::atomic<uint32_t> generation;
+    std::atomic<uint32_t> parked;      // the reader waits on wake_futex
+    std::atomic<uint32_t> wake_futex;
+    std::atomic<uint64_t> read_seq;    // first frame of the window, moved by the reader and a timed out Put
+    std::atomic<uint64_t> dropped;     // written by Put
+    std::atomic<uint64_t> delivered;   // written by the reader
+};
+
+struct alignas(64) ShmFrameSlot {
+    // seqlock: the sequence number of the frame stored, kWriting meanwhile.
+    // The payload is read in place, the fields around it are atomics.
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> size;
+    std::atomic<int64_t> stamp;
+
+    uint8_t* Data() {
+        return reinterpret_cast<uint8_t*>(this + 1);
+    }
+};
+
+struct alignas(64) ShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t max_buffers;
+    uint64_t max_clients;
+    uint64_t max_frame_size;
+    std::atomic<uint64_t> head;        // frames put
+    std::atomic<uint32_t> closed;
+    std::atomic<uint32_t> producer_parked;  // Put waits on space_futex
+    std::atomic<uint32_t> space_futex;
+
+    static size_t MapSize(size_t max_buffers, size_t max_clients, size_t max_frame_size) {
+        return sizeof(ShmHeader) + max_clients * sizeof(ShmClientSlot) +
+            (max_buffers + 1) * RoundUp(sizeof(ShmFrameSlot) + max_frame_size);
+    }
+
+    ShmClientSlot& Client(size_t slot) {
+        return reinterpret_cast<ShmClientSlot*>(this + 1)[slot];
+    }
+
+    ShmFrameSlot* FrameAt(uint64_t seq) {
+        auto frames = reinterpret_cast<uint8_t*>(&Client(max_clients));
+        auto stride = RoundUp(sizeof(ShmFrameSlot) + max_frame_size);
+        return reinterpret_cast<ShmFrameSlot*>(frames + (seq % (max_buffers + 1)) * stride);
+    }
+
+    // read_seq is loaded first: the head only grows and is never behind it
+    uint64_t Lag(ShmClientSlot& client) {
+        auto read_seq = client.read_seq.load();
+        return head.load() - read_seq;
+    }
+
+    void StatsGet(size_t slot, uint32_t generation, ClientStats* stats) {
+        auto& client = Client(slot);
+        auto read_seq = client.read_seq.load();
+        auto head_seq = head.load();
+        auto latency = std::min<uint64_t>(head_seq - read_seq, max_buffers);
+        stats->id = (ClientID(generation) << 32) | slot;
+        stats->latency = latency;
+        stats->dropped = client.dropped.load(std::memory_order_relaxed);
+        stats->skipped = 0;
+        stats->delivered = client.delivered.load(std::memory_order_relaxed);
+        stats->overflow = OverflowPolicy::DROP_OLDEST;
+        stats->bytes = 0;
+        for (auto seq = head_seq - latency; seq < head_seq; ++seq) {
+            stats->bytes += FrameAt(seq)->size.load(std::memory_order_relaxed);
+        }
+    }
+
+    // a reader freed room, Put is woken only while it waits for it
+    void WakeProducer() {
+        if (producer_parked.load()) {
+            FutexWake(space_futex, 1);
+        }
+    }
+};
+
+ShmSplitter::ShmSplitter(size_t max_buffers, size_t max_clients, size_t max_frame_size):
+  max_buffers_(max_buffers),
+  max_clients_(max_clients),
+  max_frame_size_(max_frame_size),
+  fd_(-1),
+  map_size_(ShmHeader::MapSize(max_buffers, max_clients, max_frame_size)),
+  header_(nullptr) {
+    if (!max_buffers || !max_clients) {
+        return;
+    }
+    int fd = memfd_create("splitter", MFD_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(map_size_)) == 0) {
+        map = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+
+    header_ = new (map) ShmHeader();
+    header_->max_buffers = max_buffers;
+    header_->max_clients = max_clients;
+    header_->max_frame_size = max_frame_size;
+    for (size_t slot = 0; slot < max_clients; ++slot) {
+        new (&header_->Client(slot)) ShmClientSlot();
+    }
+    for (size_t seq = 0; seq <= max_buffers; ++seq) {
+        new (header_->FrameAt(seq)) ShmFrameSlot();
+        header_->FrameAt(seq)->seq.store(kWriting, std::memory_order_relaxed);
+    }
+    header_->magic = kShmMagic;
+    header_->version = kShmVersion;
+    fd_ = fd;
+}
+
+ShmSplitter::~ShmSplitter() {
+    if (!header_) {
+        return;
+    }
+    Close();
+    // readers keep their own mappings of the memfd
+    munmap(header_, map_size_);
+    close(fd_);
+}
+
+int ShmSplitter::FdGet() const {
+    return fd_;
+}
+
+bool ShmSplitter::InfoGet(size_t* _pzMaxBuffers, size_t* _pzMaxClients, size_t* _pzMaxFrameSize) const {
+    *_pzMaxBuffers = max_buffers_;
+    *_pzMaxClients = max_clients_;
+    *_pzMaxFrameSize = max_frame_size_;
+    return true;
+}
+
+ISplitterError ShmSplitter::Put(const FrameBuffer& _pVecPut, int32_t _nTimeOutMsec) {
+    auto size = _pVecPut ? _pVecPut->size() : 0;
+    if (size > max_frame_size_) {
+        return ISplitterError::FRAME_TOO_LARGE;
+    }
+    std::lock_guard lck(push_mtx_);
+    if (!header_ || header_->closed.load()) {
+        return ISplitterError::CLOSED;
+    }
+    auto exit_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(_nTimeOutMsec);
+
+    // the slot overwritten is out of every window: clients were trimmed to
+    // max_buffers frames by the previous Put
+    auto seq = header_->head.load(std::memory_order_relaxed);
+    auto frame = header_->FrameAt(seq);
+    // acquire keeps the writes below after it
+    frame->seq.exchange(kWriting, std::memory_order_acq_rel);
+    frame->size.store(size, std::memory_order_relaxed);
+    frame->stamp.store(Metrics::Now(), std::memory_order_relaxed);
+    if (size) {
+        memcpy(frame->Data(), _pVecPut->data(), size);
+    }
+    frame->seq.store(seq, std::memory_order_release);
+    header_->head.store(seq + 1);
+
+    // only parked readers are woken
+    bool stalled = false;
+    for (size_t slot = 0; slot < max_clients_; ++slot) {
+        auto& client = header_->Client(slot);
+        if (!(client.generation.load() & 1)) {
+            continue;
+        }
+        if (client.parked.load()) {
+            FutexWake(client.wake_futex, 1);
+        }
+        stalled |= header_->Lag(client) > max_buffers_;
+    }
+
+    auto res = ISplitterError::NO_ERROR;
+    while (stalled) {
+        // a reader frees room after the scan sees it, or it sees the flag
+        // and changes the futex word
+        header_->producer_parked.store(1);
+        auto value = header_->space_futex.load();
+        if (header_->closed.load()) {
+            res = ISplitterError::CLOSED;
+            break;
+        }
+        stalled = false;
+        for (size_t slot = 0; slot < max_clients_; ++slot) {
+            auto& client = header_->Client(slot);
+            auto generation = client.generation.load();
+            if (!(generation & 1) || (header_->Lag(client) <= max_buffers_)) {
+                continue;
+            }
+            if (!ClientAlive(slot) && Reap(slot, generation)) {
+                continue;
+            }
+            stalled = true;
+            if (res == ISplitterError::TIMEOUT) {
+                Trim(slot);
+            }
+        }
+        if (!stalled || (res == ISplitterError::TIMEOUT)) {
+            break;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= exit_time) {
+            // the next pass drops the oldest frames of the clients still stalled
+            res = ISplitterError::TIMEOUT;
+            continue;
+        }
+        auto wait_msec = std::chrono::ceil<std::chrono::milliseconds>(exit_time - now).count();
+        FutexWait(header_->space_futex, value, static_cast<int32_t>(std::min<int64_t>(wait_msec, kLivenessPollMsec)));
+    }
+    header_->producer_parked.store(0);
+    return res;
+}
+
+bool ShmSplitter::ClientGetCount(size_t* _pnCount) const {
+    *_pnCount = 0;
+    for (size_t slot = 0; header_ && (slot < max_clients_); ++slot) {
+        *_pnCount += header_->Client(slot).generation.load() & 1;
+    }
+    return true;
+}
+
+bool ShmSplitter::ClientsStatsGet(std::vector<ClientStats>* _pvStats) const {
+    _pvStats->clear();
+    for (size_t slot = 0; header_ && (slot < max_clients_); ++slot) {
+        auto generation = header_->Client(slot).generation.load();
+        if (generation & 1) {
+            header_->StatsGet(slot, generation, &_pvStats->emplace_back());
+        }
+    }
+    return true;
+}
+
+size_t ShmSplitter::ClientsReap() {
+    size_t reaped = 0;
+    for (size_t slot = 0; header_ && (slot < max_clients_); ++slot) {
+        auto generation = header_->Client(slot).generation.load();
+        if ((generation & 1) && !ClientAlive(slot) && Reap(slot, generation)) {
+            ++reaped;
+        }
+    }
+    return reaped;
+}
+
+void ShmSplitter::Close() {
+    if (!header_ || header_->closed.exchange(1)) {
+        return;
+    }
+    for (size_t slot = 0; slot < max_clients_; ++slot) {
+        FutexWake(header_->Client(slot).wake_futex, INT_MAX);
+    }
+    // releases a Put stalled on clients
+    header_->WakeProducer();
+}
+
+// a reader holds the lock from before its generation turns odd until after
+// it turns even, the kernel drops it with the last fd of a dead process
+bool ShmSplitter::ClientAlive(size_t slot) const {
+    auto lock = SlotLock(slot, F_WRLCK);
+    if (fcntl(fd_, F_OFD_GETLK, &lock) < 0) {
+        return true;
+    }
+    return lock.l_type != F_UNLCK;
+}
+
+// fails when a new reader has already taken the slot over
+bool ShmSplitter::Reap(size_t slot, uint32_t generation) {
+    return header_->Client(slot).generation.compare_exchange_strong(generation, generation + 1);
+}
+
+// drops the oldest frames of a client down to a full window. The reader
+// moves read_seq too, hence the CAS.
+void ShmSplitter::Trim(size_t slot) {
+    auto& client = header_->Client(slot);
+    auto read_seq = client.read_seq.load();
+    auto first = header_->head.load() - max_buffers_;
+    while (read_seq < first) {
+        if (client.read_seq.compare_exchange_weak(read_seq, first)) {
+            client.dropped.fetch_add(first - read_seq, std::memory_order_relaxed);
+            break;
+        }
+    }
+}
+
+ShmClient::ShmClient():
+  fd_(-1),
+  map_size_(0),
+  header_(nullptr),
+  slot_(0),
+  generation_(0),
+  holding_(false),
+  held_seq_(0) {
+}
+
+ShmClient::~ShmClient() {
+    Detach();
+}
+
+bool ShmClient::Attach(int _nFd, ClientID* _punClientID) {
+    Detach();
+
+    // own open file description, the slot lock belongs to it and not to the
+    // one shared with the producer over fork
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", _nFd);
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    void* map = MAP_FAILED;
+    if ((fstat(fd, &st) == 0) && (static_cast<size_t>(st.st_size) >= sizeof(ShmHeader))) {
+        map = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    auto header = static_cast<ShmHeader*>(map);
+    auto map_size = static_cast<size_t>(st.st_size);
+    if ((header->magic != kShmMagic) || (header->version != kShmVersion) ||
+            (ShmHeader::MapSize(header->max_buffers, header->max_clients, header->max_frame_size) != map_size)) {
+        munmap(map, map_size);
+        close(fd);
+        return false;
+    }
+
+    for (size_t slot = 0; slot < header->max_clients; ++slot) {
+        auto lock = SlotLock(slot, F_WRLCK);
+        if (fcntl(fd, F_OFD_SETLK, &lock) < 0) {
+            continue;
+        }
+        // a dead reader may have left the slot active, unless Put has
+        // reaped it meanwhile
+        auto& client = header->Client(slot);
+        auto generation = client.generation.load();
+        if ((generation & 1) && client.generation.compare_exchange_strong(generation, generation + 1)) {
+            ++generation;
+        }
+        assert(!(generation & 1));
+        client.parked.store(0);
+        client.dropped.store(0, std::memory_order_relaxed);
+        client.delivered.store(0, std::memory_order_relaxed);
+        client.read_seq.store(header->head.load());
+        client.generation.store(generation + 1);
+
+        fd_ = fd;
+        map_size_ = map_size;
+        header_ = header;
+        slot_ = slot;
+        generation_ = generation + 1;
+        holding_ = false;
+        *_punClientID = (ClientID(generation_) << 32) | slot;
+        return true;
+    }
+    munmap(map, map_size);
+    close(fd);
+    return false;
+}
+
+void ShmClient::Detach() {
+    if (!header_) {
+        return;
+    }
+    auto generation = generation_;
+    header_->Client(slot_).generation.compare_exchange_strong(generation, generation + 1);
+    // a Put stalled on this client doesn't wait for it anymore
+    header_->WakeProducer();
+    munmap(header_, map_size_);
+    // releases the slot lock
+    close(fd_);
+    header_ = nullptr;
+    fd_ = -1;
+}
+
+ISplitterError ShmClient::Get(ShmFrame* _pFrame, int32_t _nTimeOutMsec) {
+    if (!header_) {
+        return ISplitterError::UNKNOWN_CLIENT;
+    }
+    Release();
+
+    auto& client = header_->Client(slot_);
+    auto exit_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(_nTimeOutMsec);
+    while (true) {
+        if (header_->closed.load() || (client.generation.load() != generation_)) {
+            return ISplitterError::EOS;
+        }
+        auto read_seq = client.read_seq.load();
+        if (read_seq < header_->head.load()) {
+            auto frame = header_->FrameAt(read_seq);
+            // a timed out Put may have moved the window past it meanwhile
+            if (frame->seq.load(std::memory_order_acquire) != read_seq) {
+                continue;
+            }
+            _pFrame->data = frame->Data();
+            _pFrame->size = frame->size.load(std::memory_order_relaxed);
+            _pFrame->seq = read_seq;
+            _pFrame->stamp = frame->stamp.load(std::memory_order_relaxed);
+            if (!FrameIntact(*_pFrame)) {
+                continue;
+            }
+            holding_ = true;
+            held_seq_ = read_seq;
+            client.delivered.store(client.delivered.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return ISplitterError::NO_ERROR;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= exit_time) {
+            return ISplitterError::TIMEOUT;
+        }
+        auto wait_msec = std::chrono::ceil<std::chrono::milliseconds>(exit_time - now).count();
+        // Put publishes before it looks at the flag, Close sets closed first
+        client.parked.store(1);
+        auto value = client.wake_futex.load();
+        if ((header_->head.load() == read_seq) && !header_->closed.load()) {
+            FutexWait(client.wake_futex, value, static_cast<int32_t>(wait_msec));
+        }
+        client.parked.store(0);
+    }
+}
+
+bool ShmClient::FrameIntact(const ShmFrame& _rFrame) const {
+    if (!header_) {
+        return false;
+    }
+    // an RMW rather than a load: release keeps the reads of the frame before
+    // it, and it sees the latest seq
+    return header_->FrameAt(_rFrame.seq)->seq.fetch_add(0, std::memory_order_acq_rel) == _rFrame.seq;
+}
+
+bool ShmClient::StatsGet(ClientStats* _pStats) const {
+    if (!header_) {
+        return false;
+    }
+    header_->StatsGet(slot_, generation_, _pStats);
+    return true;
+}
+
+// the frame of the last Get leaves the window, unless Put dropped it already
+void ShmClient::Release() {
+    if (!holding_) {
+        return;
+    }
+    holding_ = false;
+    auto read_seq = held_seq_;
+    header_->Client(slot_).read_seq.compare_exchange_strong(read_seq, held_seq_ + 1);
+    header_->WakeProducer();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Splitter.h"
+
+// Splitter shared between processes. Put copies the frame once into a ring in
+// a memfd mapping, reader processes map the same fd and read frames in place.
+// Semantics follow SplitterEngine::RING: every client has a window of
+// max_buffers frames, Put waits up to its timeout for clients with a full
+// window and then drops their oldest frames.
+//
+// Both sides park on futexes in the mapping and are woken only while parked.
+// Every reader holds an OFD lock on the byte of its client slot, the kernel
+// releases it when the reader process dies. A stalled Put tests the lock and
+// frees the slot of a dead reader, so a crashed reader costs the producer a
+// few syscalls at most.
+
+// Frame of ShmClient::Get, points into the shared ring
+struct ShmFrame {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    uint64_t seq = 0;    // frames put before it, gaps are dropped frames
+    int64_t stamp = 0;   // steady_clock ns of the Put, the clock is system wide
+};
+
+class ShmSplitter {
+public:
+    ShmSplitter(size_t max_buffers, size_t max_clients, size_t max_frame_size);
+    ~ShmSplitter();
+
+    ShmSplitter(const ShmSplitter&) = delete;
+    ShmSplitter& operator=(const ShmSplitter&) = delete;
+
+    // fd of the mapping for reader processes, inherited over fork or passed
+    // over a unix socket. Owned by the splitter, -1 when creation failed.
+    int FdGet() const;
+    bool InfoGet(size_t* _pzMaxBuffers, size_t* _pzMaxClients, size_t* _pzMaxFrameSize) const;
+
+    // copies the frame into the ring, FRAME_TOO_LARGE over max_frame_size
+    ISplitterError Put(const FrameBuffer& _pVecPut, int32_t _nTimeOutMsec);
+
+    bool ClientGetCount(size_t* _pnCount) const;
+    bool ClientsStatsGet(std::vector<ClientStats>* _pvStats) const;
+    // frees the slots of dead reader processes, returns how many. Put does it
+    // by itself for the clients it stalls on.
+    size_t ClientsReap();
+
+    // readers get EOS, a stalled and later Put calls CLOSED
+    void Close();
+private:
+    bool ClientAlive(size_t slot) const;
+    bool Reap(size_t slot, uint32_t generation);
+    void Trim(size_t slot);
+
+    const size_t max_buffers_;
+    const size_t max_clients_;
+    const size_t max_frame_size_;
+    int fd_;
+    size_t map_size_;
+    struct ShmHeader* header_;
+    // serializes Put, the ring has a single writer
+    std::mutex push_mtx_;
+};
+
+// Reader side of a ShmSplitter, in any process. Used by one thread at a time.
+class ShmClient {
+public:
+    ShmClient();
+    ~ShmClient();
+
+    ShmClient(const ShmClient&) = delete;
+    ShmClient& operator=(const ShmClient&) = delete;
+
+    // maps the splitter of _nFd and takes a free client slot, or the slot of
+    // a dead reader. The client starts at the next frame put. _nFd stays
+    // owned by the caller.
+    bool Attach(int _nFd, ClientID* _punClientID);
+    void Detach();
+
+    // Next frame without a copy. It stays in the client window until the
+    // next Get, so Put doesn't overwrite it unless it times out on this
+    // client; FrameIntact tells whether that happened while reading it.
+    // EOS after Close or when the slot was taken away.
+    ISplitterError Get(ShmFrame* _pFrame, int32_t _nTimeOutMsec);
+    bool FrameIntact(const ShmFrame& _rFrame) const;
+
+    bool StatsGet(ClientStats* _pStats) const;
+private:
+    void Release();
+
+    int fd_;
+    size_t map_size_;
+    struct ShmHeader* header_;
+    size_t slot_;
+    uint32_t generation_;
+    bool holding_;      // the frame of the last Get is still in the window
+    uint64_t held_seq_;
+};
+
+inline std::shared_ptr<ShmSplitter> ShmSplitterCreate(size_t _zMaxBuffers, size_t _zMaxClients,
+        size_t _zMaxFrameSize) {
+    auto splitter = std::make_shared<ShmSplitter>(_zMaxBuffers, _zMaxClients, _zMaxFrameSize);
+    return splitter->FdGet() >= 0 ? splitter : nullptr;
+}
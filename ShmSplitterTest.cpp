@@ -0,0 +1,188 @@
+#include <gtest/gtest.h>
+
+#include "ShmSplitter.h"
+#include "TestFrames.h"
+#include <csignal>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// runs body in a forked reader process, it exits with 0 when body succeeds
+template <typename Body>
+static pid_t ForkReader(Body body) {
+    auto pid = fork();
+    if (pid == 0) {
+        _exit(body() ? 0 : 1);
+    }
+    return pid;
+}
+
+static bool ReaderSucceeded(pid_t pid) {
+    int status;
+    return (waitpid(pid, &status, 0) == pid) && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+static bool WaitClients(const ShmSplitter& s, size_t count) {
+    for (int i = 0; i < 1000; ++i) {
+        size_t n;
+        s.ClientGetCount(&n);
+        if (n == count) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return false;
+}
+
+TEST(ForkedReaders, ShmSplitter) {
+    constexpr int kFrames = 50;
+    auto s = ShmSplitterCreate(4, 2, 1000);
+    ASSERT_TRUE(s);
+
+    std::vector<pid_t> readers;
+    for (int i = 0; i < 2; ++i) {
+        readers.push_back(ForkReader([fd = s->FdGet()]() {
+            ShmClient client;
+            ClientID id;
+            if (!client.Attach(fd, &id)) {
+                return false;
+            }
+            for (int i = 0; i < kFrames; ++i) {
+                ShmFrame frame;
+                if ((client.Get(&frame, 5000) != ISplitterError::NO_ERROR) ||
+                        (frame.seq != uint64_t(i)) || (frame.size != 100u + i) || (frame.data[i] != i) ||
+                        !client.FrameIntact(frame)) {
+                    return false;
+                }
+            }
+            ClientStats stats;
+            return client.StatsGet(&stats) && (stats.delivered == kFrames) && (stats.dropped == 0);
+        }));
+    }
+    ASSERT_TRUE(WaitClients(*s, 2));
+
+    // the readers keep up or Put waits for them, nothing is dropped
+    for (int i = 0; i < kFrames; ++i) {
+        EXPECT_EQ(s->Put(MakeFrame(i, 100 + i), 5000), ISplitterError::NO_ERROR);
+    }
+    for (auto pid : readers) {
+        EXPECT_TRUE(ReaderSucceeded(pid));
+    }
+    EXPECT_TRUE(WaitClients(*s, 0));
+}
+
+TEST(CrashedReader, ShmSplitter) {
+    auto s = ShmSplitterCreate(2, 1, 1000);
+    ASSERT_TRUE(s);
+
+    auto pid = ForkReader([fd = s->FdGet()]() {
+        ShmClient client;
+        ClientID id;
+        client.Attach(fd, &id);
+        pause();
+        return false;
+    });
+    ASSERT_TRUE(WaitClients(*s, 1));
+    kill(pid, SIGKILL);
+    // a zombie holds no locks, the slot is free before the reader is waited for
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(s->Put(MakeFrame(i, 100), 5000), ISplitterError::NO_ERROR);
+    }
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+    size_t count;
+    EXPECT_TRUE(s->ClientGetCount(&count));
+    EXPECT_EQ(count, 0u);
+    waitpid(pid, nullptr, 0);
+}
+
+TEST(SlotOfCrashedReaderReused, ShmSplitter) {
+    auto s = ShmSplitterCreate(2, 1, 1000);
+    ASSERT_TRUE(s);
+
+    ClientID dead_id = 0;
+    int ids[2];
+    ASSERT_EQ(pipe(ids), 0);
+    auto pid = ForkReader([fd = s->FdGet(), &ids]() {
+        ShmClient client;
+        ClientID id;
+        client.Attach(fd, &id);
+        [[maybe_unused]] auto res = write(ids[1], &id, sizeof(id));
+        pause();
+        return false;
+    });
+    ASSERT_EQ(read(ids[0], &dead_id, sizeof(dead_id)), ssize_t(sizeof(dead_id)));
+    close(ids[0]);
+    close(ids[1]);
+
+    ShmClient client;
+    ClientID id;
+    EXPECT_FALSE(client.Attach(s->FdGet(), &id));
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+
+    // the slot is still active, the new reader takes it over
+    size_t count;
+    EXPECT_TRUE(s->ClientGetCount(&count));
+    EXPECT_EQ(count, 1u);
+    EXPECT_TRUE(client.Attach(s->FdGet(), &id));
+    EXPECT_NE(id, dead_id);
+    EXPECT_EQ(s->ClientsReap(), 0u);
+
+    EXPECT_EQ(s->Put(MakeFrame(7, 100), 0), ISplitterError::NO_ERROR);
+    ShmFrame frame;
+    EXPECT_EQ(client.Get(&frame, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(frame.data[0], 7);
+}
+
+TEST(SlowReaderDrops, ShmSplitter) {
+    auto s = ShmSplitterCreate(2, 1, 1000);
+    ASSERT_TRUE(s);
+    ShmClient client;
+    ClientID id;
+    ASSERT_TRUE(client.Attach(s->FdGet(), &id));
+
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(s->Put(MakeFrame(i, 100), 0), i < 2 ? ISplitterError::NO_ERROR : ISplitterError::TIMEOUT);
+    }
+    std::vector<ClientStats> stats;
+    EXPECT_TRUE(s->ClientsStatsGet(&stats));
+    ASSERT_EQ(stats.size(), 1u);
+    EXPECT_EQ(stats[0].id, id);
+    EXPECT_EQ(stats[0].latency, 2u);
+    EXPECT_EQ(stats[0].dropped, 3u);
+    EXPECT_EQ(stats[0].bytes, 200u);
+
+    ShmFrame frame;
+    EXPECT_EQ(client.Get(&frame, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(frame.seq, 3u);
+    EXPECT_EQ(frame.data[0], 3);
+    EXPECT_TRUE(client.FrameIntact(frame));
+
+    // the frame held since Get is dropped and overwritten by timed out Puts
+    EXPECT_EQ(s->Put(MakeFrame(5, 100), 0), ISplitterError::TIMEOUT);
+    EXPECT_EQ(s->Put(MakeFrame(6, 100), 0), ISplitterError::TIMEOUT);
+    EXPECT_FALSE(client.FrameIntact(frame));
+    EXPECT_EQ(client.Get(&frame, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(frame.seq, 5u);
+}
+
+TEST(Close, ShmSplitter) {
+    auto s = ShmSplitterCreate(2, 1, 100);
+    ASSERT_TRUE(s);
+    EXPECT_EQ(s->Put(MakeFrame(0, 101), 0), ISplitterError::FRAME_TOO_LARGE);
+
+    auto pid = ForkReader([fd = s->FdGet()]() {
+        ShmClient client;
+        ClientID id;
+        ShmFrame frame;
+        return client.Attach(fd, &id) && (client.Get(&frame, 5000) == ISplitterError::EOS);
+    });
+    ASSERT_TRUE(WaitClients(*s, 1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    s->Close();
+    EXPECT_TRUE(ReaderSucceeded(pid));
+    EXPECT_EQ(s->Put(MakeFrame(0, 100), 0), ISplitterError::CLOSED);
+}
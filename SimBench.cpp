@@ -0,0 +1,80 @@
+#include <benchmark/benchmark.h>
+
+#include "Splitter.h"
+#include "SplitterSim.h"
+#include <cstring>
+
+// Simulated-time runs of a 30fps stream and slow clients polling every
+// second or every ten seconds, as SplitterSimTest plays them for seconds.
+// Reports how much faster than real time the splitter and the simulation
+// get through it. With thousands of clients the Put doesn't wait: a stalled
+// Put retries every stalled client on each poll.
+
+using namespace std::chrono_literals;
+
+namespace {
+
+void BM_SimSlowClients(benchmark::State& state) {
+    auto clients = static_cast<size_t>(state.range(0));
+    auto length = std::chrono::seconds(state.range(1));
+    auto engine = static_cast<SplitterEngine>(state.range(2));
+    auto put_timeout = static_cast<int32_t>(state.range(3));
+    const std::chrono::milliseconds periods[] = {1000ms, 10000ms};
+    uint64_t frames = 0;
+    uint64_t delivered = 0;
+
+    for (auto _ : state) {
+        auto clock = SimClockCreate();
+        SplitterOptions options;
+        options.engine = engine;
+        options.clock = clock;
+        ISplitter s(8, clients, options);
+        std::vector<ClientID> ids(clients);
+        for (auto& id : ids) {
+            s.ClientAdd(&id);
+        }
+
+        SimRun run(clock);
+        auto end = SimRun::time_point(length);
+        run.Thread([&]() {
+            for (auto next = SimRun::time_point(); next < end; next += 33ms) {
+                clock->SleepUntil(next);
+                auto fb = std::make_shared<std::vector<uint8_t>>(sizeof(int64_t));
+                auto stamp = next.time_since_epoch().count();
+                memcpy(fb->data(), &stamp, sizeof(stamp));
+                s.Put(fb, put_timeout);
+                ++frames;
+            }
+        });
+        std::vector<std::function<void()>> polls(clients);
+        std::vector<FrameBuffer> batch;
+        for (size_t i = 0; i < clients; ++i) {
+            polls[i] = [&, i]() {
+                s.GetBatch(ids[i], batch, 8, 0);
+                delivered += batch.size();
+                if (clock->Now() < end) {
+                    run.At(clock->Now() + periods[i % std::size(periods)], polls[i]);
+                }
+            };
+            run.At(SimRun::time_point(std::chrono::milliseconds(i % 1000)), polls[i]);
+        }
+        if (!run.Run()) {
+            state.SkipWithError("stuck threads");
+        }
+    }
+    state.counters["frames"] = static_cast<double>(frames);
+    state.counters["delivered"] = static_cast<double>(delivered);
+    state.counters["sim_speedup"] = benchmark::Counter(
+        static_cast<double>(length.count() * state.iterations()), benchmark::Counter::kIsRate);
+}
+
+}
+
+BENCHMARK(BM_SimSlowClients)
+    ->ArgNames({"clients", "seconds", "engine", "put_timeout"})
+    ->Args({20, 3600, static_cast<int64_t>(SplitterEngine::QUEUE), 5})
+    ->Args({10000, 3600, static_cast<int64_t>(SplitterEngine::QUEUE), 0})
+    ->Args({10000, 3600, static_cast<int64_t>(SplitterEngine::RING), 0})
+    ->Iterations(1)
+    ->Unit(benchmark::kSecond)
+    ->UseRealTime();
@@ -1,34 +1,50 @@
 #include <gtest/gtest.h>
 
 #include "Splitter.h"
+#include "SplitterSim.h"
 #include <thread>
 
 TEST(PullTimeout, SingleClient) {
-
-    ISplitter s(1, 2);
+    auto clock = SimClockCreate();
+    SplitterOptions options;
+    options.clock = clock;
+    ISplitter s(1, 2, options);
 
     ClientID client1;
     EXPECT_TRUE(s.ClientAdd(&client1));
 
-    FrameBuffer fb;
-    auto res = s.Get(client1, fb, 1000);
-    EXPECT_EQ(res, ISplitterError::TIMEOUT);
+    SimRun run(clock);
+    run.Thread([&]() {
+        FrameBuffer fb;
+        auto res = s.Get(client1, fb, 1000);
+        EXPECT_EQ(res, ISplitterError::TIMEOUT);
+        EXPECT_EQ(clock->Now(), SimRun::time_point(std::chrono::milliseconds(1000)));
+    });
+    EXPECT_TRUE(run.Run());
 }
 
 
 TEST(PushTimeout, SingleClient) {
-    ISplitter s(1, 2);
+    auto clock = SimClockCreate();
+    SplitterOptions options;
+    options.clock = clock;
+    ISplitter s(1, 2, options);
 
     ClientID client1;
     EXPECT_TRUE(s.ClientAdd(&client1));
 
-    FrameBuffer fb = std::make_shared<std::vector<uint8_t>>(100);
-    
-    auto res = s.Put(fb, 1000);
-    EXPECT_EQ(res, ISplitterError::NO_ERROR);
+    SimRun run(clock);
+    run.Thread([&]() {
+        FrameBuffer fb = std::make_shared<std::vector<uint8_t>>(100);
 
-    res = s.Put(fb, 1000);
-    EXPECT_EQ(res, ISplitterError::TIMEOUT);
+        auto res = s.Put(fb, 1000);
+        EXPECT_EQ(res, ISplitterError::NO_ERROR);
+
+        res = s.Put(fb, 1000);
+        EXPECT_EQ(res, ISplitterError::TIMEOUT);
+        EXPECT_EQ(clock->Now(), SimRun::time_point(std::chrono::milliseconds(1000)));
+    });
+    EXPECT_TRUE(run.Run());
 }
 
 TEST(FifoTestNoDrop, SingleClient) {
@@ -60,24 +76,31 @@ TEST(FifoTestNoDrop, SingleClient) {
 
 TEST(FifoTestDrop, SingleClient) {
     int num_bufs = 4;
-    ISplitter s(2, 2);
+    auto clock = SimClockCreate();
+    SplitterOptions options;
+    options.clock = clock;
+    ISplitter s(2, 2, options);
 
     ClientID client1;
     EXPECT_TRUE(s.ClientAdd(&client1));
 
     std::vector<FrameBuffer> fbs;
 
-    for (int i = 0; i < num_bufs; ++i) {
-        FrameBuffer fb = std::make_shared<std::vector<uint8_t>>(100);
-        auto res = s.Put(fb, 1000);
-        if (i < 2) {
-            EXPECT_EQ(res, ISplitterError::NO_ERROR);
-        } else {
-            EXPECT_EQ(res, ISplitterError::TIMEOUT);
+    SimRun run(clock);
+    run.Thread([&]() {
+        for (int i = 0; i < num_bufs; ++i) {
+            FrameBuffer fb = std::make_shared<std::vector<uint8_t>>(100);
+            auto res = s.Put(fb, 1000);
+            if (i < 2) {
+                EXPECT_EQ(res, ISplitterError::NO_ERROR);
+            } else {
+                EXPECT_EQ(res, ISplitterError::TIMEOUT);
+            }
+
+            fbs.push_back(fb);
         }
-
-        fbs.push_back(fb);
-    }
+    });
+    EXPECT_TRUE(run.Run());
 
     // from 2 - first 2 bufs will dropped
     for (int i = 2; i < num_bufs; ++i) {
@@ -99,7 +122,10 @@ TEST(FifoTestDrop, SingleClient) {
 }
 
 TEST(DeleteUntillPull, SingleClient) {
-    ISplitter s(1, 1);
+    auto clock = SimClockCreate();
+    SplitterOptions options;
+    options.clock = clock;
+    ISplitter s(1, 1, options);
 
     ClientID client1;
     EXPECT_TRUE(s.ClientAdd(&client1));
@@ -107,7 +133,8 @@ TEST(DeleteUntillPull, SingleClient) {
     FrameBuffer fb0 = std::make_shared<std::vector<uint8_t>>(100);
     FrameBuffer fb1 = std::make_shared<std::vector<uint8_t>>(100);
 
-    std::thread pull_thread([&]() {
+    SimRun run(clock);
+    run.Thread([&]() {
         FrameBuffer fb;
         auto res = s.Get(client1, fb, std::numeric_limits<int32_t>::max());
         EXPECT_EQ(fb, fb0);
@@ -119,26 +146,30 @@ TEST(DeleteUntillPull, SingleClient) {
         res = s.Get(client1, fb, std::numeric_limits<int32_t>::max());
         EXPECT_EQ(res, ISplitterError::EOS);
     });
+    run.Thread([&]() {
+        auto res = s.Put(fb0, std::numeric_limits<int32_t>::max());
+        EXPECT_EQ(res, ISplitterError::NO_ERROR);
 
-    auto res = s.Put(fb0, std::numeric_limits<int32_t>::max());
-    EXPECT_EQ(res, ISplitterError::NO_ERROR);
-
-    res = s.Put(fb1, std::numeric_limits<int32_t>::max());
-    EXPECT_EQ(res, ISplitterError::NO_ERROR);
-
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000)); //test may be flaky
-    EXPECT_TRUE(s.ClientRemove(client1));
-
-    pull_thread.join();
+        res = s.Put(fb1, std::numeric_limits<int32_t>::max());
+        EXPECT_EQ(res, ISplitterError::NO_ERROR);
+    });
+    run.At(SimRun::time_point(std::chrono::seconds(1)), [&]() {
+        EXPECT_TRUE(s.ClientRemove(client1));
+    });
+    EXPECT_TRUE(run.Run());
 }
 
 TEST(DeleteUntillPush, SingleClient) {
-    ISplitter s(1, 1);
+    auto clock = SimClockCreate();
+    SplitterOptions options;
+    options.clock = clock;
+    ISplitter s(1, 1, options);
 
     ClientID client1;
     EXPECT_TRUE(s.ClientAdd(&client1));
 
-    std::thread push_thread([&]() {
+    SimRun run(clock);
+    run.Thread([&]() {
         FrameBuffer fb0 = std::make_shared<std::vector<uint8_t>>(100);
         FrameBuffer fb1 = std::make_shared<std::vector<uint8_t>>(100);
         FrameBuffer fb2 = std::make_shared<std::vector<uint8_t>>(100);
@@ -151,15 +182,15 @@ TEST(DeleteUntillPush, SingleClient) {
         res = s.Put(fb2, std::numeric_limits<int32_t>::max());
         EXPECT_EQ(res, ISplitterError::NO_ERROR);
     });
-
-    FrameBuffer fb;
-    auto res = s.Get(client1, fb, std::numeric_limits<int32_t>::max());
-    EXPECT_EQ(res, ISplitterError::NO_ERROR);
-
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000)); //test may be flaky
-    EXPECT_TRUE(s.ClientRemove(client1));
-
-    push_thread.join();
+    run.Thread([&]() {
+        FrameBuffer fb;
+        auto res = s.Get(client1, fb, std::numeric_limits<int32_t>::max());
+        EXPECT_EQ(res, ISplitterError::NO_ERROR);
+    });
+    run.At(SimRun::time_point(std::chrono::seconds(1)), [&]() {
+        EXPECT_TRUE(s.ClientRemove(client1));
+    });
+    EXPECT_TRUE(run.Run());
 }
 
 TEST(FifoTestNoDropThreaded, SingleClient) {
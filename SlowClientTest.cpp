@@ -7,6 +7,11 @@
 #include <gtest/gtest.h>
 
 #include "Splitter.h"
+#include "SplitterSim.h"
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <thread>
 
 /*
 t     push  pull_c1 pull_c2
@@ -35,7 +40,10 @@ t     push  pull_c1 pull_c2
 */
 
 TEST(SlowClient, MultipleClients) {
-    ISplitter s(2, 2);
+    auto clock = SimClockCreate();
+    SplitterOptions options;
+    options.clock = clock;
+    ISplitter s(2, 2, options);
 
     ClientID client1;
     ClientID client2;
@@ -47,70 +55,74 @@ TEST(SlowClient, MultipleClients) {
         bufs.push_back(std::make_shared<std::vector<uint8_t>>(100));
     }
 
-    // steps 0 - 5, bufs [0-2]
-    for (int i = 0; i < 3; ++i) {
-        {
-            auto res = s.Put(bufs[i], 50);
-            EXPECT_EQ(res, ISplitterError::NO_ERROR);
-        }
-        
-        FrameBuffer fb1;
-        auto res1 = s.Get(client1, fb1, 100);
-        FrameBuffer fb2;
-        auto res2 = s.Get(client2, fb2, 100);
-        EXPECT_EQ(res1, ISplitterError::NO_ERROR);
-        EXPECT_EQ(res2, ISplitterError::NO_ERROR);
-        EXPECT_EQ(fb1, bufs[i]);
-        EXPECT_EQ(fb2, bufs[i]);
-    }
-
-    // steps 6 - 14, bufs [3-6]
-    for (int i = 3; i < 7; ++i) {
-        {
-            auto res = s.Put(bufs[i], 50);
-            if ((i>=5) && (i<=7)) {
-                EXPECT_EQ(res, ISplitterError::TIMEOUT);
-            } else {
+    SimRun run(clock);
+    run.Thread([&]() {
+        // steps 0 - 5, bufs [0-2]
+        for (int i = 0; i < 3; ++i) {
+            {
+                auto res = s.Put(bufs[i], 50);
                 EXPECT_EQ(res, ISplitterError::NO_ERROR);
             }
+
+            FrameBuffer fb1;
+            auto res1 = s.Get(client1, fb1, 100);
+            FrameBuffer fb2;
+            auto res2 = s.Get(client2, fb2, 100);
+            EXPECT_EQ(res1, ISplitterError::NO_ERROR);
+            EXPECT_EQ(res2, ISplitterError::NO_ERROR);
+            EXPECT_EQ(fb1, bufs[i]);
+            EXPECT_EQ(fb2, bufs[i]);
         }
-        
-        FrameBuffer fb1;
-        auto res1 = s.Get(client1, fb1, 100);
-        EXPECT_EQ(res1, ISplitterError::NO_ERROR);
-        EXPECT_EQ(fb1, bufs[i]);
-    }
 
-    // steps 15 - 19, bufs [7-9]
-    for (int i = 7; i < 10; ++i) {
-        {
-            auto res = s.Put(bufs[i], 50);
-            if (i==7) {
-                EXPECT_EQ(res, ISplitterError::TIMEOUT);
-            } else {
-                EXPECT_EQ(res, ISplitterError::NO_ERROR);
+        // steps 6 - 14, bufs [3-6]
+        for (int i = 3; i < 7; ++i) {
+            {
+                auto res = s.Put(bufs[i], 50);
+                if ((i>=5) && (i<=7)) {
+                    EXPECT_EQ(res, ISplitterError::TIMEOUT);
+                } else {
+                    EXPECT_EQ(res, ISplitterError::NO_ERROR);
+                }
             }
+
+            FrameBuffer fb1;
+            auto res1 = s.Get(client1, fb1, 100);
+            EXPECT_EQ(res1, ISplitterError::NO_ERROR);
+            EXPECT_EQ(fb1, bufs[i]);
         }
 
-        FrameBuffer fb1;
-        auto res1 = s.Get(client1, fb1, 100);
-        FrameBuffer fb2;
-        auto res2 = s.Get(client2, fb2, 100);
-        EXPECT_EQ(res1, ISplitterError::NO_ERROR);
-        EXPECT_EQ(res2, ISplitterError::NO_ERROR);
-        EXPECT_EQ(fb1, bufs[i]);
-        EXPECT_EQ(fb2, bufs[i-1]);
-    }
-    // steps 20 - 21
-    {
-        FrameBuffer fb1;
-        auto res1 = s.Get(client1, fb1, 100);
-        FrameBuffer fb2;
-        auto res2 = s.Get(client2, fb2, 100);
-        EXPECT_EQ(res1, ISplitterError::TIMEOUT);
-        EXPECT_EQ(res2, ISplitterError::NO_ERROR);
-        EXPECT_EQ(fb2, bufs[9]);
-    }
+        // steps 15 - 19, bufs [7-9]
+        for (int i = 7; i < 10; ++i) {
+            {
+                auto res = s.Put(bufs[i], 50);
+                if (i==7) {
+                    EXPECT_EQ(res, ISplitterError::TIMEOUT);
+                } else {
+                    EXPECT_EQ(res, ISplitterError::NO_ERROR);
+                }
+            }
+
+            FrameBuffer fb1;
+            auto res1 = s.Get(client1, fb1, 100);
+            FrameBuffer fb2;
+            auto res2 = s.Get(client2, fb2, 100);
+            EXPECT_EQ(res1, ISplitterError::NO_ERROR);
+            EXPECT_EQ(res2, ISplitterError::NO_ERROR);
+            EXPECT_EQ(fb1, bufs[i]);
+            EXPECT_EQ(fb2, bufs[i-1]);
+        }
+        // steps 20 - 21
+        {
+            FrameBuffer fb1;
+            auto res1 = s.Get(client1, fb1, 100);
+            FrameBuffer fb2;
+            auto res2 = s.Get(client2, fb2, 100);
+            EXPECT_EQ(res1, ISplitterError::TIMEOUT);
+            EXPECT_EQ(res2, ISplitterError::NO_ERROR);
+            EXPECT_EQ(fb2, bufs[9]);
+        }
+    });
+    EXPECT_TRUE(run.Run());
 
     {
         auto lock = s.BeginClientsIteration();
@@ -129,3 +141,246 @@ TEST(SlowClient, MultipleClients) {
         EXPECT_EQ(drops, 3);
     }
 }
+
+// The scenario above with 500 clients in their own threads, counting wakeups.
+// Consumers that keep up must not cost the producer any, and each push wakes
+// a parked consumer at most once. The producer puts the next frame once the
+// consumers got the previous one, nothing depends on how fast threads run.
+TEST(SlowClient, Wakeups500Clients) {
+    const int num_clients = 500;
+    const int num_bufs = 10;
+    ISplitter s(2, num_clients);
+
+    std::vector<ClientID> clients(num_clients);
+    for (auto& client : clients) {
+        EXPECT_TRUE(s.ClientAdd(&client));
+    }
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    int delivered = 0;      // frames got by all consumers
+    bool slow_wake = false;
+    auto got = [&]() {
+        std::lock_guard lck(mtx);
+        ++delivered;
+        cv.notify_all();
+    };
+
+    std::vector<int> received(num_clients);
+    std::vector<std::thread> consumers;
+    // client 0 gets 3 frames, then stops until the producer is done
+    consumers.emplace_back([&]() {
+        FrameBuffer fb;
+        while ((received[0] < 3) &&
+                (s.Get(clients[0], fb, std::numeric_limits<int32_t>::max()) == ISplitterError::NO_ERROR)) {
+            ++received[0];
+            got();
+        }
+        std::unique_lock lck(mtx);
+        cv.wait(lck, [&]() {
+            return slow_wake;
+        });
+        lck.unlock();
+        while (s.TryGet(clients[0], fb) == ISplitterError::NO_ERROR) {
+            ++received[0];
+        }
+    });
+    for (int c = 1; c < num_clients; ++c) {
+        consumers.emplace_back([&, c]() {
+            FrameBuffer fb;
+            while (s.Get(clients[c], fb, std::numeric_limits<int32_t>::max()) == ISplitterError::NO_ERROR) {
+                ++received[c];
+                got();
+            }
+        });
+    }
+
+    for (int i = 0; i < num_bufs; ++i) {
+        // the slow client holds 2 frames, 3 and 4
+        EXPECT_EQ(s.Put(std::make_shared<std::vector<uint8_t>>(100), 0),
+            (i < 5) ? ISplitterError::NO_ERROR : ISplitterError::TIMEOUT);
+        std::unique_lock lck(mtx);
+        cv.wait(lck, [&]() {
+            return delivered == (i + 1) * (num_clients - 1) + std::min(i + 1, 3);
+        });
+    }
+    // before Close wakes every consumer
+    SplitterMetrics metrics;
+    EXPECT_TRUE(s.MetricsGet(&metrics));
+    {
+        std::lock_guard lck(mtx);
+        slow_wake = true;
+        cv.notify_all();
+    }
+    consumers[0].join();
+    // the others wait in Get until they're removed
+    s.Close();
+    for (int c = 1; c < num_clients; ++c) {
+        consumers[c].join();
+    }
+
+    // 0, 1, 2, 8 and 9
+    EXPECT_EQ(received[0], 5);
+    for (int c = 1; c < num_clients; ++c) {
+        EXPECT_EQ(received[c], num_bufs);
+    }
+
+    EXPECT_LE(metrics.pull_wakeups, uint64_t(num_clients * num_bufs));
+    // before it was a notify per Get, num_clients * num_bufs
+    EXPECT_LT(metrics.push_wakeups, uint64_t(num_clients));
+    EXPECT_EQ(metrics.event_fd_syscalls, 0u);
+}
+
+TEST(SlowClient, ReportTimedOut) {
+    auto clock = SimClockCreate();
+    SplitterOptions options;
+    options.clock = clock;
+    ISplitter s(1, 2, options);
+    ClientID client1;
+    ClientID client2;
+    EXPECT_TRUE(s.ClientAdd(&client1));
+    EXPECT_TRUE(s.ClientAdd(&client2));
+
+    auto fb = std::make_shared<std::vector<uint8_t>>(100);
+    SimRun run(clock);
+    run.Thread([&]() {
+        std::vector<ClientID> timed_out;
+        EXPECT_EQ(s.Put(fb, 10, &timed_out), ISplitterError::NO_ERROR);
+        EXPECT_TRUE(timed_out.empty());
+
+        FrameBuffer got;
+        EXPECT_EQ(s.Get(client2, got, 0), ISplitterError::NO_ERROR);
+        EXPECT_EQ(s.Put(fb, 10, &timed_out), ISplitterError::TIMEOUT);
+        EXPECT_EQ(timed_out, std::vector<ClientID>{client1});
+        EXPECT_EQ(clock->Now(), SimRun::time_point(std::chrono::milliseconds(10)));
+    });
+    EXPECT_TRUE(run.Run());
+}
+
+// Put doesn't wait for the slow client, its frames wait aside and time out
+// on their own
+TEST(SlowClient, BackgroundDelivery) {
+    auto clock = SimClockCreate();
+    SplitterOptions options;
+    options.background_delivery = true;
+    options.clock = clock;
+    ISplitter s(2, 2, options);
+    ClientID slow;
+    ClientID fast;
+    EXPECT_TRUE(s.ClientAdd(&slow));
+    EXPECT_TRUE(s.ClientAdd(&fast));
+
+    std::vector<FrameBuffer> bufs;
+    for (int i = 0; i < 6; ++i) {
+        bufs.push_back(std::make_shared<std::vector<uint8_t>>(100));
+    }
+
+    SimRun run(clock);
+    run.Thread([&]() {
+        std::vector<ClientID> timed_out;
+        for (int i = 0; i < 4; ++i) {
+            EXPECT_EQ(s.Put(bufs[i], 100, &timed_out), ISplitterError::NO_ERROR);
+            FrameBuffer got;
+            EXPECT_EQ(s.Get(fast, got, 0), ISplitterError::NO_ERROR);
+            EXPECT_EQ(got, bufs[i]);
+        }
+        EXPECT_EQ(clock->Now(), SimRun::time_point());
+
+        // frames set aside move in as the slow client frees space, in order
+        for (int i = 0; i < 4; ++i) {
+            FrameBuffer got;
+            EXPECT_EQ(s.Get(slow, got, 0), ISplitterError::NO_ERROR);
+            EXPECT_EQ(got, bufs[i]);
+        }
+        EXPECT_TRUE(timed_out.empty());
+
+        // now the slow client sleeps past the deadline, the oldest frames are dropped
+        FrameBuffer got;
+        for (int i = 0; i < 4; ++i) {
+            EXPECT_EQ(s.Put(bufs[i], 50, &timed_out), ISplitterError::NO_ERROR);
+            EXPECT_EQ(s.Get(fast, got, 0), ISplitterError::NO_ERROR);
+        }
+        clock->SleepUntil(clock->Now() + std::chrono::milliseconds(100));
+        EXPECT_EQ(s.Put(bufs[4], 50, &timed_out), ISplitterError::TIMEOUT);
+        EXPECT_EQ(timed_out, std::vector<ClientID>{slow});
+
+        std::vector<ClientStats> stats;
+        s.ClientsStatsGet(&stats);
+        EXPECT_EQ(stats[0].dropped, 2u);
+        EXPECT_EQ(s.Get(slow, got, 0), ISplitterError::NO_ERROR);
+        EXPECT_EQ(got, bufs[2]);
+    });
+    EXPECT_TRUE(run.Run());
+}
+
+// a Put without the list doesn't take the timed out clients from a later one
+TEST(ReportAcrossOverloads, BackgroundDelivery) {
+    auto clock = SimClockCreate();
+    SplitterOptions options;
+    options.background_delivery = true;
+    options.clock = clock;
+    ISplitter s(1, 2, options);
+    ClientID slow;
+    ClientID fast;
+    EXPECT_TRUE(s.ClientAdd(&slow));
+    EXPECT_TRUE(s.ClientAdd(&fast));
+
+    SimRun run(clock);
+    run.Thread([&]() {
+        auto frame = std::make_shared<std::vector<uint8_t>>(100);
+        FrameBuffer got;
+        for (int i = 0; i < 2; ++i) {
+            EXPECT_EQ(s.Put(frame, 50), ISplitterError::NO_ERROR);
+            EXPECT_EQ(s.Get(fast, got, 0), ISplitterError::NO_ERROR);
+        }
+        clock->SleepUntil(clock->Now() + std::chrono::milliseconds(100));
+
+        EXPECT_EQ(s.Put(frame, 50), ISplitterError::TIMEOUT);
+        EXPECT_EQ(s.Get(fast, got, 0), ISplitterError::NO_ERROR);
+        std::vector<ClientID> timed_out;
+        EXPECT_EQ(s.Put(frame, 50, &timed_out), ISplitterError::TIMEOUT);
+        EXPECT_EQ(timed_out, std::vector<ClientID>{slow});
+    });
+    EXPECT_TRUE(run.Run());
+}
+
+// a Put with no timeout queues behind the frames set aside by earlier Puts
+TEST(MixedTimeouts, BackgroundDelivery) {
+    auto clock = SimClockCreate();
+    SplitterOptions options;
+    options.background_delivery = true;
+    options.clock = clock;
+    ISplitter s(2, 1, options);
+    ClientID client;
+    EXPECT_TRUE(s.ClientAdd(&client));
+
+    SimRun run(clock);
+    run.Thread([&]() {
+        auto frame = std::make_shared<std::vector<uint8_t>>(100);
+        for (int32_t timeout : {0, 0, 100, 0}) {
+            EXPECT_EQ(s.Put(frame, timeout), ISplitterError::NO_ERROR);
+        }
+        for (uint64_t i = 0; i < 4; ++i) {
+            FrameBuffer got;
+            uint64_t seq;
+            EXPECT_EQ(s.Get(client, got, 0, &seq), ISplitterError::NO_ERROR);
+            EXPECT_EQ(seq, i);
+        }
+
+        // both frames set aside are forced in once the first one expires
+        for (int32_t timeout : {0, 0, 50, 0}) {
+            s.Put(frame, timeout);
+        }
+        clock->SleepUntil(clock->Now() + std::chrono::milliseconds(100));
+        for (uint64_t i = 6; i < 8; ++i) {
+            FrameBuffer got;
+            uint64_t seq;
+            EXPECT_EQ(s.Get(client, got, 0, &seq), ISplitterError::NO_ERROR);
+            EXPECT_EQ(seq, i);
+        }
+        std::vector<ClientStats> stats;
+        s.ClientsStatsGet(&stats);
+        EXPECT_EQ(stats[0].dropped, 2u);
+    });
+    EXPECT_TRUE(run.Run());
+}
@@ -1,240 +1,1540 @@
 #include "Splitter.h"
+#include "BasicSplitter.h"
+#include "SplitterAsync.h"
+#include "StreamLog.h"
+#include "Tracer.h"
 
 #include <atomic>
 #include <deque>
 #include <iterator>
+#include <latch>
 #include <cassert>
+#include <algorithm>
+#include <span>
+#include <utility>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
-struct ClientCtx {
-    ClientCtx(size_t max_buffers):
-      to_delete_(false),
-      drop_counter_(0),
-      max_buffers_(max_buffers) {
+namespace {
 
+size_t FrameBytes(const FrameBuffer& fb) {
+    return fb ? fb->size() : 0;
+}
+
+}
+
+// Frame storage of SplitterEngine::RING. Put publishes a frame once, clients
+// only keep a read sequence number into it. The ring has one slot more than
+// max_buffers, so a frame can be published while stalled clients still hold a
+// full window of older frames.
+class FrameRing {
+public:
+    FrameRing(size_t max_buffers):
+      slots_(max_buffers + 1),
+      stamps_(max_buffers + 1),
+      sizes_(max_buffers + 1),
+      bytes_(0),
+      head_(0),
+      tail_(0) {
+
+    }
+
+    // single writer: Put and AsyncPut under ring_put_mtx_ and push_mtx_.
+    // Readers load head with acquire, so every slot below head is visible to
+    // them.
+    void Publish(const FrameBuffer& fb, int64_t stamp) {
+        auto head = head_.load(std::memory_order_relaxed);
+        auto slot = head % slots_.size();
+        auto size = FrameBytes(fb);
+        Advance<size_t>(bytes_, size - sizes_[slot].load(std::memory_order_relaxed));
+        sizes_[slot].store(size, std::memory_order_relaxed);
+        slots_[slot] = fb;
+        stamps_[slot] = stamp;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    const FrameBuffer& At(uint64_t seq) const {
+        return slots_[seq % slots_.size()];
+    }
+
+    int64_t StampAt(uint64_t seq) const {
+        return stamps_[seq % slots_.size()];
+    }
+
+    // payload bytes of a slot, safe without push_mtx_
+    size_t SizeAt(uint64_t seq) const {
+        return sizes_[seq % slots_.size()].load(std::memory_order_relaxed);
+    }
+
+    // payload bytes of all slots
+    size_t Bytes() const {
+        return bytes_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Head() const {
+        return head_.load(std::memory_order_acquire);
+    }
+
+    // oldest frame still held, under push_mtx_
+    uint64_t Tail() const {
+        return std::max(tail_, Head() - std::min<uint64_t>(Head(), slots_.size() - 1));
+    }
+
+    void Clear() {
+        tail_ = Head();
+        for (auto& slot : slots_) {
+            slot.reset();
+        }
+        for (auto& size : sizes_) {
+            size.store(0, std::memory_order_relaxed);
+        }
+        bytes_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<FrameBuffer> slots_;
+    std::vector<int64_t> stamps_;  // Metrics::Stamp of the Put
+    std::vector<std::atomic<size_t>> sizes_;
+    std::atomic<size_t> bytes_;
+    std::atomic<uint64_t> head_;
+    uint64_t tail_;  // head at the last Clear
+};
+
+// A frame put into a QUEUE engine splitter. Counts the client queues that
+// hold the frame, so its bytes are counted once however many share it.
+struct FrameRecord {
+    FrameRecord():
+      refs(0),
+      bytes(0),
+      seq(0),
+      budget(nullptr),
+      next(nullptr) {
+
+    }
+
+    std::atomic<uint32_t> refs;
+    size_t bytes;
+    uint64_t seq;  // order of the Put, the lowest is the oldest frame
+    class ByteBudget* budget;
+    FrameRecord* next;  // in the free list of the budget
+};
+
+// Payload bytes held by all client queues against SplitterOptions::max_bytes,
+// only kept when it's set. Records are taken by Put under push_mtx_ from a
+// pool and freed by whoever drops the last queued reference.
+class ByteBudget {
+public:
+    ByteBudget(size_t max_bytes, size_t records):
+      producers_waiting_(0),
+      free_(nullptr),
+      bytes_(0),
+      max_bytes_(max_bytes) {
+        for (size_t i = 0; i < records; ++i) {
+            Free(&records_.emplace_back());
+        }
+    }
+
+    // a record with the reference of Put. The pool grows when every record
+    // is held, up to the frames the queues, the history and the Puts in
+    // flight hold together; a deque keeps the records in place.
+    FrameRecord* Acquire(size_t bytes, uint64_t seq) {
+        // only Put takes records, so a record in the list can't be taken and
+        // freed again between the loads and the exchange
+        auto record = free_.load(std::memory_order_acquire);
+        while (record && !free_.compare_exchange_weak(record, record->next,
+                std::memory_order_acquire, std::memory_order_acquire)) {
+        }
+        if (!record) {
+            record = &records_.emplace_back();
+        }
+        return Take(*record, bytes, seq);
+    }
+
+    static void AddRef(FrameRecord* record) {
+        if (record) {
+            record->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    static void Release(FrameRecord* record) {
+        if (record && (record->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)) {
+            record->budget->bytes_.fetch_sub(record->bytes, std::memory_order_relaxed);
+            record->budget->Free(record);
+        }
+    }
+
+    bool Fits(size_t bytes) const {
+        return !max_bytes_ || (Bytes() + bytes <= max_bytes_);
+    }
+
+    size_t Bytes() const {
+        return bytes_.load(std::memory_order_relaxed);
+    }
+
+    // Puts waiting on push_cv_ for bytes to be freed
+    std::atomic<uint32_t> producers_waiting_;
+private:
+    void Free(FrameRecord* record) {
+        record->next = free_.load(std::memory_order_relaxed);
+        while (!free_.compare_exchange_weak(record->next, record,
+                std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+
+    FrameRecord* Take(FrameRecord& record, size_t bytes, uint64_t seq) {
+        record.bytes = bytes;
+        record.seq = seq;
+        record.budget = this;
+        record.refs.store(1, std::memory_order_relaxed);
+        bytes_.fetch_add(bytes, std::memory_order_relaxed);
+        return &record;
+    }
+
+    std::deque<FrameRecord> records_;
+    std::atomic<FrameRecord*> free_;
+    std::atomic<size_t> bytes_;
+    const size_t max_bytes_;
+};
+
+
+// FIFO of a QUEUE engine client, sized by max_buffers at run time
+using FrameQueue = BasicQueue<QueuedFrame>;
+
+// Last frames put, SplitterOptions::history of a QUEUE engine splitter.
+// Holds a reference to the byte budget record of every frame like a client
+// queue does. Guarded by push_mtx_.
+class FrameHistory {
+public:
+    FrameHistory(size_t capacity):
+      capacity_(capacity) {
+        frames_.Reserve(capacity);
+    }
+
+    void Push(const QueuedFrame& frame) {
+        if (frames_.size() == capacity_) {
+            DropOldest();
+        }
+        ByteBudget::AddRef(frame.record);
+        frames_.push_back({frame.fb, frame.stamp, frame.record, {}, frame.seq});
+    }
+
+    bool DropOldest() {
+        if (frames_.empty()) {
+            return false;
+        }
+        ByteBudget::Release(frames_.pop_front().record);
+        return true;
+    }
+
+    void Clear() {
+        while (DropOldest()) {
+        }
+    }
+
+    // frames a new client starts with, oldest first
+    std::vector<QueuedFrame> Seed(HistorySeed seed, size_t seed_frames) const {
+        size_t first = frames_.size();
+        if (seed == HistorySeed::LAST_FRAMES) {
+            first -= std::min(seed_frames, frames_.size());
+        } else if (seed == HistorySeed::LAST_KEYFRAME) {
+            for (size_t i = frames_.size(); i-- > 0;) {
+                if (FrameIsKeyFrame(frames_.at(i).fb)) {
+                    first = i;
+                    break;
+                }
+            }
+        }
+        std::vector<QueuedFrame> res;
+        for (size_t i = first; i < frames_.size(); ++i) {
+            res.push_back(frames_.at(i));
+        }
+        return res;
+    }
+
+private:
+    const size_t capacity_;
+    FrameQueue frames_;
+};
+
+// Client of ISplitter: a BasicClientBase slot with the queue of QueuedFrame
+// references or the cursor into the ring, and the byte limits, background
+// delivery, decimation, history seeds, eventfd and AsyncGet waiters of the
+// splitter. All methods except the statistics getters expect mtx_ to be held
+// by the caller.
+class alignas(64) ClientCtx : public BasicClientBase {
+public:
+    ClientCtx():
+      event_fd_(-1),
+      signaled_(false),
+      max_buffers_(0),
+      max_bytes_(0),
+      queue_bytes_(0),
+      bytes_(0),
+      ring_(nullptr),
+      background_delivery_(false),
+      read_seq_(0),
+      await_keyframe_(false),
+      skip_counter_(0),
+      decimated_(false),
+      keyframes_only_(false),
+      every_nth_(1),
+      nth_count_(0),
+      fps_interval_(0),
+      fps_tolerance_(0),
+      fps_tat_(0),
+      decided_seq_(UINT64_MAX),
+      admitted_(true) {
+
+    }
+
+    void Setup(size_t slot, size_t max_buffers, size_t max_bytes, Metrics* metrics, SplitterClock* clock,
+            const FrameRing* ring, bool background_delivery) {
+        BasicClientBase::Setup(slot, metrics, clock);
+        max_buffers_ = max_buffers;
+        max_bytes_ = max_bytes;
+        ring_ = ring;
+        background_delivery_ = background_delivery;
+    }
+
+    ~ClientCtx() {
+        if (event_fd_ >= 0) {
+            close(event_fd_);
+        }
+    }
+
+    // starts a new client in a free slot, returns its generation or 0 when
+    // the client can't be created
+    uint32_t Activate(const ClientOptions& options) {
+        assert(event_fd_ < 0);
+        if (options.event_fd) {
+            event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (event_fd_ < 0) {
+                return 0;
+            }
+            signaled_ = false;
+        }
+        overflow_.Set(options.overflow);
+        await_keyframe_ = false;
+        skip_counter_.store(0, std::memory_order_relaxed);
+        read_seq_.store(ring_ ? ring_->Head() : 0, std::memory_order_release);
+        // queues take memory only while the slot is used, a splitter for
+        // many clients may never see most of them
+        if (!ring_) {
+            bufs_.Reserve(max_buffers_);
+        }
+        if (background_delivery_) {
+            deferred_.Reserve(max_buffers_);
+        }
+        residence_ = std::make_unique<Histogram>();
+        return BasicClientBase::Activate(options);
+    }
+
+    // frees the slot, a consumer waiting in Get gets EOS. The event fd is left
+    // readable, its duplicates handed out by ClientEventFdGet keep it open.
+    void Deactivate() {
+        BasicClientBase::Deactivate();
+        ClearQueues();
+        bufs_.Release();
+        deferred_.Release();
+        residence_.reset();
+        WakeAsync(ISplitterError::EOS);
+        if (event_fd_ >= 0) {
+            Signal();
+            close(event_fd_);
+            event_fd_ = -1;
+        }
+    }
+
+    // Decimation of a new client, or none. Called by ClientAdd with push_mtx_
+    // held: the decimation state belongs to Put.
+    void Decimate(const ClientOptions& options) {
+        keyframes_only_ = options.keyframes_only;
+        every_nth_ = std::max<size_t>(options.every_nth, 1);
+        nth_count_ = 0;
+        fps_interval_ = (options.max_fps > 0) ? static_cast<int64_t>(1e9 / options.max_fps) : 0;
+        fps_tolerance_ = fps_interval_ * static_cast<int64_t>(std::max<size_t>(options.max_fps_burst, 1) - 1);
+        fps_tat_ = 0;
+        decided_seq_ = UINT64_MAX;
+        decimated_ = DecimationSet(options);
+    }
+
+    // ClientAdd holds push_mtx_ while the client starts with a seed or
+    // decimation, or stops decimating: that state belongs to Put. decimated_
+    // is only changed by ClientAdd, safe under registry_mtx_.
+    bool AddExclusive(const ClientOptions& options) const {
+        return (options.seed != HistorySeed::NONE) || DecimationSet(options) || decimated_;
+    }
+
+    // whether the client gets the frame at all, called by Put with push_mtx_
+    // held and with or without the client lock. A frame is decided once, a
+    // retry of a stalled Put gets the same answer.
+    bool Admit(const QueuedFrame& frame) {
+        if (!decimated_) {
+            return true;
+        }
+        if (frame.seq != decided_seq_) {
+            decided_seq_ = frame.seq;
+            admitted_ = Decide(frame.fb);
+            if (!admitted_) {
+                Advance<size_t>(skip_counter_);
+            }
+        }
+        return admitted_;
     }
-    
-    void PrepareDelete() {
-        to_delete_ = true;
-        pull_cv_.notify_all();
+
+    // AsyncGet suspended on the empty queue, fired by the next push
+    void AddAsyncWaiter(const std::shared_ptr<AsyncWaiter>& waiter) {
+        std::erase_if(async_waiters_, [](const auto& waiter) {
+            return waiter->Fired();
+        });
+        async_waiters_.push_back(waiter);
+    }
+
+    int EventFd() const {
+        return event_fd_;
+    }
+
+    // for ring clients the frame being put is already published, so the queue
+    // is full when that frame doesn't fit into the window
+    bool QueueFull(const QueuedFrame& frame) const {
+        if (ring_) {
+            return Lag() > max_buffers_;
+        }
+        return Overflows(FrameBytes(frame.fb)) || !deferred_.empty();
+    }
+
+    void PushBuffer(const QueuedFrame& frame) {
+        Tracer::Instant(TraceEvent::PUSH, id_, frame.seq);
+        if (ring_) {
+            while (Lag() > max_buffers_) {
+                Advance<uint64_t>(read_seq_);
+                Drop(1);
+            }
+        } else if (max_buffers_ == 0) {
+            Drop(1);
+        } else {
+            if (await_keyframe_) {
+                if (!FrameIsKeyFrame(frame.fb)) {
+                    Drop(1);
+                    return;
+                }
+                await_keyframe_ = false;
+            }
+            auto bytes = FrameBytes(frame.fb);
+            if (Overflows(bytes)) {
+                switch (Overflow()) {
+                case OverflowPolicy::DROP_NEWEST:
+                case OverflowPolicy::BLOCK:
+                    Drop(1);
+                    return;
+                case OverflowPolicy::KEYFRAME:
+                    while (!bufs_.empty() && Overflows(bytes)) {
+                        SkipToKeyFrame();
+                    }
+                    if (await_keyframe_ && !FrameIsKeyFrame(frame.fb)) {
+                        Drop(1);
+                        return;
+                    }
+                    await_keyframe_ = false;
+                    break;
+                case OverflowPolicy::DROP_OLDEST:
+                    while (!bufs_.empty() && Overflows(bytes)) {
+                        DropFront();
+                    }
+                    break;
+                }
+            }
+            Enqueue(frame);
+        }
     }
 
-    bool WillDelete() const {
-        return to_delete_;
+    OverflowPolicy Overflow() const {
+        return overflow_.Get();
     }
 
-    bool QueueFull() const {
-        return bufs_.size() == max_buffers_;
+    // frames a Put can't push in order before its timeout, the client's
+    // queue is left alone
+    void DropBuffers(std::span<const QueuedFrame> frames) {
+        for (auto& frame : frames) {
+            if (Admit(frame)) {
+                Drop(1);
+            }
+        }
     }
 
-    void PushBuffer(FrameBuffer fb) {
-        bufs_.push_back(fb);
-        while (bufs_.size() > max_buffers_) {
-            bufs_.pop_front();
-            ++drop_counter_;
-        };
-        pull_cv_.notify_all();
+    // push frames while the queue has room, or all of them dropping the oldest
+    // when forced. Consumer is woken once. Returns number of frames done
+    // with, pushed or skipped by the decimation.
+    size_t PushBuffers(std::span<const QueuedFrame> frames, bool force) {
+        size_t done = 0;
+        size_t pushed = 0;
+        for (; done < frames.size(); ++done) {
+            if (!Admit(frames[done])) {
+                continue;
+            }
+            if (!force && QueueFull(frames[done])) {
+                break;
+            }
+            PushBuffer(frames[done]);
+            ++pushed;
+        }
+        if (pushed) {
+            NotifyPull();
+            Signal();
+            WakeAsync(ISplitterError::NO_ERROR);
+        }
+        return done;
     }
 
-    FrameBuffer PopBuffer() {
-        auto res = *bufs_.begin();
-        bufs_.pop_front();
+    // starts a new client with frames put before it joined, the newest that
+    // fit its queue. whole: all of them or none.
+    void Seed(std::span<const QueuedFrame> frames, bool whole) {
+        size_t count = 0;
+        size_t bytes = 0;
+        while ((count < frames.size()) && (count < max_buffers_)) {
+            auto frame_bytes = FrameBytes(frames[frames.size() - count - 1].fb);
+            if (max_bytes_ && count && (bytes + frame_bytes > max_bytes_)) {
+                break;
+            }
+            bytes += frame_bytes;
+            ++count;
+        }
+        if (!count || (whole && (count < frames.size()))) {
+            return;
+        }
+        for (auto& frame : frames.last(count)) {
+            Enqueue(frame);
+        }
+        Signal();
+    }
+
+    // same for a ring client: the window starts at an older frame
+    void SeedRing(uint64_t first) {
+        read_seq_.store(first, std::memory_order_release);
+        if (!IsQueueEmpty()) {
+            Signal();
+        }
+    }
+
+    // background_delivery: keeps frames that don't fit until the consumer
+    // frees space or their deadline. When even that is full, the oldest frame
+    // set aside is forced in.
+    void Defer(std::span<const QueuedFrame> frames, SplitterClock::time_point deadline) {
+        for (auto& frame : frames) {
+            if (!Admit(frame)) {
+                continue;
+            }
+            if (deferred_.size() == max_buffers_) {
+                if (deferred_.empty() || (Overflow() == OverflowPolicy::BLOCK)) {
+                    Drop(1);
+                    continue;
+                }
+                auto oldest = PopDeferred();
+                PushBuffer(oldest);
+                ByteBudget::Release(oldest.record);
+            }
+            ByteBudget::AddRef(frame.record);
+            Advance<size_t>(bytes_, FrameBytes(frame.fb));
+            deferred_.push_back({frame.fb, frame.stamp, frame.record, deadline, frame.seq});
+        }
+    }
+
+    // safe without the client lock
+    bool HasDeferred() const {
+        return !deferred_.empty();
+    }
+
+    // force-feeds frames set aside whose deadline has passed, dropping the
+    // oldest queued ones. Lowers *next to the deadline of the rest.
+    size_t ExpireDeferred(SplitterClock::time_point now, SplitterClock::time_point* next) {
+        size_t forced = 0;
+        // BLOCK frames wait for the consumer however long it takes
+        while (!deferred_.empty() && (Overflow() != OverflowPolicy::BLOCK) && (deferred_.front().deadline <= now)) {
+            auto frame = PopDeferred();
+            PushBuffer(frame);
+            ByteBudget::Release(frame.record);
+            ++forced;
+        }
+        if (forced) {
+            NotifyPull();
+            Signal();
+            WakeAsync(ISplitterError::NO_ERROR);
+        }
+        if (!deferred_.empty() && (Overflow() != OverflowPolicy::BLOCK)) {
+            *next = std::min(*next, deferred_.front().deadline);
+        }
+        return forced;
+    }
+
+    FrameBuffer PopBuffer(uint64_t* seq) {
+        Delivered();
+        FrameBuffer res;
+        int64_t stamp;
+        if (ring_) {
+            *seq = read_seq_.load(std::memory_order_relaxed);
+            Advance<uint64_t>(read_seq_);
+            res = ring_->At(*seq);
+            stamp = ring_->StampAt(*seq);
+        } else {
+            auto frame = Dequeue();
+            res = std::move(frame.fb);
+            stamp = frame.stamp;
+            *seq = frame.seq;
+            PromoteDeferred();
+        }
+        Tracer::Instant(TraceEvent::POP, id_, *seq);
+        if (metrics_->Enabled()) {
+            Metrics::RecordSince(*residence_, stamp);
+        }
+        if (IsQueueEmpty()) {
+            Unsignal();
+        }
         return res;
     }
 
     void Flush() {
-        drop_counter_ += bufs_.size();
-        bufs_.clear();
-        pull_cv_.notify_all();
+        Drop(GetLatency());
+        if (ring_) {
+            read_seq_.store(ring_->Head(), std::memory_order_release);
+        } else {
+            ClearQueues();
+        }
+        Unsignal();
+    }
+
+    // order of the oldest queued frame, UINT64_MAX when there is nothing the
+    // byte budget may evict
+    uint64_t OldestSeq() const {
+        if (bufs_.empty() || !bufs_.front().record || (Overflow() == OverflowPolicy::BLOCK)) {
+            return UINT64_MAX;
+        }
+        return bufs_.front().record->seq;
+    }
+
+    // drops the oldest frame for the byte budget, by the client's policy
+    void Evict() {
+        if (Overflow() == OverflowPolicy::KEYFRAME) {
+            SkipToKeyFrame();
+        } else {
+            DropFront();
+        }
+        PromoteDeferred();
+        if (IsQueueEmpty()) {
+            Unsignal();
+        }
     }
 
     bool IsQueueEmpty() const {
-        return bufs_.empty();
+        return ring_ ? Lag() == 0 : bufs_.empty();
     }
 
     size_t GetLatency() const {
-        return bufs_.size();
+        return ring_ ? std::min<size_t>(Lag(), max_buffers_) : bufs_.size() + deferred_.size();
     }
-    size_t GetDropped() const {
-        return drop_counter_;
+    size_t GetSkipped() const {
+        return skip_counter_.load(std::memory_order_relaxed);
+    }
+    // payload bytes of the queued frames
+    size_t GetBytes() const {
+        if (!ring_) {
+            return bytes_.load(std::memory_order_relaxed);
+        }
+        auto head = ring_->Head();
+        size_t bytes = 0;
+        for (auto seq = head - GetLatency(); seq < head; ++seq) {
+            bytes += ring_->SizeAt(seq);
+        }
+        return bytes;
+    }
+
+    void StatsGet(ClientStats* stats) const {
+        stats->latency = GetLatency();
+        stats->dropped = GetDropped();
+        stats->skipped = GetSkipped();
+        stats->delivered = GetDelivered();
+        stats->overflow = Overflow();
+        stats->bytes = GetBytes();
+    }
+
+    // ns from Put to Get of every delivered frame, while metrics are enabled
+    const Histogram* Residence() const {
+        return residence_.get();
     }
 
-    std::condition_variable pull_cv_;
 private:
-    std::deque<FrameBuffer> bufs_;
-    std::atomic_bool to_delete_;
-    size_t drop_counter_;
+    // event fd is readable exactly while signaled_, it's written only on
+    // transitions so a busy client costs no syscalls
+    void Signal() {
+        if ((event_fd_ >= 0) && !signaled_) {
+            uint64_t one = 1;
+            [[maybe_unused]] auto res = write(event_fd_, &one, sizeof(one));
+            signaled_ = true;
+            Metrics::CountWakeup(metrics_->event_fd_syscalls_);
+        }
+    }
+
+    void Unsignal() {
+        if ((event_fd_ >= 0) && signaled_) {
+            uint64_t value;
+            [[maybe_unused]] auto res = read(event_fd_, &value, sizeof(value));
+            signaled_ = false;
+            Metrics::CountWakeup(metrics_->event_fd_syscalls_);
+        }
+    }
+
+    void WakeAsync(ISplitterError reason) {
+        for (auto& waiter : async_waiters_) {
+            waiter->Fire(reason);
+        }
+        async_waiters_.clear();
+    }
+
+    // frames after a dropped one can't be decoded up to the next keyframe. When
+    // none is queued, frames put are dropped until a keyframe comes.
+    void SkipToKeyFrame() {
+        DropFront();
+        while (!bufs_.empty() && !FrameIsKeyFrame(bufs_.front().fb)) {
+            DropFront();
+        }
+        await_keyframe_ = bufs_.empty();
+    }
+
+    // per-client limits, max_bytes_ lets a single frame in whatever its size
+    bool Overflows(size_t bytes) const {
+        return (bufs_.size() == max_buffers_) ||
+            (max_bytes_ && !bufs_.empty() && (queue_bytes_ + bytes > max_bytes_));
+    }
+
+    void Enqueue(const QueuedFrame& frame) {
+        auto bytes = FrameBytes(frame.fb);
+        ByteBudget::AddRef(frame.record);
+        queue_bytes_ += bytes;
+        Advance<size_t>(bytes_, bytes);
+        bufs_.push_back({frame.fb, frame.stamp, frame.record, {}, frame.seq});
+    }
+
+    // releases the reference of the record, the frame stays valid
+    QueuedFrame Dequeue() {
+        auto frame = bufs_.pop_front();
+        auto bytes = FrameBytes(frame.fb);
+        queue_bytes_ -= bytes;
+        bytes_.store(bytes_.load(std::memory_order_relaxed) - bytes, std::memory_order_release);
+        ByteBudget::Release(frame.record);
+        return frame;
+    }
+
+    QueuedFrame PopDeferred() {
+        auto frame = deferred_.pop_front();
+        bytes_.store(bytes_.load(std::memory_order_relaxed) - FrameBytes(frame.fb), std::memory_order_release);
+        return frame;
+    }
+
+    void DropFront() {
+        Dequeue();
+        Drop(1);
+    }
+
+    // freed room goes to the oldest frames set aside
+    void PromoteDeferred() {
+        while (!deferred_.empty() && !Overflows(FrameBytes(deferred_.front().fb))) {
+            auto frame = PopDeferred();
+            Enqueue(frame);
+            ByteBudget::Release(frame.record);
+        }
+    }
+
+    void ClearQueues() {
+        while (!bufs_.empty()) {
+            Dequeue();
+        }
+        while (!deferred_.empty()) {
+            ByteBudget::Release(PopDeferred().record);
+        }
+    }
+
+    // keyframes, then every Nth of those, then a token of the bucket. The
+    // bucket is kept as the time it's full again (GCRA).
+    bool Decide(const FrameBuffer& fb) {
+        if (keyframes_only_ && !FrameIsKeyFrame(fb)) {
+            return false;
+        }
+        if (nth_count_++ % every_nth_) {
+            return false;
+        }
+        if (fps_interval_) {
+            auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock_->Now().time_since_epoch()).count();
+            if (now < fps_tat_ - fps_tolerance_) {
+                return false;
+            }
+            fps_tat_ = std::max(fps_tat_, now) + fps_interval_;
+        }
+        return true;
+    }
+
+    void Drop(size_t n) {
+        BasicClientBase::Drop(n, Overflow());
+    }
+
+    // read_seq_ is loaded first: the head only grows and is never behind it
+    uint64_t Lag() const {
+        auto read_seq = read_seq_.load(std::memory_order_acquire);
+        return ring_->Head() - read_seq;
+    }
+
+    std::unique_ptr<Histogram> residence_;  // of the active client, guarded by mtx_
+    int event_fd_;
+    bool signaled_;
     size_t max_buffers_;
+    size_t max_bytes_;
+    size_t queue_bytes_;          // bytes of bufs_
+    std::atomic<size_t> bytes_;   // bytes of bufs_ and deferred_
+    FrameQueue bufs_;
+    FrameQueue deferred_;  // background_delivery frames that didn't fit, with deadlines
+    const FrameRing* ring_;
+    bool background_delivery_;  // deferred_ is used
+    std::atomic<uint64_t> read_seq_;
+    std::vector<std::shared_ptr<AsyncWaiter>> async_waiters_;
+    ClientPolicy overflow_;
+    bool await_keyframe_;  // KEYFRAME client dropped frames a keyframe must follow
+    std::atomic<size_t> skip_counter_;
+    // decimation, guarded by push_mtx_ of the splitter
+    bool decimated_;
+    bool keyframes_only_;
+    size_t every_nth_;
+    uint64_t nth_count_;
+    int64_t fps_interval_;   // ns per token
+    int64_t fps_tolerance_;  // ns of the burst beyond one token
+    int64_t fps_tat_;        // clock_ ns when the bucket is empty
+    uint64_t decided_seq_;   // QueuedFrame::seq of the last frame decided
+    bool admitted_;
 };
 
-ISplitter::ISplitter(size_t max_buffers, size_t max_clients):
-  state_(ISplitterError::NO_ERROR),
-  max_buffers_(max_buffers),
-  max_clients_(max_clients) {
+static_assert(std::tuple_size_v<decltype(Metrics::policy_drops_)> == kOverflowPolicies);
+
+// the ring holds no frames past the window of its clients, and max_buffers + 1
+// frames whatever their size
+static bool OptionsSupported(size_t max_buffers, const SplitterOptions& options) {
+    return (options.engine != SplitterEngine::RING) ||
+        (!options.background_delivery && (options.history <= max_buffers) &&
+            !options.max_bytes && !options.max_client_bytes);
 }
 
-bool ISplitter::InfoGet(size_t* _pzMaxBuffers, size_t* _pzMaxClients) const {
-    std::lock_guard lck(mtx_);
-    *_pzMaxBuffers = max_buffers_;
-    *_pzMaxClients = max_clients_;
-    return true;
+// What ISplitter adds to the BasicSplitter engine: the frame stores shared by
+// the clients, and the AsyncPut calls woken along with the producers.
+struct SplitterHooks {
+    using Client = ClientCtx;
+
+    void Setup(ClientCtx& client, size_t slot, size_t max_buffers, Metrics* metrics, SplitterClock* clock) {
+        client.Setup(slot, max_buffers, max_client_bytes, metrics, clock, ring.get(), background_delivery);
+    }
+
+    void ProducersWoken(ISplitterError reason) {
+        for (auto& waiter : async_producers) {
+            waiter->Fire(reason);
+        }
+        async_producers.clear();
+    }
+
+    // any Get may free bytes of the budget
+    bool ProducerWaits() const {
+        return budget && (budget->producers_waiting_.load() > 0);
+    }
+
+    void FramesClear() {
+        if (ring) {
+            ring->Clear();
+        }
+        if (history) {
+            history->Clear();
+        }
+    }
+
+    std::shared_ptr<FrameRing> ring; // only for SplitterEngine::RING
+    std::shared_ptr<ByteBudget> budget; // only for SplitterEngine::QUEUE with max_bytes
+    std::shared_ptr<FrameHistory> history; // only for SplitterEngine::QUEUE, guarded by push_mtx_
+    size_t max_client_bytes = 0;
+    bool background_delivery = false;
+    // suspended AsyncPut calls, guarded by push_mtx_
+    std::vector<std::shared_ptr<AsyncWaiter>> async_producers;
+};
+
+static SplitterHooks HooksCreate(size_t max_buffers, const SplitterOptions& options) {
+    SplitterHooks hooks;
+    if (options.engine == SplitterEngine::RING) {
+        hooks.ring = std::make_shared<FrameRing>(max_buffers);
+    } else if (options.max_bytes) {
+        // a batch being put, the pool grows with the frames held
+        hooks.budget = std::make_shared<ByteBudget>(options.max_bytes, max_buffers + 1);
+    }
+    if (options.history && !hooks.ring) {
+        hooks.history = std::make_shared<FrameHistory>(options.history);
+    }
+    hooks.max_client_bytes = options.max_client_bytes;
+    hooks.background_delivery = options.background_delivery;
+    return hooks;
 }
 
-ClientID ISplitter::GenerateClinetId() const {
-    // this ID generator have an issue that ID will repeated after 4e9 client connections
-    static std::atomic<uint32_t> id_counter_;
-    return ++id_counter_;
+// Engine of ISplitter: BasicSplitter over QueuedFrame references with an
+// OverflowPolicy per client, and the RING engine, byte budget, history, log,
+// background delivery and coroutine Get/Put of SplitterOptions on top.
+class SplitterCore : public BasicSplitter<QueuedFrame, std::dynamic_extent, ClientPolicy, SplitterHooks> {
+public:
+    SplitterCore(size_t max_buffers, size_t max_clients, const SplitterOptions& options);
+    ~SplitterCore();
+
+    bool InfoGet(size_t* _pzMaxBuffers, size_t* _pzMaxClients) const;
+    ISplitterError PutFrames(std::span<const FrameBuffer> _pVecsPut, int32_t _nTimeOutMsec,
+        std::vector<ClientID>* _pvTimedOut);
+    ISplitterError Get(ClientID _nClientID, FrameBuffer& _pVecGet, int32_t _nTimeOutMsec, uint64_t* _punSeq);
+    ISplitterError GetBatch(ClientID _nClientID, std::vector<FrameBuffer>& _pVecsGet, size_t _zMaxCount,
+        int32_t _nTimeOutMsec);
+    bool ClientAdd(ClientID* _unClientID, const ClientOptions& _rOptions, const uint64_t* _punLogSeq);
+    int ClientEventFdGet(ClientID _nClientID) const;
+    bool BytesHeldGet(size_t* _pzBytes) const;
+    std::shared_ptr<StreamLog> LogGet() const;
+    SplitterTask<ISplitterError> AsyncGet(ClientID _nClientID, FrameBuffer& _pVecGet, int32_t _nTimeOutMsec,
+        SplitterExecutor& _rExecutor);
+    SplitterTask<ISplitterError> AsyncPut(FrameBuffer _pVecPut, int32_t _nTimeOutMsec, SplitterExecutor& _rExecutor);
+
+private:
+    // background_delivery: feed clients with room, set the rest aside
+    void DeliverDeferred(std::span<const QueuedFrame> frames, SplitterClock::time_point deadline);
+    // byte budget: waits until bytes more fit, evicting at exit_time. false
+    // when frames were evicted.
+    bool MakeRoom(std::unique_lock<std::mutex>& lck, size_t bytes,
+        SplitterClock::time_point exit_time);
+    bool EvictOldest();
+    // starts a new client with frames of the history, called with push_mtx_
+    // and the client lock held
+    void Seed(ClientCtx& _rClient, const ClientOptions& _rOptions);
+    // a frame being put, with the Put's reference to its byte budget record
+    QueuedFrame PutFrame(const FrameBuffer& _pVecPut);
+    void PutFrameRelease(QueuedFrame& _rFrame);
+    void PusherRun();
+    // force-feeds expired frames set aside, returns the next deadline
+    SplitterClock::time_point PusherExpire(std::vector<ClientID>& timed_out);
+    // register a suspended AsyncGet/AsyncPut, false when it shouldn't suspend
+    bool AsyncPullWait(ClientID _nClientID, const std::shared_ptr<AsyncWaiter>& _pWaiter);
+    bool AsyncPushWait(uint64_t _unWakeups, const std::shared_ptr<AsyncWaiter>& _pWaiter);
+
+    const SplitterOptions options_;
+    const bool supported_;  // options_ fit the engine
+    // RING engine: Put and AsyncPut calls run one at a time, the ring has one
+    // spare slot for the frame being delivered
+    AsyncMutex ring_put_mtx_;
+    std::shared_ptr<AsyncTimer> async_timer_;
+    // background_delivery thread, deadline and timed out clients are guarded
+    // by pusher_mtx_
+    std::mutex pusher_mtx_;
+    std::condition_variable pusher_cv_;
+    bool pusher_stop_;
+    SplitterClock::time_point pusher_deadline_;
+    std::vector<ClientID> pusher_timed_out_;
+    std::thread pusher_;
+};
+
+SplitterCore::SplitterCore(size_t max_buffers, size_t max_clients, const SplitterOptions& options):
+  BasicSplitter(max_buffers, max_clients, options.clock, HooksCreate(max_buffers, options)),
+  options_(options),
+  supported_(OptionsSupported(max_buffers, options)),
+  async_timer_(std::make_shared<AsyncTimer>()),
+  pusher_stop_(false),
+  pusher_deadline_(SplitterClock::time_point::max()) {
+    if (options_.background_delivery && !hooks_.ring) {
+        // a simulated clock counts the thread in once it's attached
+        std::latch attached(1);
+        pusher_ = std::thread([this, &attached]() {
+            clock_->Attach();
+            attached.count_down();
+            PusherRun();
+            clock_->Detach();
+        });
+        attached.wait();
+    }
 }
 
-bool ISplitter::ClientAdd(ClientID* _unClientID) {
-    std::lock_guard lck(mtx_);
-    if (clients_.size() < max_clients_) {
-        auto id = GenerateClinetId();
-        auto ctx = std::make_shared<ClientCtx>(max_buffers_);
-        clients_.insert({id, ctx});
-        *_unClientID = id;
-        return true;
-    } else {
+SplitterCore::~SplitterCore() {
+    if (pusher_.joinable()) {
+        {
+            std::lock_guard lck(pusher_mtx_);
+            pusher_stop_ = true;
+        }
+        clock_->NotifyAll(pusher_cv_);
+        pusher_.join();
+    }
+}
+
+bool SplitterCore::InfoGet(size_t* _pzMaxBuffers, size_t* _pzMaxClients) const {
+    return BasicSplitter::InfoGet(_pzMaxBuffers, _pzMaxClients) && supported_;
+}
+
+bool SplitterCore::AsyncPullWait(ClientID _nClientID, const std::shared_ptr<AsyncWaiter>& _pWaiter) {
+    uint32_t generation;
+    auto client = FindClient(_nClientID, &generation);
+    if (!client) {
+        return false;
+    }
+    std::lock_guard lck(client->mtx_);
+    if (!client->Alive(generation) || !client->IsQueueEmpty()) {
         return false;
     }
+    client->AddAsyncWaiter(_pWaiter);
+    return true;
 }
 
-bool ISplitter::ClientRemove(ClientID _unClientID) {
-    std::lock_guard lck(mtx_);
-    auto client_iter = clients_.find(_unClientID);
-    if (client_iter != clients_.end()) {
-        auto client = *client_iter;
-        client.second->PrepareDelete();
-        clients_.erase(client_iter);
-        push_cv_.notify_all();
-        return true;
-    } else {
+bool SplitterCore::AsyncPushWait(uint64_t _unWakeups, const std::shared_ptr<AsyncWaiter>& _pWaiter) {
+    std::lock_guard lck(push_mtx_);
+    // a consumer freed space since the caller looked at the stalled clients
+    if (push_wakeups_ != _unWakeups) {
         return false;
     }
+    std::erase_if(hooks_.async_producers, [](const auto& waiter) {
+        return waiter->Fired();
+    });
+    hooks_.async_producers.push_back(_pWaiter);
+    return true;
 }
 
-ISplitterError ISplitter::Put(const FrameBuffer& _pVecPut, int32_t _nTimeOutMsec) {
-    auto exit_time = std::chrono::high_resolution_clock().now() + std::chrono::milliseconds(_nTimeOutMsec);
-    std::unique_lock lck(mtx_);
+std::shared_ptr<StreamLog> SplitterCore::LogGet() const {
+    return options_.log;
+}
+
+bool SplitterCore::ClientAdd(ClientID* _unClientID, const ClientOptions& _rOptions, const uint64_t* _punLogSeq) {
+    // a ring cursor can only skip the oldest frames
+    if (!supported_ || (hooks_.ring && (((_rOptions.overflow != OverflowPolicy::DROP_OLDEST) &&
+            (_rOptions.overflow != OverflowPolicy::BLOCK)) || DecimationSet(_rOptions)))) {
+        return false;
+    }
+    // no Put in between, the client gets every frame once
+    return BasicSplitter::ClientAdd(_unClientID, _rOptions, _punLogSeq != nullptr, [&]() {
+        return !_punLogSeq || (options_.log->End() == *_punLogSeq);
+    }, [&](ClientCtx& client) {
+        client.Decimate(_rOptions);
+        Seed(client, _rOptions);
+    });
+}
+
+void SplitterCore::Seed(ClientCtx& _rClient, const ClientOptions& _rOptions) {
+    if (!options_.history) {
+        return;
+    }
+    if (hooks_.history) {
+        auto frames = hooks_.history->Seed(_rOptions.seed, _rOptions.seed_frames);
+        _rClient.Seed(frames, _rOptions.seed == HistorySeed::LAST_KEYFRAME);
+        return;
+    }
+
+    auto& ring = *hooks_.ring;
+    auto head = ring.Head();
+    // the ring holds up to max_buffers frames anyway
+    auto tail = std::max(ring.Tail(), head - std::min<uint64_t>(head, options_.history));
+    auto first = head;
+    if (_rOptions.seed == HistorySeed::LAST_FRAMES) {
+        first -= std::min<uint64_t>(head - tail, _rOptions.seed_frames);
+    } else if (_rOptions.seed == HistorySeed::LAST_KEYFRAME) {
+        for (auto seq = head; seq-- > tail;) {
+            if (FrameIsKeyFrame(ring.At(seq))) {
+                first = seq;
+                break;
+            }
+        }
+    }
+    _rClient.SeedRing(first);
+}
+
+ISplitterError SplitterCore::PutFrames(std::span<const FrameBuffer> _pVecsPut, int32_t _nTimeOutMsec,
+        std::vector<ClientID>* _pvTimedOut) {
+    Tracer::Begin(TraceEvent::PUT, 0, _pVecsPut.size());
+    auto exit_time = clock_->Now() + std::chrono::milliseconds(_nTimeOutMsec);
+    // every Put goes through the frames set aside, a frame forced in right
+    // away would overtake them; with no timeout they're expired at once
+    bool background = pusher_.joinable();
+    auto& ring = hooks_.ring;
+
+    // a single frame, the common case, needs no allocation
+    QueuedFrame single;
+    std::vector<QueuedFrame> batch;
+    std::span<QueuedFrame> frames(&single, 1);
+    if (_pVecsPut.size() != 1) {
+        batch.resize(_pVecsPut.size());
+        frames = batch;
+    }
+
+    std::unique_lock<AsyncMutex> ring_lck;
+    if (ring) {
+        ring_lck = std::unique_lock(ring_put_mtx_);
+    }
+    auto lck = metrics_.Lock(push_mtx_);
+    // over the byte budget Put waits like for a stalled client, with
+    // background delivery it evicts right away
+    size_t bytes = 0;
+    for (auto& fb : _pVecsPut) {
+        bytes += FrameBytes(fb);
+    }
+    bool room = MakeRoom(lck, bytes, background ? clock_->Now() : exit_time);
+
+    auto seq = put_seq_;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        frames[i] = PutFrame(_pVecsPut[i]);
+    }
 
     ISplitterError res = ISplitterError::NO_ERROR;
+    if (background) {
+        DeliverDeferred(frames, exit_time);
+    } else if (!ring) {
+        res = Deliver(lck, frames, seq, exit_time, _pvTimedOut);
+    } else {
+        // the ring has only one spare slot, so frames are published one by
+        // one; ring clients see a frame by cursor, it's stored only once
+        for (size_t i = 0; i < frames.size(); ++i) {
+            ring->Publish(frames[i].fb, frames[i].stamp);
+            auto frame_res = Deliver(lck, frames.subspan(i, 1), seq + i, exit_time, _pvTimedOut);
+            if (frame_res != ISplitterError::NO_ERROR) {
+                res = frame_res;
+            }
+            if ((res == ISplitterError::CLOSED) || (res == ISplitterError::FLUSHED)) {
+                break;
+            }
+        }
+    }
+
+    // frames no client took are freed here
+    for (auto& frame : frames) {
+        PutFrameRelease(frame);
+    }
+    lck.unlock();
+
+    if (background) {
+        std::lock_guard pusher_lck(pusher_mtx_);
+        res = pusher_timed_out_.empty() ? ISplitterError::NO_ERROR : ISplitterError::TIMEOUT;
+        // kept for the next Put that asks for them
+        if (_pvTimedOut) {
+            _pvTimedOut->swap(pusher_timed_out_);
+            pusher_timed_out_.clear();
+        }
+    }
+    if (!room && (res == ISplitterError::NO_ERROR)) {
+        res = ISplitterError::TIMEOUT;
+    }
+    Tracer::End(TraceEvent::PUT, 0, static_cast<uint64_t>(res));
+    return res;
+}
 
-    std::deque<std::shared_ptr<ClientCtx>> stall;
+QueuedFrame SplitterCore::PutFrame(const FrameBuffer& _pVecPut) {
+    auto seq = put_seq_++;
+    auto record = hooks_.budget ? hooks_.budget->Acquire(FrameBytes(_pVecPut), seq) : nullptr;
+    QueuedFrame frame = {_pVecPut, metrics_.Stamp(), record, {}, seq};
+    if (options_.log) {
+        options_.log->Append(_pVecPut);
+    }
+    if (hooks_.history) {
+        hooks_.history->Push(frame);
+    }
+    return frame;
+}
 
-    // first pass: put buffers to clients than doesn't stall and collect stalled
-    for (auto client = clients_.begin(); client != clients_.end(); ++client) {
-        if (client->second->WillDelete()) {
+void SplitterCore::PutFrameRelease(QueuedFrame& _rFrame) {
+    ByteBudget::Release(std::exchange(_rFrame.record, nullptr));
+}
+
+bool SplitterCore::MakeRoom(std::unique_lock<std::mutex>& lck, size_t bytes,
+        SplitterClock::time_point exit_time) {
+    auto& budget = hooks_.budget;
+    auto& history = hooks_.history;
+    if (!budget || budget->Fits(bytes)) {
+        return true;
+    }
+    // the history is the cheapest to lose
+    while (history && !budget->Fits(bytes) && history->DropOldest()) {
+    }
+    // counted, as other producers may wait here too
+    ++budget->producers_waiting_;
+    while (!budget->Fits(bytes) && (clock_->Now() < exit_time)) {
+        ++producers_parked_;
+        clock_->WaitUntil(push_cv_, lck, exit_time);
+        --producers_parked_;
+    }
+    --budget->producers_waiting_;
+    if (budget->Fits(bytes)) {
+        return true;
+    }
+    while (!budget->Fits(bytes) && EvictOldest()) {
+    }
+    return false;
+}
+
+bool SplitterCore::EvictOldest() {
+    auto clients_end = clients_end_.load(std::memory_order_acquire);
+    ClientCtx* victim = nullptr;
+    uint32_t victim_generation = 0;
+    uint64_t oldest = UINT64_MAX;
+    for (size_t slot = 0; slot < clients_end; ++slot) {
+        auto& client = clients_[slot];
+        auto generation = client.Generation();
+        if (!ClientCtx::IsActive(generation)) {
             continue;
-        } else if (client->second->QueueFull()) {
-            stall.push_back(client->second);
+        }
+        std::lock_guard client_lck(client.mtx_);
+        auto seq = client.Alive(generation) ? client.OldestSeq() : UINT64_MAX;
+        if (seq < oldest) {
+            oldest = seq;
+            victim = &client;
+            victim_generation = generation;
+        }
+    }
+    if (!victim) {
+        return false;
+    }
+    std::lock_guard client_lck(victim->mtx_);
+    if (victim->Alive(victim_generation) && (victim->OldestSeq() != UINT64_MAX)) {
+        victim->Evict();
+    }
+    return true;
+}
+
+void SplitterCore::DeliverDeferred(std::span<const QueuedFrame> frames, SplitterClock::time_point deadline) {
+    auto clients_end = clients_end_.load(std::memory_order_acquire);
+    bool deferred = false;
+    for (size_t slot = 0; slot < clients_end; ++slot) {
+        auto& client = clients_[slot];
+        auto generation = client.Generation();
+        // a single frame the client skips doesn't need its lock
+        if (!ClientCtx::IsActive(generation) || ((frames.size() == 1) && !client.Admit(frames[0]))) {
             continue;
         }
-        client->second->PushBuffer(_pVecPut);
-        client->second->pull_cv_.notify_all();
+        auto client_lck = metrics_.Lock(client.mtx_);
+        if (!client.Alive(generation)) {
+            continue;
+        }
+        auto pushed = client.PushBuffers(frames, false);
+        if (pushed < frames.size()) {
+            client.Defer(frames.subspan(pushed), deadline);
+            deferred = true;
+        }
     }
 
-    // until we have time - try to put buffers to clients
-    while (stall.size() && (res != ISplitterError::TIMEOUT)) {
-        res = push_cv_.wait_until(lck, exit_time) == std::cv_status::timeout ? ISplitterError::TIMEOUT : res;
+    if (deferred) {
+        std::lock_guard lck(pusher_mtx_);
+        if (deadline < pusher_deadline_) {
+            pusher_deadline_ = deadline;
+            clock_->NotifyAll(pusher_cv_);
+        }
+    }
+}
 
-        if (state_ != ISplitterError::NO_ERROR) {
-            res = state_;
-            stall.clear();
-            state_ = ISplitterError::NO_ERROR;
-            break;
+void SplitterCore::PusherRun() {
+    std::unique_lock lck(pusher_mtx_);
+    while (!pusher_stop_) {
+        if (pusher_deadline_ == SplitterClock::time_point::max()) {
+            clock_->Wait(pusher_cv_, lck);
+            continue;
+        }
+        if (clock_->Now() < pusher_deadline_) {
+            clock_->WaitUntil(pusher_cv_, lck, pusher_deadline_);
+            continue;
         }
 
-        for (auto client = stall.begin(); client < stall.end(); ++client) {
-            if ((*client)->WillDelete()) {
-                client = stall.erase(client);
-            } else if (!(*client)->QueueFull()) {
-                (*client)->PushBuffer(_pVecPut);
-                client = stall.erase(client);
+        // Put may set an earlier deadline meanwhile, it's kept by the min
+        pusher_deadline_ = SplitterClock::time_point::max();
+        lck.unlock();
+        std::vector<ClientID> timed_out;
+        auto next = PusherExpire(timed_out);
+        lck.lock();
+        pusher_deadline_ = std::min(pusher_deadline_, next);
+        for (auto id : timed_out) {
+            if (std::find(pusher_timed_out_.begin(), pusher_timed_out_.end(), id) == pusher_timed_out_.end()) {
+                pusher_timed_out_.push_back(id);
             }
         }
     }
+}
 
-    // now we can't wait - force push buffer to FIFO. it will drop old buffers
-    for (auto client = stall.begin(); client != stall.end(); ++client) {
-        if (!(*client)->WillDelete()) {
-            (*client)->PushBuffer(_pVecPut);
+SplitterClock::time_point SplitterCore::PusherExpire(std::vector<ClientID>& timed_out) {
+    auto now = clock_->Now();
+    auto next = SplitterClock::time_point::max();
+    auto clients_end = clients_end_.load(std::memory_order_acquire);
+    for (size_t slot = 0; slot < clients_end; ++slot) {
+        auto& client = clients_[slot];
+        auto generation = client.Generation();
+        if (!ClientCtx::IsActive(generation) || !client.HasDeferred()) {
+            continue;
+        }
+        auto client_lck = metrics_.Lock(client.mtx_);
+        if (client.Alive(generation) && client.ExpireDeferred(now, &next)) {
+            timed_out.push_back(ClientCtx::MakeId(slot, generation));
         }
     }
+    return next;
+}
 
-    return res;
+ISplitterError SplitterCore::Get(ClientID _nClientID, FrameBuffer& _pVecGet, int32_t _nTimeOutMsec,
+        uint64_t* _punSeq) {
+    return Pull(_nClientID, _nTimeOutMsec, [&](ClientCtx& client) {
+        _pVecGet = client.PopBuffer(_punSeq);
+    });
 }
 
-ISplitterError ISplitter::Get(ClientID _nClientID, FrameBuffer& _pVecGet, int32_t _nTimeOutMsec) {
-    std::unique_lock lck(mtx_);
+ISplitterError SplitterCore::GetBatch(ClientID _nClientID, std::vector<FrameBuffer>& _pVecsGet, size_t _zMaxCount,
+        int32_t _nTimeOutMsec) {
+    _pVecsGet.clear();
+    return Pull(_nClientID, _nTimeOutMsec, [&](ClientCtx& client) {
+        uint64_t seq;
+        while (!client.IsQueueEmpty() && (_pVecsGet.size() < _zMaxCount)) {
+            _pVecsGet.push_back(client.PopBuffer(&seq));
+        }
+    });
+}
+
+int SplitterCore::ClientEventFdGet(ClientID _nClientID) const {
+    uint32_t generation;
+    auto client = FindClient(_nClientID, &generation);
+    if (!client) {
+        return -1;
+    }
+    std::lock_guard lck(client->mtx_);
+    if (!client->Alive(generation) || (client->EventFd() < 0)) {
+        return -1;
+    }
+    return fcntl(client->EventFd(), F_DUPFD_CLOEXEC, 0);
+}
+
+bool SplitterCore::BytesHeldGet(size_t* _pzBytes) const {
+    if (!hooks_.ring && !hooks_.budget) {
+        return false;
+    }
+    *_pzBytes = hooks_.ring ? hooks_.ring->Bytes() : hooks_.budget->Bytes();
+    return true;
+}
+
+SplitterTask<ISplitterError> SplitterCore::AsyncGet(ClientID _nClientID, FrameBuffer& _pVecGet,
+        int32_t _nTimeOutMsec, SplitterExecutor& _rExecutor) {
+    auto deadline = AsyncTimer::Clock::now() + std::chrono::milliseconds(_nTimeOutMsec);
+    uint64_t seq;
+    while (true) {
+        auto res = Get(_nClientID, _pVecGet, 0, &seq);
+        if ((res != ISplitterError::TIMEOUT) || (_nTimeOutMsec <= 0)) {
+            co_return res;
+        }
+
+        auto reason = co_await WaitFor(_rExecutor, *async_timer_, deadline,
+            [this, _nClientID](const std::shared_ptr<AsyncWaiter>& waiter) {
+                return AsyncPullWait(_nClientID, waiter);
+            });
+        if (reason == ISplitterError::EOS) {
+            co_return reason;
+        } else if (reason == ISplitterError::TIMEOUT) {
+            // like Get, a frame that came right at the deadline is still taken
+            co_return Get(_nClientID, _pVecGet, 0, &seq);
+        }
+    }
+}
+
+SplitterTask<ISplitterError> SplitterCore::AsyncPut(FrameBuffer _pVecPut, int32_t _nTimeOutMsec,
+        SplitterExecutor& _rExecutor) {
+    // background_delivery: full clients get the frame set aside, nothing to
+    // wait for
+    if (pusher_.joinable()) {
+        co_return PutFrames(std::span(&_pVecPut, 1), _nTimeOutMsec, nullptr);
+    }
+    auto deadline = AsyncTimer::Clock::now() + std::chrono::milliseconds(_nTimeOutMsec);
+    QueuedFrame frame;
+    auto frames = std::span<const QueuedFrame>(&frame, 1);
+
     ISplitterError res = ISplitterError::NO_ERROR;
+    std::vector<Stalled> stall;
+    uint64_t wakeups;
+    uint64_t epoch;
+    bool room;
+    // like Put, it keeps the ring until the frame is delivered
+    std::unique_lock<AsyncMutex> ring_lck;
+    if (hooks_.ring) {
+        co_await WaitFor(_rExecutor, *async_timer_, AsyncTimer::Clock::time_point::max(),
+            [this](const std::shared_ptr<AsyncWaiter>& waiter) {
+                return ring_put_mtx_.Enqueue(waiter);
+            });
+        ring_lck = std::unique_lock(ring_put_mtx_, std::adopt_lock);
+    }
+    {
+        auto lck = metrics_.Lock(push_mtx_);
+        // over the byte budget it doesn't wait, the oldest frames are evicted
+        room = MakeRoom(lck, FrameBytes(_pVecPut), clock_->Now());
+        frame = PutFrame(_pVecPut);
+        if (hooks_.ring) {
+            hooks_.ring->Publish(frame.fb, frame.stamp);
+        }
+        epoch = abort_epoch_;
+        DeliverFirst(frames, frame.seq, stall);
+        wakeups = push_wakeups_;
+    }
+    auto stall_stamp = stall.empty() ? 0 : metrics_.Stamp();
+
+    while (!stall.empty() && (res != ISplitterError::TIMEOUT)) {
+        auto reason = co_await WaitFor(_rExecutor, *async_timer_, deadline,
+            [this, wakeups](const std::shared_ptr<AsyncWaiter>& waiter) {
+                return AsyncPushWait(wakeups, waiter);
+            });
 
-    auto client_iter = clients_.find(_nClientID);
-    if (client_iter == clients_.end()) {
-        return ISplitterError::UNKNOWN_CLIENT;
+        // like Deliver, a Flush or Close counts whatever woke us: it may come
+        // after a consumer fired the waiter, or before it was registered
+        auto lck = metrics_.Lock(push_mtx_);
+        if (abort_epoch_ != epoch) {
+            DeliverAbort(frames, frame.seq, stall);
+            PutFrameRelease(frame);
+            co_return abort_reason_;
+        }
+        res = reason;
+        DeliverRetry(frames, frame.seq, stall);
+        wakeups = push_wakeups_;
     }
-    auto client = client_iter->second;
 
-    if (client->IsQueueEmpty()) {
-        if (client->pull_cv_.wait_for(lck, std::chrono::milliseconds(_nTimeOutMsec)) == std::cv_status::timeout) {
-            return ISplitterError::TIMEOUT;
+    {
+        auto lck = metrics_.Lock(push_mtx_);
+        if (abort_epoch_ != epoch) {
+            DeliverAbort(frames, frame.seq, stall);
+            PutFrameRelease(frame);
+            co_return abort_reason_;
         }
+        DeliverForce(frames, frame.seq, stall);
+        wakeups = push_wakeups_;
     }
 
-    if (client->WillDelete()) {
-        push_cv_.notify_all();
-        return ISplitterError::EOS;
+    // BLOCK clients are left, they are waited for with no deadline
+    while (!stall.empty()) {
+        co_await WaitFor(_rExecutor, *async_timer_, AsyncTimer::Clock::time_point::max(),
+            [this, wakeups](const std::shared_ptr<AsyncWaiter>& waiter) {
+                return AsyncPushWait(wakeups, waiter);
+            });
+
+        auto lck = metrics_.Lock(push_mtx_);
+        if (abort_epoch_ != epoch) {
+            DeliverAbort(frames, frame.seq, stall);
+            PutFrameRelease(frame);
+            co_return abort_reason_;
+        }
+        DeliverRetry(frames, frame.seq, stall);
+        wakeups = push_wakeups_;
     }
+    Metrics::RecordSince(metrics_.put_stall_, stall_stamp);
+    PutFrameRelease(frame);
+    co_return room ? res : ISplitterError::TIMEOUT;
+}
 
-    _pVecGet = client->PopBuffer();
-    push_cv_.notify_all();
-    return res;
+ISplitter::ISplitter(size_t max_buffers, size_t max_clients, const SplitterOptions& options):
+  core_(std::make_shared<SplitterCore>(max_buffers, max_clients, options)) {
 }
 
-std::unique_lock<std::mutex> ISplitter::BeginClientsIteration() {
-    return std::unique_lock(mtx_);
+ISplitter::~ISplitter() {
 }
 
-bool ISplitter::ClientGetCount(size_t* _pnCount, std::unique_lock<std::mutex>& lock) const {
-    assert(lock.owns_lock());
-    *_pnCount = clients_.size();
-    return true;
+bool ISplitter::InfoGet(size_t* _pzMaxBuffers, size_t* _pzMaxClients) const {
+    return core_->InfoGet(_pzMaxBuffers, _pzMaxClients);
+}
+
+ISplitterError ISplitter::Put(const FrameBuffer& _pVecPut, int32_t _nTimeOutMsec) {
+    return core_->PutFrames(std::span(&_pVecPut, 1), _nTimeOutMsec, nullptr);
+}
+
+ISplitterError ISplitter::Put(const FrameBuffer& _pVecPut, int32_t _nTimeOutMsec, std::vector<ClientID>* _pvTimedOut) {
+    _pvTimedOut->clear();
+    return core_->PutFrames(std::span(&_pVecPut, 1), _nTimeOutMsec, _pvTimedOut);
+}
+
+ISplitterError ISplitter::PutBatch(std::span<const FrameBuffer> _pVecsPut, int32_t _nTimeOutMsec) {
+    return core_->PutFrames(_pVecsPut, _nTimeOutMsec, nullptr);
+}
+
+ISplitterError ISplitter::Get(ClientID _nClientID, FrameBuffer& _pVecGet, int32_t _nTimeOutMsec) {
+    uint64_t seq;
+    return core_->Get(_nClientID, _pVecGet, _nTimeOutMsec, &seq);
+}
+
+ISplitterError ISplitter::Get(ClientID _nClientID, FrameBuffer& _pVecGet, int32_t _nTimeOutMsec, uint64_t* _punSeq) {
+    return core_->Get(_nClientID, _pVecGet, _nTimeOutMsec, _punSeq);
+}
+
+ISplitterError ISplitter::TryGet(ClientID _nClientID, FrameBuffer& _pVecGet) {
+    return Get(_nClientID, _pVecGet, 0);
+}
+
+ISplitterError ISplitter::GetBatch(ClientID _nClientID, std::vector<FrameBuffer>& _pVecsGet, size_t _zMaxCount,
+        int32_t _nTimeOutMsec) {
+    return core_->GetBatch(_nClientID, _pVecsGet, _zMaxCount, _nTimeOutMsec);
+}
+
+bool ISplitter::ClientAdd(ClientID* _unClientID) {
+    return ClientAdd(_unClientID, ClientOptions());
+}
+
+bool ISplitter::ClientAdd(ClientID* _unClientID, const ClientOptions& _rOptions) {
+    return core_->ClientAdd(_unClientID, _rOptions, nullptr);
+}
+
+bool ISplitter::ClientAddAt(uint64_t _unLogSeq, ClientID* _unClientID, const ClientOptions& _rOptions) {
+    return core_->LogGet() && core_->ClientAdd(_unClientID, _rOptions, &_unLogSeq);
+}
+
+std::shared_ptr<StreamLog> ISplitter::LogGet() const {
+    return core_->LogGet();
+}
+
+int ISplitter::ClientEventFdGet(ClientID _nClientID) const {
+    return core_->ClientEventFdGet(_nClientID);
+}
+
+bool ISplitter::ClientRemove(ClientID _unClientID) {
+    return core_->ClientRemove(_unClientID);
 }
 
 bool ISplitter::ClientGetCount(size_t* _pnCount) const {
-    std::lock_guard lck(mtx_);
-    *_pnCount = clients_.size();
-    return true;
+    return core_->ClientGetCount(_pnCount);
+}
+
+std::unique_lock<std::mutex> ISplitter::BeginClientsIteration() {
+    return core_->BeginClientsIteration();
+}
+
+bool ISplitter::ClientGetCount(size_t* _pnCount, std::unique_lock<std::mutex>& lock) const {
+    return core_->ClientGetCount(_pnCount, lock);
 }
 
 bool ISplitter::ClientGetByIndex(size_t _zIndex,
         ClientID* _punClientID, size_t* _pzLatency, size_t* _pzDropped,
         std::unique_lock<std::mutex>& lock) const {
-    assert(lock.owns_lock());
+    return core_->ClientGetByIndex(_zIndex, _punClientID, _pzLatency, _pzDropped, lock);
+}
 
-    auto client_iter = clients_.begin();
-    std::advance(client_iter, _zIndex);
-    *_punClientID = client_iter->first;
-    *_pzLatency = client_iter->second->GetLatency();
-    *_pzDropped = client_iter->second->GetDropped();
-    return true;
+bool ISplitter::ClientsStatsGet(std::vector<ClientStats>* _pvStats) const {
+    return core_->ClientsStatsGet(_pvStats);
+}
+
+bool ISplitter::BytesHeldGet(size_t* _pzBytes) const {
+    return core_->BytesHeldGet(_pzBytes);
+}
+
+void ISplitter::MetricsEnable(bool _bEnable) {
+    core_->MetricsEnable(_bEnable);
+}
+
+bool ISplitter::MetricsGet(SplitterMetrics* _pMetrics) const {
+    return core_->MetricsGet(_pMetrics);
+}
+
+SplitterTask<ISplitterError> ISplitter::AsyncGet(ClientID _nClientID, FrameBuffer& _pVecGet, int32_t _nTimeOutMsec,
+        SplitterExecutor& _rExecutor) {
+    return core_->AsyncGet(_nClientID, _pVecGet, _nTimeOutMsec, _rExecutor);
+}
+
+SplitterTask<ISplitterError> ISplitter::AsyncPut(FrameBuffer _pVecPut, int32_t _nTimeOutMsec,
+        SplitterExecutor& _rExecutor) {
+    return core_->AsyncPut(std::move(_pVecPut), _nTimeOutMsec, _rExecutor);
 }
 
 void ISplitter::Close() {
-    std::lock_guard lck(mtx_);
-    for (auto client = clients_.begin(); client != clients_.end(); ++client) {
-        client->second->PrepareDelete();
-    }
-    clients_.clear();
-    state_ = ISplitterError::CLOSED;
-    push_cv_.notify_all();
+    core_->Close();
 }
 
 ISplitterError ISplitter::Flush() {
-    std::lock_guard lck(mtx_);
-    for (auto client = clients_.begin(); client != clients_.end(); ++client) {
-        client->second->Flush();
-    }
-    state_ = ISplitterError::FLUSHED;
-    push_cv_.notify_all();
-
-    return ISplitterError::NO_ERROR;
-}
\ No newline at end of file
+    return core_->Flush();
+}
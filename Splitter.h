@@ -1,14 +1,30 @@
 #pragma once
 
 #include <memory>
-#include <map>
 #include <vector>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <chrono>
+#include <span>
+#include <array>
+#include <cstring>
+#include <thread>
+
+#include "Metrics.h"
+#include "SplitterClock.h"
 
 using FrameBuffer = std::shared_ptr<std::vector<uint8_t>>;
-using ClientID = uint32_t;
+// slot of the client in the low 32 bits, generation of the slot in the high
+// ones. It used to be uint32_t: code keeping ids in 32 bits must widen them,
+// and binaries built against the old header must be rebuilt. Fewer
+// generation bits would let a stale id reach the next client of its slot.
+using ClientID = uint64_t;
+
+template <typename T>
+class SplitterTask;
+class SplitterExecutor;
+class StreamLog;
 
 enum class ISplitterError {
     NO_ERROR = 0,
@@ -17,19 +33,201 @@ enum class ISplitterError {
     CLOSED,
     FLUSHED,
     UNKNOWN_CLIENT,
+    FRAME_TOO_LARGE,  // doesn't fit a slot of a fixed size frame store
+};
+
+// What a client does with a frame put while its queue is full and Put has
+// timed out
+enum class OverflowPolicy {
+    DROP_OLDEST = 0,  // drop the oldest queued frame
+    DROP_NEWEST,      // drop the frame being put
+    BLOCK,            // never drop, Put waits for the client past its timeout
+    KEYFRAME,         // drop up to the next queued keyframe, or until one is put
+};
+constexpr size_t kOverflowPolicies = 4;
+
+// Optional metadata at the start of a frame payload. Producers that use it
+// leave sizeof(FrameHeader) bytes in front of the data. Frames without the
+// header count as keyframes.
+struct FrameHeader {
+    static constexpr uint32_t kMagic = 0x46484452;  // "FHDR"
+    static constexpr uint32_t kKeyFrame = 1u << 0;
+
+    uint32_t magic;
+    uint32_t flags;
+};
+
+inline bool FrameHeaderSet(const FrameBuffer& _pVec, uint32_t _unFlags) {
+    if (!_pVec || (_pVec->size() < sizeof(FrameHeader))) {
+        return false;
+    }
+    FrameHeader header = {FrameHeader::kMagic, _unFlags};
+    memcpy(_pVec->data(), &header, sizeof(header));
+    return true;
+}
+
+inline bool FrameHeaderGet(const FrameBuffer& _pVec, FrameHeader* _pHeader) {
+    if (!_pVec || (_pVec->size() < sizeof(FrameHeader))) {
+        return false;
+    }
+    memcpy(_pHeader, _pVec->data(), sizeof(FrameHeader));
+    return _pHeader->magic == FrameHeader::kMagic;
+}
+
+inline bool FrameIsKeyFrame(const FrameBuffer& _pVec) {
+    FrameHeader header;
+    return !FrameHeaderGet(_pVec, &header) || (header.flags & FrameHeader::kKeyFrame);
+}
+
+// What a new client starts with, taken from the frames kept by
+// SplitterOptions::history
+enum class HistorySeed {
+    NONE = 0,       // the next frame put
+    LAST_FRAMES,    // the last ClientOptions::seed_frames frames
+    LAST_KEYFRAME,  // the last keyframe and the frames after it, none when they don't fit the queue
+};
+
+// How Get waits for a frame while the client queue is empty
+enum class WaitStrategy {
+    PARK = 0,        // sleep on a condition variable right away
+    SPIN_THEN_PARK,  // spin up to ClientOptions::spin_usec, then park
+    BUSY_POLL,       // spin until a frame comes or the timeout, takes a core
+    ADAPTIVE,        // spin about as long as the recent waits took, park when they took over spin_usec
+};
+
+enum class SplitterEngine {
+    QUEUE = 0,  // every client owns a FIFO of FrameBuffer references
+    RING,       // one shared ring of frames, every client owns a read cursor
+};
+
+// Frame of a Put on its way to the clients, also an entry of a client queue.
+// Internal to the splitter.
+struct QueuedFrame {
+    FrameBuffer fb;
+    int64_t stamp;                 // Metrics::Stamp of the Put
+    struct FrameRecord* record;    // QUEUE engine only
+    SplitterClock::time_point deadline;  // of a frame set aside by background_delivery
+    uint64_t seq = 0;              // order of the Put
+};
+
+struct ClientStats {
+    ClientID id;
+    size_t latency;      // frames waiting in the client queue
+    size_t dropped;
+    size_t skipped;      // frames left out by the client's decimation, not dropped
+    uint64_t delivered;  // frames returned by Get/GetBatch
+    OverflowPolicy overflow;
+    size_t bytes;        // payload bytes of the queued frames
+};
+
+struct SplitterMetrics {
+    HistogramSnapshot put_stall;   // ns a stalled Put waited for its clients
+    HistogramSnapshot lock_wait;   // ns waited for contended splitter locks
+    std::vector<uint64_t> drops_per_second;  // oldest first, last is the current second
+    std::vector<std::pair<ClientID, HistogramSnapshot>> residence;  // ns from Put to Get per client
+    // counted even while metrics are disabled
+    uint64_t pull_wakeups = 0;       // notifies of consumers parked in Get
+    uint64_t push_wakeups = 0;       // notifies of a producer parked in Put
+    uint64_t event_fd_syscalls = 0;  // eventfd writes and reads
+    std::array<uint64_t, kOverflowPolicies> policy_drops = {};  // dropped frames by OverflowPolicy
+};
+
+struct ClientOptions {
+    // create an eventfd for the client, see ISplitter::ClientEventFdGet
+    bool event_fd = false;
+    // DROP_NEWEST and KEYFRAME need the QUEUE engine. With background_delivery
+    // a BLOCK client drops the newest frames once its frames set aside fill up.
+    OverflowPolicy overflow = OverflowPolicy::DROP_OLDEST;
+    // frames put before the client joined, the newest that fit its queue
+    HistorySeed seed = HistorySeed::NONE;
+    size_t seed_frames = 0;
+    // Decimation: frames the client gets at all, decided by Put before it
+    // takes the client lock. All set filters apply, in this order. QUEUE
+    // engine only.
+    bool keyframes_only = false;
+    size_t every_nth = 0;      // every Nth frame put from the first one, 0 or 1 for all
+    double max_fps = 0;        // token bucket refilled at max_fps, 0 for no limit
+    size_t max_fps_burst = 1;  // frames the bucket holds
+    // Spinning saves the consumer the futex wake and context switch of a
+    // park, Put doesn't notify a spinning consumer at all.
+    WaitStrategy wait = WaitStrategy::PARK;
+    uint32_t spin_usec = 50;
+};
+
+struct SplitterOptions {
+    SplitterEngine engine = SplitterEngine::QUEUE;
+    // Put returns right after feeding the clients with room. Frames of a full
+    // client wait aside until its consumer frees space, or are force-fed by a
+    // background thread at their own deadline, in the order they were put; a
+    // Put with no timeout sets them aside already expired. QUEUE engine only,
+    // the shared ring can't hold frames past the window of a client; a RING
+    // splitter with it set takes no clients.
+    bool background_delivery = false;
+    // Payload byte limits, 0 for none. max_bytes covers all clients and
+    // counts a frame shared by many of them once; over it Put waits for
+    // consumers up to its timeout and then evicts the oldest frames.
+    // max_client_bytes is applied with the client's OverflowPolicy like
+    // max_buffers, a single frame is let in whatever its size. QUEUE engine
+    // only, the ring holds max_buffers + 1 frames anyway; a RING splitter with
+    // either set takes no clients.
+    size_t max_bytes = 0;
+    size_t max_client_bytes = 0;
+    // Last frames put, kept for clients that join late (ClientOptions::seed).
+    // Shared by reference with the queues and counted against max_bytes once
+    // like them; over max_bytes they are let go before anything else. The
+    // RING engine seeds from the ring, a RING splitter with more than
+    // max_buffers takes no clients.
+    size_t history = 0;
+    // Put appends every frame to the log, see StreamLog.h
+    std::shared_ptr<StreamLog> log;
+    // time of the timeouts and deadlines, the steady clock when not set. The
+    // AsyncGet/AsyncPut timers run on the steady clock regardless.
+    std::shared_ptr<SplitterClock> clock;
 };
 
 class ISplitter {
 public:
-    ISplitter(size_t max_buffers, size_t max_clients);
-    virtual ~ISplitter() = default;
+    ISplitter(size_t max_buffers, size_t max_clients, const SplitterOptions& options = SplitterOptions());
+    virtual ~ISplitter();
 
+    // false for options the engine doesn't support or no max_buffers, the
+    // splitter takes no clients then
     bool InfoGet(size_t* _pzMaxBuffers, size_t* _pzMaxClients) const;
 
     ISplitterError Put(const FrameBuffer& _pVecPut, int32_t _nTimeOutMsec);
+    // Put reporting the clients that timed out, TIMEOUT when there are any.
+    // With background_delivery these are the clients timed out since the
+    // previous report, as deadlines expire after Put has returned; a Put
+    // without _pvTimedOut keeps them for the next report.
+    ISplitterError Put(const FrameBuffer& _pVecPut, int32_t _nTimeOutMsec, std::vector<ClientID>* _pvTimedOut);
     ISplitterError Get(ClientID _nClientID, FrameBuffer& _pVecGet, int32_t _nTimeOutMsec);
+    // Get with the sequence number of the frame: frames put are numbered in
+    // one order over all producers, a frame has the same number for every
+    // client, and every client gets its frames in that order. Gaps are
+    // frames the client dropped or skipped.
+    ISplitterError Get(ClientID _nClientID, FrameBuffer& _pVecGet, int32_t _nTimeOutMsec, uint64_t* _punSeq);
+    // Get that never waits, TIMEOUT when the queue is empty
+    ISplitterError TryGet(ClientID _nClientID, FrameBuffer& _pVecGet);
+
+    // Same as Put/Get for a sequence of frames, but under one critical section
+    // per client and with a single wakeup. The timeout covers the whole batch.
+    // GetBatch replaces the content of _pVecsGet with up to _zMaxCount frames.
+    ISplitterError PutBatch(std::span<const FrameBuffer> _pVecsPut, int32_t _nTimeOutMsec);
+    ISplitterError GetBatch(ClientID _nClientID, std::vector<FrameBuffer>& _pVecsGet, size_t _zMaxCount,
+        int32_t _nTimeOutMsec);
 
     bool ClientAdd(ClientID* _unClientID);
+    bool ClientAdd(ClientID* _unClientID, const ClientOptions& _rOptions);
+    // ClientAdd for a reader of SplitterOptions::log that has read up to
+    // _unLogSeq: the client gets the frames from that one on. false when
+    // there is no log or it is past _unLogSeq already.
+    bool ClientAddAt(uint64_t _unLogSeq, ClientID* _unClientID, const ClientOptions& _rOptions);
+    std::shared_ptr<StreamLog> LogGet() const;
+    // Duplicate of the client's eventfd, owned by the caller, -1 when the
+    // client has none. The fd is readable while the queue is not empty and
+    // after the client was removed, so a reactor can poll it and drain the
+    // client with TryGet.
+    int ClientEventFdGet(ClientID _nClientID) const;
     bool ClientRemove(ClientID _unClientID);
     bool ClientGetCount(size_t* _pnCount) const;
 
@@ -37,19 +235,37 @@ public:
     bool ClientGetCount(size_t* _pnCount, std::unique_lock<std::mutex>& lock) const;
     bool ClientGetByIndex(size_t _zIndex, ClientID* _punClientID, size_t* _pzLatency, size_t* _pzDropped, std::unique_lock<std::mutex>& lock) const;
 
+    // Statistics of every client in one call. Takes no locks, so it doesn't
+    // block Put and Get; values of different clients aren't taken at the same
+    // instant. Prefer it over the BeginClientsIteration/ClientGetByIndex scan.
+    bool ClientsStatsGet(std::vector<ClientStats>* _pvStats) const;
+    // payload bytes held by the splitter, a frame shared by clients once.
+    // The QUEUE engine counts them only with SplitterOptions::max_bytes set,
+    // false without it.
+    bool BytesHeldGet(size_t* _pzBytes) const;
+
+    // Histograms are only filled while enabled, disabled by default
+    void MetricsEnable(bool _bEnable);
+    bool MetricsGet(SplitterMetrics* _pMetrics) const;
+
+    // Coroutine versions of Get and Put, see SplitterAsync.h. They suspend
+    // instead of blocking the thread and are resumed through _rExecutor; the
+    // results are the same as of Get and Put. _pVecGet must outlive the task.
+    SplitterTask<ISplitterError> AsyncGet(ClientID _nClientID, FrameBuffer& _pVecGet, int32_t _nTimeOutMsec,
+        SplitterExecutor& _rExecutor);
+    SplitterTask<ISplitterError> AsyncPut(FrameBuffer _pVecPut, int32_t _nTimeOutMsec, SplitterExecutor& _rExecutor);
+
     ISplitterError Flush();
     void Close();
 private:
-    ClientID GenerateClinetId() const;
-    
-    std::atomic<ISplitterError> state_;
-    mutable std::mutex mtx_;
-    std::condition_variable push_cv_;
-    std::map<ClientID, std::shared_ptr<class ClientCtx>> clients_;
-    const size_t max_buffers_;
-    const size_t max_clients_;
-};
-
-inline std::shared_ptr<ISplitter> SplitterCreate(size_t _zMaxBuffers, size_t _zMaxClients) {
-    return std::make_shared<ISplitter>(_zMaxBuffers, _zMaxClients);
+    // the BasicSplitter engine with the client of the splitter, see
+    // BasicSplitter.h
+    std::shared_ptr<class SplitterCore> core_;
+};
+
+inline std::shared_ptr<ISplitter> SplitterCreate(size_t _zMaxBuffers, size_t _zMaxClients,
+        const SplitterOptions& _rOptions = SplitterOptions()) {
+    auto splitter = std::make_shared<ISplitter>(_zMaxBuffers, _zMaxClients, _rOptions);
+    size_t max_buffers, max_clients;
+    return splitter->InfoGet(&max_buffers, &max_clients) ? splitter : nullptr;
 }
\ No newline at end of file
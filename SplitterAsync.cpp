@@ -0,0 +1,112 @@
+#include "SplitterAsync.h"
+
+bool AsyncWaiter::Fire(ISplitterError reason) {
+    if (fired_.exchange(true)) {
+        return false;
+    }
+    reason_ = reason;
+    timer_.Cancel(*this);
+    executor_.Post(handle_);
+    return true;
+}
+
+AsyncTimer::AsyncTimer():
+  stop_(false) {
+}
+
+AsyncTimer::~AsyncTimer() {
+    {
+        std::lock_guard lck(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void AsyncTimer::Add(const std::shared_ptr<AsyncWaiter>& waiter, Clock::time_point deadline) {
+    std::lock_guard lck(mtx_);
+    // it may be fired already, then Cancel has run before us
+    if (waiter->Fired() || (deadline == Clock::time_point::max())) {
+        return;
+    }
+    if (!thread_.joinable()) {
+        thread_ = std::thread([this]() {
+            Run();
+        });
+    }
+    waiter->timer_pos_ = waiters_.insert({deadline, waiter});
+    waiter->timed_ = true;
+    if (waiter->timer_pos_ == waiters_.begin()) {
+        cv_.notify_all();
+    }
+}
+
+void AsyncTimer::Cancel(AsyncWaiter& waiter) {
+    std::lock_guard lck(mtx_);
+    if (waiter.timed_) {
+        waiters_.erase(waiter.timer_pos_);
+        waiter.timed_ = false;
+    }
+}
+
+void AsyncTimer::Run() {
+    std::unique_lock lck(mtx_);
+    while (!stop_) {
+        if (waiters_.empty()) {
+            cv_.wait(lck);
+            continue;
+        }
+        auto first = waiters_.begin();
+        // a copy, Cancel may erase the waiter while the lock is released
+        auto deadline = first->first;
+        if (deadline > Clock::now()) {
+            cv_.wait_until(lck, deadline);
+            continue;
+        }
+        auto waiter = first->second;
+        waiters_.erase(first);
+        waiter->timed_ = false;
+        lck.unlock();
+        waiter->Fire(ISplitterError::TIMEOUT);
+        lck.lock();
+    }
+}
+
+AsyncMutex::AsyncMutex():
+  locked_(false) {
+}
+
+void AsyncMutex::lock() {
+    std::unique_lock lck(mtx_);
+    cv_.wait(lck, [this]() {
+        return !locked_;
+    });
+    locked_ = true;
+}
+
+void AsyncMutex::unlock() {
+    std::unique_lock lck(mtx_);
+    if (waiters_.empty()) {
+        locked_ = false;
+        lck.unlock();
+        cv_.notify_one();
+        return;
+    }
+    // stays locked, the waiter owns it now
+    auto waiter = std::move(waiters_.front());
+    waiters_.pop_front();
+    lck.unlock();
+    waiter->Fire(ISplitterError::NO_ERROR);
+}
+
+bool AsyncMutex::Enqueue(const std::shared_ptr<AsyncWaiter>& waiter) {
+    std::lock_guard lck(mtx_);
+    if (!locked_) {
+        locked_ = true;
+        return false;
+    }
+    waiters_.push_back(waiter);
+    return true;
+}
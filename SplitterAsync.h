@@ -0,0 +1,211 @@
+#pragma once
+
+#include "Splitter.h"
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <map>
+#include <thread>
+#include <utility>
+
+// Coroutine support of ISplitter::AsyncGet/AsyncPut. The splitter never
+// resumes a coroutine itself, it hands the handle to the executor the
+// operation was started with.
+
+class SplitterExecutor {
+public:
+    virtual ~SplitterExecutor() = default;
+    // Resume h on the executor. Called from any thread, Put and Get included,
+    // so it must not resume inline nor block.
+    virtual void Post(std::coroutine_handle<> h) = 0;
+};
+
+// Lazily started task. co_await runs it and resumes the awaiting coroutine
+// when it finishes.
+template <typename T>
+class [[nodiscard]] SplitterTask {
+public:
+    struct promise_type {
+        SplitterTask get_return_object() {
+            return SplitterTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                auto continuation = h.promise().continuation_;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+            void await_resume() noexcept {
+            }
+        };
+
+        FinalAwaiter final_suspend() noexcept {
+            return {};
+        }
+
+        void return_value(T value) {
+            value_ = std::move(value);
+        }
+
+        void unhandled_exception() {
+            std::terminate();
+        }
+
+        T value_;
+        std::coroutine_handle<> continuation_;
+    };
+
+    SplitterTask(SplitterTask&& other) noexcept:
+      handle_(std::exchange(other.handle_, nullptr)) {
+    }
+
+    SplitterTask(const SplitterTask&) = delete;
+    SplitterTask& operator=(const SplitterTask&) = delete;
+
+    ~SplitterTask() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept {
+        handle_.promise().continuation_ = continuation;
+        return handle_;
+    }
+
+    T await_resume() {
+        return std::move(handle_.promise().value_);
+    }
+
+private:
+    explicit SplitterTask(std::coroutine_handle<promise_type> handle):
+      handle_(handle) {
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// One suspension of an async operation. Shared between the suspended
+// coroutine, the wait list it's registered in and the timer; whichever
+// fires it first decides the reason it's resumed with.
+struct AsyncWaiter {
+    AsyncWaiter(SplitterExecutor& executor, class AsyncTimer& timer, std::coroutine_handle<> handle):
+      executor_(executor),
+      timer_(timer),
+      handle_(handle),
+      fired_(false),
+      reason_(ISplitterError::NO_ERROR),
+      timed_(false) {
+    }
+
+    // false if it was fired already
+    bool Fire(ISplitterError reason);
+
+    bool Fired() const {
+        return fired_;
+    }
+
+    SplitterExecutor& executor_;
+    class AsyncTimer& timer_;
+    std::coroutine_handle<> handle_;
+    std::atomic_bool fired_;
+    ISplitterError reason_;
+    // guarded by the timer lock
+    bool timed_;
+    std::multimap<std::chrono::steady_clock::time_point, std::shared_ptr<AsyncWaiter>>::iterator timer_pos_;
+};
+
+// Fires waiters with TIMEOUT at their deadline. The thread is started by the
+// first Add.
+class AsyncTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    AsyncTimer();
+    ~AsyncTimer();
+
+    void Add(const std::shared_ptr<AsyncWaiter>& waiter, Clock::time_point deadline);
+    // unlinks the waiter if it's still waiting for its deadline
+    void Cancel(AsyncWaiter& waiter);
+
+private:
+    void Run();
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool stop_;
+    std::thread thread_;
+    std::multimap<Clock::time_point, std::shared_ptr<AsyncWaiter>> waiters_;
+};
+
+// Mutex a coroutine can hold across suspensions, so it may be unlocked on
+// another thread than it was locked on. Threads block in lock(), coroutines
+// queue a waiter with Enqueue. unlock() hands it over to the first queued
+// coroutine before any blocked thread.
+class AsyncMutex {
+public:
+    AsyncMutex();
+
+    void lock();
+    void unlock();
+    // locks it and returns false when it's free, or queues the waiter to be
+    // fired with NO_ERROR once it's handed over
+    bool Enqueue(const std::shared_ptr<AsyncWaiter>& waiter);
+
+private:
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool locked_;
+    std::deque<std::shared_ptr<AsyncWaiter>> waiters_;
+};
+
+// Suspends until the waiter is fired. register_fn puts the waiter into the
+// wait list it belongs to and returns false when it's not worth to suspend.
+template <typename RegisterFn>
+struct WaiterAwaitable {
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> h) {
+        auto waiter = std::make_shared<AsyncWaiter>(executor_, timer_, h);
+        waiter_ = waiter;
+        auto& timer = timer_;
+        auto deadline = deadline_;
+        if (!register_fn_(waiter)) {
+            waiter->fired_ = true;
+            return false;
+        }
+        // the coroutine may be resumed from now on, don't touch this
+        timer.Add(waiter, deadline);
+        return true;
+    }
+
+    ISplitterError await_resume() const {
+        return waiter_->reason_;
+    }
+
+    SplitterExecutor& executor_;
+    AsyncTimer& timer_;
+    AsyncTimer::Clock::time_point deadline_;
+    RegisterFn register_fn_;
+    std::shared_ptr<AsyncWaiter> waiter_;
+};
+
+template <typename RegisterFn>
+WaiterAwaitable<RegisterFn> WaitFor(SplitterExecutor& executor, AsyncTimer& timer,
+        AsyncTimer::Clock::time_point deadline, RegisterFn register_fn) {
+    return {executor, timer, deadline, std::move(register_fn), nullptr};
+}
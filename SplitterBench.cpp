@@ -0,0 +1,282 @@
+#include <benchmark/benchmark.h>
+
+#include "BasicSplitter.h"
+#include "FramePool.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+// Splitter throughput and latency. Run the bench_json target (or pass
+// --benchmark_out=<file> --benchmark_out_format=json) to get results
+// suitable for comparing releases.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+void StampFrame(const FrameBuffer& fb) {
+    auto now = NowNs();
+    std::memcpy(fb->data(), &now, sizeof(now));
+}
+
+int64_t FrameAgeNs(const FrameBuffer& fb) {
+    int64_t stamp;
+    std::memcpy(&stamp, fb->data(), sizeof(stamp));
+    return NowNs() - stamp;
+}
+
+// consumer threads, each owns a subset of clients and Gets them round-robin
+class Consumers {
+public:
+    Consumers(ISplitter& s, size_t clients, size_t threads, std::chrono::microseconds slow_delay = {},
+        size_t slow_clients = 0, const ClientOptions& options = ClientOptions()):
+      s_(s),
+      latencies_(threads),
+      ids_(threads) {
+        for (size_t i = 0; i < clients; ++i) {
+            ClientID id;
+            s_.ClientAdd(&id, options);
+            ids_[i % threads].push_back({id, i < slow_clients});
+        }
+        for (size_t t = 0; t < threads; ++t) {
+            threads_.emplace_back([this, t, slow_delay]() {
+                FrameBuffer fb;
+                while (true) {
+                    for (auto& [id, slow] : ids_[t]) {
+                        auto res = s_.Get(id, fb, 100);
+                        if ((res == ISplitterError::EOS) || (res == ISplitterError::UNKNOWN_CLIENT)) {
+                            return;
+                        } else if (res == ISplitterError::NO_ERROR) {
+                            latencies_[t].push_back(FrameAgeNs(fb));
+                            if (slow) {
+                                std::this_thread::sleep_for(slow_delay);
+                            }
+                        }
+                    }
+                }
+            });
+        }
+    }
+
+    ~Consumers() {
+        s_.Close();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void Report(benchmark::State& state) {
+        std::vector<int64_t> all;
+        for (auto& latencies : latencies_) {
+            all.insert(all.end(), latencies.begin(), latencies.end());
+        }
+        if (all.empty()) {
+            return;
+        }
+        std::sort(all.begin(), all.end());
+        auto percentile = [&](double p) {
+            return static_cast<double>(all[static_cast<size_t>(p * (all.size() - 1))]) / 1000.0;
+        };
+        state.counters["p50_us"] = percentile(0.5);
+        state.counters["p90_us"] = percentile(0.9);
+        state.counters["p99_us"] = percentile(0.99);
+        state.counters["p999_us"] = percentile(0.999);
+        state.counters["max_us"] = percentile(1.0);
+    }
+
+private:
+    ISplitter& s_;
+    std::vector<std::vector<int64_t>> latencies_;
+    std::vector<std::vector<std::pair<ClientID, bool>>> ids_;
+    std::vector<std::thread> threads_;
+};
+
+// payload is never touched by the splitter, so big frames only cost memory
+void PutArgs(benchmark::internal::Benchmark* b) {
+    for (int64_t clients : {1, 16, 256, 1024}) {
+        for (int64_t buffers : {1, 16, 256}) {
+            for (int64_t size : {64, 64 << 10, 8 << 20}) {
+                if (buffers * size <= (256 << 20)) {
+                    b->Args({clients, buffers, size});
+                }
+            }
+        }
+    }
+}
+
+// Put cost with nobody reading: after max_buffers frames every Put drops the
+// oldest frame of every client. Zero timeout, so it never waits.
+void BM_Put(benchmark::State& state) {
+    auto clients = state.range(0);
+    auto buffers = state.range(1);
+    auto size = state.range(2);
+    ISplitter s(buffers, clients);
+    auto pool = FramePoolCreate(size, buffers + 2);
+
+    for (int64_t i = 0; i < clients; ++i) {
+        ClientID id;
+        s.ClientAdd(&id);
+    }
+
+    for (auto _ : state) {
+        s.Put(pool->Acquire(), 0);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["deliveries_per_second"] = benchmark::Counter(
+        static_cast<double>(state.iterations() * clients), benchmark::Counter::kIsRate);
+}
+
+// Put cost of BM_Put with the tracer off and on, each delivery records a
+// Push and a Drop event
+void BM_PutTraced(benchmark::State& state) {
+    auto clients = state.range(0);
+    ISplitter s(16, clients);
+    auto pool = FramePoolCreate(64, 18);
+    for (int64_t i = 0; i < clients; ++i) {
+        ClientID id;
+        s.ClientAdd(&id);
+    }
+
+    Tracer::Enable(state.range(1));
+    for (auto _ : state) {
+        s.Put(pool->Acquire(), 0);
+    }
+    Tracer::Enable(false);
+    Tracer::Clear();
+    state.SetItemsProcessed(state.iterations());
+}
+
+// 64 byte telemetry record, the kind of frame BasicSplitter is meant for
+struct Telemetry {
+    int64_t stamp;
+    uint32_t source;
+    uint32_t flags;
+    double values[6];
+};
+
+// Put and Get of a small frame to every client: a FrameBuffer allocated per
+// frame (kind 0) against a BasicSplitter that copies it into the queues
+// (kind 1)
+void BM_SmallFrames(benchmark::State& state) {
+    auto clients = state.range(0);
+    std::vector<ClientID> ids(clients);
+    Telemetry record = {};
+    if (state.range(1) == 0) {
+        ISplitter s(16, clients);
+        for (auto& id : ids) {
+            s.ClientAdd(&id);
+        }
+        for (auto _ : state) {
+            auto fb = std::make_shared<std::vector<uint8_t>>(sizeof(record));
+            std::memcpy(fb->data(), &record, sizeof(record));
+            s.Put(fb, 0);
+            for (auto id : ids) {
+                s.TryGet(id, fb);
+                benchmark::DoNotOptimize(fb->data());
+            }
+        }
+    } else {
+        BasicSplitter<Telemetry, 16> s(clients);
+        for (auto& id : ids) {
+            s.ClientAdd(&id);
+        }
+        for (auto _ : state) {
+            s.Put(record, 0);
+            for (auto id : ids) {
+                s.TryGet(id, record);
+                benchmark::DoNotOptimize(record);
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Put to Get delivery latency with every client drained by consumer threads
+void BM_PutGetLatency(benchmark::State& state) {
+    auto clients = state.range(0);
+    auto buffers = state.range(1);
+    ISplitter s(buffers, clients);
+    auto pool = FramePoolCreate(64, buffers + 2);
+    Consumers consumers(s, clients, std::min<size_t>(clients, 8));
+
+    for (auto _ : state) {
+        auto fb = pool->Acquire();
+        StampFrame(fb);
+        s.Put(fb, 1000);
+    }
+    state.SetItemsProcessed(state.iterations());
+    consumers.Report(state);
+}
+
+// Put against consumers where some sleep after each frame, so Put waits up
+// to the timeout for them
+void BM_StalledPut(benchmark::State& state) {
+    auto slow_clients = state.range(0);
+    auto timeout_ms = static_cast<int32_t>(state.range(1));
+    size_t clients = 16;
+    ISplitter s(4, clients);
+    auto pool = FramePoolCreate(64, 8);
+    Consumers consumers(s, clients, 4, std::chrono::microseconds(500), slow_clients);
+
+    int64_t timeouts = 0;
+    for (auto _ : state) {
+        auto fb = pool->Acquire();
+        StampFrame(fb);
+        if (s.Put(fb, timeout_ms) == ISplitterError::TIMEOUT) {
+            ++timeouts;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["timeouts"] = static_cast<double>(timeouts);
+    consumers.Report(state);
+}
+
+// Put to Get handoff latency of one client by its WaitStrategy, with frames
+// coming every interval_us. The producer sleeps between frames, so a parked
+// consumer pays the wake-up and a spinning one takes a core.
+void BM_Handoff(benchmark::State& state) {
+    ClientOptions options;
+    options.wait = static_cast<WaitStrategy>(state.range(0));
+    auto interval = std::chrono::microseconds(state.range(1));
+    ISplitter s(16, 1);
+    auto pool = FramePoolCreate(64, 18);
+    Consumers consumers(s, 1, 1, {}, 0, options);
+
+    for (auto _ : state) {
+        std::this_thread::sleep_for(interval);
+        auto fb = pool->Acquire();
+        StampFrame(fb);
+        s.Put(fb, 1000);
+    }
+    state.SetItemsProcessed(state.iterations());
+    consumers.Report(state);
+}
+
+}
+
+BENCHMARK(BM_Put)->ArgNames({"clients", "buffers", "size"})->Apply(PutArgs);
+
+BENCHMARK(BM_PutTraced)->ArgNames({"clients", "trace"})->ArgsProduct({{1, 16, 256}, {0, 1}});
+
+BENCHMARK(BM_SmallFrames)->ArgNames({"clients", "kind"})->ArgsProduct({{1, 16, 256}, {0, 1}});
+
+BENCHMARK(BM_PutGetLatency)
+    ->ArgNames({"clients", "buffers"})
+    ->ArgsProduct({{1, 16, 256, 1024}, {1, 16, 256}})
+    ->UseRealTime();
+
+BENCHMARK(BM_StalledPut)
+    ->ArgNames({"slow", "timeout_ms"})
+    ->ArgsProduct({{0, 1, 4}, {0, 1, 10}})
+    ->UseRealTime();
+
+BENCHMARK(BM_Handoff)
+    ->ArgNames({"wait", "interval_us"})
+    ->ArgsProduct({{int64_t(WaitStrategy::PARK), int64_t(WaitStrategy::SPIN_THEN_PARK),
+        int64_t(WaitStrategy::BUSY_POLL), int64_t(WaitStrategy::ADAPTIVE)}, {10, 200}})
+    ->UseRealTime();
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+// Time and blocking waits of a splitter: Put and Get timeouts, the
+// background_delivery deadlines and the max_fps buckets. The splitter waits
+// and wakes through it, so a simulated clock (SimClock in SplitterSim.h) can
+// run the timing of a splitter without real time passing. Metrics and frame
+// stamps stay on the real clock.
+class SplitterClock {
+public:
+    using Clock = std::chrono::steady_clock;
+    using time_point = Clock::time_point;
+
+    virtual ~SplitterClock() = default;
+
+    virtual time_point Now() = 0;
+    // like cv.wait_until: lck is released while waiting and held on return,
+    // wakeups may be spurious. false once deadline has passed.
+    virtual bool WaitUntil(std::condition_variable& cv, std::unique_lock<std::mutex>& lck, time_point deadline) = 0;
+    // same with no deadline
+    virtual void Wait(std::condition_variable& cv, std::unique_lock<std::mutex>& lck) = 0;
+    virtual void NotifyAll(std::condition_variable& cv) = 0;
+    // false when time doesn't pass by itself, busy waiting would never end
+    virtual bool Realtime() const = 0;
+    // a thread of the splitter that waits on the clock starts and ends
+    virtual void Attach() {}
+    virtual void Detach() {}
+};
+
+// The steady clock, what a splitter uses unless SplitterOptions::clock is set
+class SteadyClock final : public SplitterClock {
+public:
+    time_point Now() override {
+        return Clock::now();
+    }
+
+    bool WaitUntil(std::condition_variable& cv, std::unique_lock<std::mutex>& lck, time_point deadline) override {
+        return cv.wait_until(lck, deadline) == std::cv_status::no_timeout;
+    }
+
+    void Wait(std::condition_variable& cv, std::unique_lock<std::mutex>& lck) override {
+        cv.wait(lck);
+    }
+
+    void NotifyAll(std::condition_variable& cv) override {
+        cv.notify_all();
+    }
+
+    bool Realtime() const override {
+        return true;
+    }
+};
+
+// shared by the splitters without a clock of their own
+inline std::shared_ptr<SplitterClock> SteadyClockGet() {
+    static auto clock = std::make_shared<SteadyClock>();
+    return clock;
+}
@@ -0,0 +1,522 @@
+#include "SplitterEgress.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// frames per sendmsg, also taken from the client queue at a time
+constexpr size_t kMaxIov = 64;
+// frames referenced by zerocopy sends in flight, over it the connection
+// waits for completions
+constexpr size_t kMaxInflight = 1024;
+constexpr int kMaxEvents = 64;
+// set in the epoll data of the event fd of a connection, the socket has the
+// bare pointer and the wake fd of the worker 0
+constexpr uint64_t kEventFdTag = 1;
+
+// statistics have a single writer, the worker, and are read under its lock
+void Advance(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+size_t FrameBytes(const FrameBuffer& fb) {
+    return fb ? fb->size() : 0;
+}
+
+}
+
+// A socket and its splitter client, owned by one worker
+struct EgressConnection {
+    EgressConnection(ClientID id, int socket, int event_fd, bool zerocopy):
+      id_(id),
+      socket_(socket),
+      event_fd_(event_fd),
+      zerocopy_(zerocopy),
+      blocked_(false),
+      closed_(false),
+      offset_(0),
+      zerocopy_seq_(0),
+      bytes_(0),
+      frames_(0),
+      writes_(0),
+      blocked_count_(0),
+      zerocopy_copied_(0) {
+    }
+
+    ~EgressConnection() {
+        if (socket_ >= 0) {
+            close(socket_);
+        }
+        close(event_fd_);
+    }
+
+    const ClientID id_;
+    int socket_;  // -1 when left to the caller
+    const int event_fd_;
+    const bool zerocopy_;
+    // waits for the socket to take more, or for zerocopy completions. The
+    // event fd is not polled meanwhile, frames are left in the client queue.
+    bool blocked_;
+    bool closed_;
+    std::deque<FrameBuffer> pending_;  // taken from the client, the front one partly sent
+    size_t offset_;                    // bytes of the front frame sent
+    uint32_t zerocopy_seq_;            // MSG_ZEROCOPY sends so far, the kernel numbers them the same way
+    std::deque<std::pair<uint32_t, FrameBuffer>> inflight_;  // frames of zerocopy sends by send number
+
+    std::atomic<uint64_t> bytes_;
+    std::atomic<uint64_t> frames_;
+    std::atomic<uint64_t> writes_;
+    std::atomic<uint64_t> blocked_count_;
+    std::atomic<uint64_t> zerocopy_copied_;
+};
+
+static_assert(alignof(EgressConnection) > kEventFdTag);
+
+class EgressWorker {
+public:
+    EgressWorker(ISplitter& splitter):
+      splitter_(splitter),
+      epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+      wake_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      stop_(false) {
+        batch_.reserve(kMaxIov);
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = 0;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+        thread_ = std::thread([this]() {
+            Run();
+        });
+    }
+
+    ~EgressWorker() {
+        stop_ = true;
+        Wake();
+        thread_.join();
+        for (auto& [id, conn] : connections_) {
+            splitter_.ClientRemove(id);
+        }
+        connections_.clear();
+        close(wake_fd_);
+        close(epoll_fd_);
+    }
+
+    // takes the event fd, the socket is left to the caller on failure
+    bool Add(ClientID id, int socket, int event_fd, bool zerocopy) {
+        // owns the event fd from here on, whatever fails
+        auto conn = std::make_unique<EgressConnection>(id, socket, event_fd, zerocopy);
+        if ((epoll_fd_ < 0) || (wake_fd_ < 0)) {
+            conn->socket_ = -1;
+            return false;
+        }
+        std::unique_lock lck(mtx_);
+        // edge triggered: EPOLLOUT comes once the socket takes more after it
+        // was full, EPOLLERR once per batch of zerocopy completions
+        epoll_event event = {};
+        event.events = EPOLLOUT | EPOLLET;
+        event.data.u64 = reinterpret_cast<uintptr_t>(conn.get());
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket, &event) != 0) {
+            conn->socket_ = -1;
+            return false;
+        }
+        event.events = EPOLLIN;
+        event.data.u64 = reinterpret_cast<uintptr_t>(conn.get()) | kEventFdTag;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd, &event) != 0) {
+            // the worker may have the connection from the socket event
+            // already, it frees it after that batch and leaves the socket
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, socket, nullptr);
+            failed_.push_back(std::move(conn));
+            Wake();
+            failed_cv_.wait(lck, [this]() {
+                return failed_.empty();
+            });
+            return false;
+        }
+        connections_.emplace(id, std::move(conn));
+        return true;
+    }
+
+    // closes the connection of a removed client on the worker thread. A
+    // blocked connection doesn't poll its event fd, so it wouldn't see the
+    // removal itself.
+    bool Remove(ClientID id) {
+        std::lock_guard lck(mtx_);
+        if (!connections_.count(id)) {
+            return false;
+        }
+        removed_.push_back(id);
+        Wake();
+        return true;
+    }
+
+    size_t Count() const {
+        std::lock_guard lck(mtx_);
+        return connections_.size();
+    }
+
+    void StatsGet(std::vector<EgressStats>* stats) const {
+        std::lock_guard lck(mtx_);
+        for (auto& [id, conn] : connections_) {
+            auto& conn_stats = stats->emplace_back();
+            conn_stats.id = id;
+            conn_stats.bytes = conn->bytes_.load(std::memory_order_relaxed);
+            conn_stats.frames = conn->frames_.load(std::memory_order_relaxed);
+            conn_stats.writes = conn->writes_.load(std::memory_order_relaxed);
+            conn_stats.blocked = conn->blocked_count_.load(std::memory_order_relaxed);
+            conn_stats.zerocopy = conn->zerocopy_;
+            conn_stats.zerocopy_copied = conn->zerocopy_copied_.load(std::memory_order_relaxed);
+        }
+    }
+
+    std::chrono::nanoseconds CpuTime() const {
+        clockid_t clock;
+        timespec ts;
+        if ((pthread_getcpuclockid(const_cast<std::thread&>(thread_).native_handle(), &clock) != 0) ||
+                (clock_gettime(clock, &ts) != 0)) {
+            return {};
+        }
+        return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+    }
+
+private:
+    void Run() {
+        epoll_event events[kMaxEvents];
+        while (!stop_) {
+            int n = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+            for (int i = 0; i < n; ++i) {
+                auto data = events[i].data.u64;
+                auto conn = reinterpret_cast<EgressConnection*>(data & ~kEventFdTag);
+                if (!data) {
+                    uint64_t count;
+                    [[maybe_unused]] auto res = read(wake_fd_, &count, sizeof(count));
+                    continue;
+                }
+                if (conn->closed_) {
+                    continue;
+                }
+                if (!(data & kEventFdTag)) {
+                    if ((events[i].events & EPOLLERR) && conn->zerocopy_) {
+                        ReapCompletions(*conn);
+                    }
+                    if (events[i].events & EPOLLHUP) {
+                        Close(*conn);
+                        continue;
+                    }
+                    if (conn->blocked_ && (events[i].events & (EPOLLOUT | EPOLLERR))) {
+                        Block(*conn, false);
+                    }
+                }
+                Pump(*conn);
+            }
+
+            CloseRemoved();
+
+            // events of the batch may still point to closed connections
+            if (!closed_.empty()) {
+                std::lock_guard lck(mtx_);
+                for (auto id : closed_) {
+                    connections_.erase(id);
+                }
+                closed_.clear();
+            }
+            FreeFailed();
+        }
+        FreeFailed();
+    }
+
+    // connections Add couldn't finish, their sockets go back to Add
+    void FreeFailed() {
+        std::lock_guard lck(mtx_);
+        if (failed_.empty()) {
+            return;
+        }
+        for (auto& conn : failed_) {
+            conn->socket_ = -1;
+        }
+        failed_.clear();
+        failed_cv_.notify_all();
+    }
+
+    void CloseRemoved() {
+        std::vector<EgressConnection*> removed;
+        {
+            std::lock_guard lck(mtx_);
+            for (auto id : removed_) {
+                auto it = connections_.find(id);
+                if (it != connections_.end()) {
+                    removed.push_back(it->second.get());
+                }
+            }
+            removed_.clear();
+        }
+        for (auto conn : removed) {
+            if (!conn->closed_) {
+                Close(*conn);
+            }
+        }
+    }
+
+    void Wake() {
+        uint64_t one = 1;
+        [[maybe_unused]] auto res = write(wake_fd_, &one, sizeof(one));
+    }
+
+    // sends while the socket takes it, pulling more frames from the client
+    void Pump(EgressConnection& conn) {
+        while (!conn.closed_ && !conn.blocked_) {
+            if (conn.inflight_.size() >= kMaxInflight) {
+                Block(conn, true);
+                break;
+            }
+            if (conn.pending_.empty()) {
+                auto res = splitter_.GetBatch(conn.id_, batch_, kMaxIov, 0);
+                if (res == ISplitterError::TIMEOUT) {
+                    // the event fd is readable again with the next frame
+                    break;
+                } else if (res != ISplitterError::NO_ERROR) {
+                    Close(conn);
+                    break;
+                }
+                for (auto& fb : batch_) {
+                    conn.pending_.push_back(std::move(fb));
+                }
+            }
+            if (!Send(conn)) {
+                Close(conn);
+            }
+        }
+    }
+
+    // one sendmsg of up to kMaxIov pending frames, false on a socket error
+    bool Send(EgressConnection& conn) {
+        iovec iov[kMaxIov];
+        size_t count = 0;
+        size_t total = 0;
+        for (auto it = conn.pending_.begin(); (it != conn.pending_.end()) && (count < kMaxIov); ++it) {
+            auto skip = count ? 0 : conn.offset_;
+            iov[count].iov_base = *it ? (*it)->data() + skip : nullptr;
+            iov[count].iov_len = FrameBytes(*it) - skip;
+            total += iov[count].iov_len;
+            ++count;
+        }
+
+        ssize_t sent = 0;
+        bool zerocopy = false;
+        if (total) {
+            msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+            zerocopy = conn.zerocopy_;
+            sent = sendmsg(conn.socket_, &msg, MSG_NOSIGNAL | (zerocopy ? MSG_ZEROCOPY : 0));
+            if ((sent < 0) && zerocopy && (errno == ENOBUFS)) {
+                // out of optmem for pinned pages, this one is copied
+                zerocopy = false;
+                sent = sendmsg(conn.socket_, &msg, MSG_NOSIGNAL);
+            }
+            Advance(conn.writes_);
+            if (sent < 0) {
+                if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                    Advance(conn.blocked_count_);
+                    Block(conn, true);
+                    return true;
+                }
+                return errno == EINTR;
+            }
+            Advance(conn.bytes_, sent);
+        }
+
+        // frames sent whole leave pending, the kernel may still read the
+        // ones of a zerocopy send
+        auto seq = conn.zerocopy_seq_;
+        if (zerocopy) {
+            ++conn.zerocopy_seq_;
+        }
+        auto left = static_cast<size_t>(sent);
+        for (size_t i = 0; i < count; ++i) {
+            auto& fb = conn.pending_.front();
+            auto size = FrameBytes(fb) - conn.offset_;
+            if (zerocopy && left) {
+                conn.inflight_.emplace_back(seq, fb);
+            }
+            if (left < size) {
+                conn.offset_ += left;
+                break;
+            }
+            left -= size;
+            conn.offset_ = 0;
+            conn.pending_.pop_front();
+            Advance(conn.frames_);
+        }
+        if (static_cast<size_t>(sent) < total) {
+            Advance(conn.blocked_count_);
+            Block(conn, true);
+        }
+        return true;
+    }
+
+    // releases the frames of completed zerocopy sends. TCP completes sends
+    // in order, a notification covers the range ee_info..ee_data.
+    void ReapCompletions(EgressConnection& conn) {
+        while (true) {
+            char control[128];
+            msghdr msg = {};
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (recvmsg(conn.socket_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+                return;
+            }
+            for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (!((cmsg->cmsg_level == IPPROTO_IP) && (cmsg->cmsg_type == IP_RECVERR)) &&
+                        !((cmsg->cmsg_level == IPPROTO_IPV6) && (cmsg->cmsg_type == IPV6_RECVERR))) {
+                    continue;
+                }
+                sock_extended_err err;
+                memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+                if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                    continue;
+                }
+                if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                    Advance(conn.zerocopy_copied_, err.ee_data - err.ee_info + 1);
+                }
+                while (!conn.inflight_.empty() && (static_cast<int32_t>(conn.inflight_.front().first - err.ee_data) <= 0)) {
+                    conn.inflight_.pop_front();
+                }
+            }
+        }
+    }
+
+    void Block(EgressConnection& conn, bool blocked) {
+        conn.blocked_ = blocked;
+        epoll_event event = {};
+        event.events = blocked ? 0u : uint32_t(EPOLLIN);
+        event.data.u64 = reinterpret_cast<uintptr_t>(&conn) | kEventFdTag;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn.event_fd_, &event);
+    }
+
+    // the connection is freed after the current batch of events
+    void Close(EgressConnection& conn) {
+        conn.closed_ = true;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn.socket_, nullptr);
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn.event_fd_, nullptr);
+        // no-op when the client was removed already
+        splitter_.ClientRemove(conn.id_);
+        closed_.push_back(conn.id_);
+    }
+
+    ISplitter& splitter_;
+    const int epoll_fd_;
+    const int wake_fd_;  // makes the thread check stop_ and removed_
+    std::atomic<bool> stop_;
+    // connections_ is only changed with it held, the worker thread reads it
+    // without
+    mutable std::mutex mtx_;
+    std::unordered_map<ClientID, std::unique_ptr<EgressConnection>> connections_;
+    std::vector<ClientID> removed_;  // by SocketRemove, guarded by mtx_
+    // out of epoll but maybe in the current batch of events, guarded by mtx_
+    std::vector<std::unique_ptr<EgressConnection>> failed_;
+    std::condition_variable failed_cv_;
+    std::vector<ClientID> closed_;
+    std::vector<FrameBuffer> batch_;
+    std::thread thread_;
+};
+
+SplitterEgress::SplitterEgress(std::shared_ptr<ISplitter> splitter, const EgressOptions& options):
+  splitter_(std::move(splitter)),
+  options_(options),
+  next_worker_(0) {
+    for (size_t i = 0; i < std::max<size_t>(options_.threads, 1); ++i) {
+        workers_.push_back(std::make_unique<EgressWorker>(*splitter_));
+    }
+}
+
+SplitterEgress::~SplitterEgress() {
+}
+
+bool SplitterEgress::SocketAdd(int _nFd, ClientID* _punClientID) {
+    return SocketAdd(_nFd, _punClientID, ClientOptions());
+}
+
+bool SplitterEgress::SocketAdd(int _nFd, ClientID* _punClientID, const ClientOptions& _rOptions) {
+    auto options = _rOptions;
+    options.event_fd = true;
+    ClientID id;
+    if (!splitter_->ClientAdd(&id, options)) {
+        return false;
+    }
+    int event_fd = splitter_->ClientEventFdGet(id);
+    int flags = fcntl(_nFd, F_GETFL);
+    if ((event_fd < 0) || (flags < 0) || (fcntl(_nFd, F_SETFL, flags | O_NONBLOCK) < 0)) {
+        if (event_fd >= 0) {
+            close(event_fd);
+        }
+        splitter_->ClientRemove(id);
+        return false;
+    }
+
+    // fails on anything but TCP
+    int zerocopy_was = 0;
+    socklen_t len = sizeof(zerocopy_was);
+    int one = 1;
+    bool zerocopy = options_.zerocopy &&
+        (getsockopt(_nFd, SOL_SOCKET, SO_ZEROCOPY, &zerocopy_was, &len) == 0) &&
+        (setsockopt(_nFd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0);
+    auto& worker = *workers_[next_worker_++ % workers_.size()];
+    if (!worker.Add(id, _nFd, event_fd, zerocopy)) {
+        splitter_->ClientRemove(id);
+        // the socket goes back to the caller as it came
+        if (zerocopy) {
+            setsockopt(_nFd, SOL_SOCKET, SO_ZEROCOPY, &zerocopy_was, sizeof(zerocopy_was));
+        }
+        fcntl(_nFd, F_SETFL, flags);
+        return false;
+    }
+    *_punClientID = id;
+    return true;
+}
+
+bool SplitterEgress::SocketRemove(ClientID _unClientID) {
+    if (!splitter_->ClientRemove(_unClientID)) {
+        return false;
+    }
+    for (auto& worker : workers_) {
+        if (worker->Remove(_unClientID)) {
+            break;
+        }
+    }
+    return true;
+}
+
+bool SplitterEgress::SocketGetCount(size_t* _pnCount) const {
+    *_pnCount = 0;
+    for (auto& worker : workers_) {
+        *_pnCount += worker->Count();
+    }
+    return true;
+}
+
+bool SplitterEgress::StatsGet(std::vector<EgressStats>* _pvStats) const {
+    _pvStats->clear();
+    for (auto& worker : workers_) {
+        worker->StatsGet(_pvStats);
+    }
+    return true;
+}
+
+bool SplitterEgress::CpuTimeGet(std::chrono::nanoseconds* _pTime) const {
+    *_pTime = {};
+    for (auto& worker : workers_) {
+        *_pTime += worker->CpuTime();
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Splitter.h"
+
+// Sends the frames of a splitter to stream sockets (TCP, unix) from a few
+// worker threads. Every socket is a client of the splitter with an eventfd;
+// a worker polls the eventfds and sockets of its connections with epoll and
+// writes queued frames with non-blocking writev, many frames per syscall.
+// Frame bytes are sent as they are, framing is up to the producer.
+//
+// A socket that can't take more isn't pulled from, so its frames stay in the
+// client queue and the splitter drops them by the client's OverflowPolicy;
+// ISplitter::ClientsStatsGet counts them as usual. A frame is always sent
+// whole once its first byte went out.
+//
+// With zerocopy, TCP sockets that accept SO_ZEROCOPY are written with
+// sendmsg(MSG_ZEROCOPY): the kernel sends from the FrameBuffer itself and
+// the frame is referenced until the completion arrives on the error queue.
+// Worth it for large frames only; loopback and unix sockets copy anyway.
+
+struct EgressOptions {
+    size_t threads = 1;
+    bool zerocopy = false;
+};
+
+struct EgressStats {
+    ClientID id;
+    uint64_t bytes = 0;          // sent
+    uint64_t frames = 0;         // sent whole
+    uint64_t writes = 0;         // writev/sendmsg calls
+    uint64_t blocked = 0;        // writes the socket didn't take in full
+    bool zerocopy = false;       // MSG_ZEROCOPY is in use
+    uint64_t zerocopy_copied = 0;  // zerocopy sends the kernel copied after all
+};
+
+class SplitterEgress {
+public:
+    SplitterEgress(std::shared_ptr<ISplitter> splitter, const EgressOptions& options = EgressOptions());
+    ~SplitterEgress();
+
+    SplitterEgress(const SplitterEgress&) = delete;
+    SplitterEgress& operator=(const SplitterEgress&) = delete;
+
+    // Takes over a connected stream socket and makes it a client of the
+    // splitter. The socket is closed when the client is removed, the peer
+    // goes away or sending fails.
+    bool SocketAdd(int _nFd, ClientID* _punClientID);
+    bool SocketAdd(int _nFd, ClientID* _punClientID, const ClientOptions& _rOptions);
+    // same as ISplitter::ClientRemove
+    bool SocketRemove(ClientID _unClientID);
+
+    bool SocketGetCount(size_t* _pnCount) const;
+    bool StatsGet(std::vector<EgressStats>* _pvStats) const;
+    // CPU time used by the worker threads
+    bool CpuTimeGet(std::chrono::nanoseconds* _pTime) const;
+
+private:
+    const std::shared_ptr<ISplitter> splitter_;
+    const EgressOptions options_;
+    std::vector<std::unique_ptr<class EgressWorker>> workers_;
+    std::atomic<size_t> next_worker_;
+};
+
+inline std::shared_ptr<SplitterEgress> SplitterEgressCreate(std::shared_ptr<ISplitter> _pSplitter,
+        const EgressOptions& _rOptions = EgressOptions()) {
+    return std::make_shared<SplitterEgress>(std::move(_pSplitter), _rOptions);
+}
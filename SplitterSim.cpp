@@ -0,0 +1,255 @@
+#include "SplitterSim.h"
+
+#include <algorithm>
+#include <cassert>
+#include <latch>
+
+namespace {
+
+// clock the thread is attached to
+thread_local const SimClock* attached_clock = nullptr;
+
+}
+
+struct SimClock::Waiter {
+    Waiter(const std::condition_variable* wait_cv, time_point wait_deadline, bool wait_attached):
+      cv(wait_cv),
+      deadline(wait_deadline),
+      attached(wait_attached) {
+    }
+
+    const std::condition_variable* cv;  // nullptr for SleepUntil
+    time_point deadline;
+    bool attached;
+    bool woken = false;
+    bool timed_out = false;
+    bool released = false;  // may go on, an attached thread when its turn comes
+    std::condition_variable wake;
+};
+
+SimClock::SimClock(time_point start):
+  now_(start),
+  held_(false),
+  running_(0) {
+}
+
+SimClock::time_point SimClock::Now() {
+    std::lock_guard lck(mtx_);
+    return now_;
+}
+
+bool SimClock::WaitUntil(std::condition_variable& cv, std::unique_lock<std::mutex>& lck, time_point deadline) {
+    Waiter waiter(&cv, deadline, attached_clock == this);
+    return Block(waiter, &lck);
+}
+
+void SimClock::Wait(std::condition_variable& cv, std::unique_lock<std::mutex>& lck) {
+    Waiter waiter(&cv, time_point::max(), attached_clock == this);
+    Block(waiter, &lck);
+}
+
+void SimClock::NotifyAll(std::condition_variable& cv) {
+    std::lock_guard lck(mtx_);
+    for (auto waiter : waiters_) {
+        if (!waiter->woken && (waiter->cv == &cv)) {
+            Wake(*waiter, false);
+        }
+    }
+}
+
+bool SimClock::Realtime() const {
+    return false;
+}
+
+void SimClock::Attach() {
+    assert(!attached_clock);
+    std::lock_guard lck(mtx_);
+    attached_clock = this;
+    ++running_;
+}
+
+void SimClock::Detach() {
+    std::lock_guard lck(mtx_);
+    attached_clock = nullptr;
+    if (--running_ == 0) {
+        idle_cv_.notify_all();
+    }
+}
+
+void SimClock::AdvanceTo(time_point _tTime) {
+    std::lock_guard lck(mtx_);
+    now_ = std::max(now_, _tTime);
+    for (auto waiter : waiters_) {
+        if (!waiter->woken && (waiter->deadline <= now_)) {
+            Wake(*waiter, true);
+        }
+    }
+}
+
+SimClock::time_point SimClock::NextDeadline() const {
+    std::lock_guard lck(mtx_);
+    auto next = time_point::max();
+    for (auto waiter : waiters_) {
+        if (!waiter->woken) {
+            next = std::min(next, waiter->deadline);
+        }
+    }
+    return next;
+}
+
+void SimClock::Hold(bool _bHold) {
+    std::lock_guard lck(mtx_);
+    held_ = _bHold;
+    if (!held_) {
+        for (auto waiter : woken_) {
+            Release(*waiter);
+        }
+        woken_.clear();
+    }
+}
+
+void SimClock::WaitIdle() {
+    std::unique_lock lck(mtx_);
+    while (true) {
+        idle_cv_.wait(lck, [this]() {
+            return running_ == 0;
+        });
+        if (woken_.empty()) {
+            return;
+        }
+        // the woken threads go on one at a time, in the order woken
+        auto waiter = woken_.front();
+        woken_.pop_front();
+        Release(*waiter);
+    }
+}
+
+void SimClock::SleepUntil(time_point _tTime) {
+    Waiter waiter(nullptr, _tTime, attached_clock == this);
+    Block(waiter, nullptr);
+}
+
+bool SimClock::Block(Waiter& waiter, std::unique_lock<std::mutex>* lck) {
+    // registered before lck is let go: a notify after that finds the waiter
+    std::unique_lock sim_lck(mtx_);
+    if (now_ >= waiter.deadline) {
+        return false;
+    }
+    waiters_.push_back(&waiter);
+    if (waiter.attached && (--running_ == 0)) {
+        idle_cv_.notify_all();
+    }
+    if (lck) {
+        lck->unlock();
+    }
+    waiter.wake.wait(sim_lck, [&waiter]() {
+        return waiter.released;
+    });
+    std::erase(waiters_, &waiter);
+    sim_lck.unlock();
+    if (lck) {
+        lck->lock();
+    }
+    return !waiter.timed_out;
+}
+
+void SimClock::Wake(Waiter& waiter, bool timed_out) {
+    waiter.woken = true;
+    waiter.timed_out = timed_out;
+    if (waiter.attached && held_) {
+        woken_.push_back(&waiter);
+    } else {
+        Release(waiter);
+    }
+}
+
+void SimClock::Release(Waiter& waiter) {
+    waiter.released = true;
+    if (waiter.attached) {
+        ++running_;
+    }
+    waiter.wake.notify_one();
+}
+
+SimRun::SimRun(std::shared_ptr<SimClock> clock):
+  clock_(std::move(clock)),
+  events_added_(0),
+  threads_done_(0) {
+}
+
+SimRun::~SimRun() {
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+SimClock& SimRun::Clock() {
+    return *clock_;
+}
+
+void SimRun::At(time_point _tTime, std::function<void()> _fEvent) {
+    std::lock_guard lck(events_mtx_);
+    events_.push({_tTime, events_added_++, std::move(_fEvent)});
+}
+
+void SimRun::Thread(std::function<void()> _fRun) {
+    pending_.push_back(std::move(_fRun));
+}
+
+bool SimRun::Run() {
+    return RunUntil(time_point::max());
+}
+
+bool SimRun::RunUntil(time_point _tEnd) {
+    clock_->Hold(true);
+    StartThreads();
+    while (true) {
+        clock_->WaitIdle();
+        auto now = clock_->Now();
+        auto next = time_point::max();
+        std::function<void()> event;
+        {
+            std::lock_guard lck(events_mtx_);
+            if (!events_.empty() && (events_.top().time <= now)) {
+                event = std::move(const_cast<Event&>(events_.top()).run);
+                events_.pop();
+            } else if (!events_.empty()) {
+                next = events_.top().time;
+            }
+        }
+        if (event) {
+            event();
+            continue;
+        }
+
+        next = std::min(next, clock_->NextDeadline());
+        if (next > _tEnd) {
+            clock_->AdvanceTo(_tEnd);
+            clock_->WaitIdle();
+            clock_->Hold(false);
+            return true;
+        }
+        if (next == time_point::max()) {
+            clock_->Hold(false);
+            return threads_done_ == threads_.size();
+        }
+        clock_->AdvanceTo(next);
+    }
+}
+
+void SimRun::StartThreads() {
+    // one at a time, each runs until it first blocks
+    for (auto& run : pending_) {
+        std::latch attached(1);
+        threads_.emplace_back([this, &attached, run = std::move(run)]() {
+            clock_->Attach();
+            attached.count_down();
+            run();
+            ++threads_done_;
+            clock_->Detach();
+        });
+        attached.wait();
+        clock_->WaitIdle();
+    }
+    pending_.clear();
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "SplitterClock.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Simulated time for splitters, set as SplitterOptions::clock. Time stands
+// still until AdvanceTo, so timeouts and deadlines take no real time and
+// don't depend on how loaded the host is. SimRun plays a script against it.
+//
+// The clock knows the threads attached to it (the SimRun threads and the
+// background_delivery thread of a splitter) and which of them are blocked in
+// a wait. While the clock is held, by SimRun::Run, an attached thread that
+// is woken goes on only when WaitIdle lets it, one thread at a time;
+// WaitIdle returns once every attached thread is blocked again, that is when
+// time may move on.
+class SimClock final : public SplitterClock {
+public:
+    explicit SimClock(time_point start = time_point());
+
+    time_point Now() override;
+    bool WaitUntil(std::condition_variable& cv, std::unique_lock<std::mutex>& lck, time_point deadline) override;
+    void Wait(std::condition_variable& cv, std::unique_lock<std::mutex>& lck) override;
+    // wakes the waits on cv, cv itself is never waited on
+    void NotifyAll(std::condition_variable& cv) override;
+    bool Realtime() const override;
+    // the calling thread takes part in WaitIdle, until Detach
+    void Attach() override;
+    void Detach() override;
+
+    // moves the time forward, the waits due time out
+    void AdvanceTo(time_point _tTime);
+    // earliest deadline of a wait not woken yet, time_point::max() for none
+    time_point NextDeadline() const;
+    // while held the woken attached threads wait for WaitIdle, otherwise they
+    // go on right away
+    void Hold(bool _bHold);
+    // lets the woken attached threads run one after the other, returns when
+    // every attached thread waits on the clock
+    void WaitIdle();
+    // a wait for the time alone, of a scripted producer say
+    void SleepUntil(time_point _tTime);
+
+private:
+    struct Waiter;
+
+    // blocks the caller until woken, with lck released meanwhile. false when
+    // it timed out.
+    bool Block(Waiter& waiter, std::unique_lock<std::mutex>* lck);
+    // called with mtx_ held
+    void Wake(Waiter& waiter, bool timed_out);
+    void Release(Waiter& waiter);
+
+    mutable std::mutex mtx_;
+    std::condition_variable idle_cv_;
+    time_point now_;
+    bool held_;
+    std::vector<Waiter*> waiters_;  // blocked in a wait, until they return
+    std::deque<Waiter*> woken_;     // attached, woken and waiting for their turn
+    size_t running_;                // attached threads not blocked
+};
+
+// Plays a timeline against a simulated clock: events run on the thread that
+// calls Run, in time order, and threads run in between until they block on
+// the clock. Only one of them runs at a time, so a run is deterministic.
+//
+// A producer that Puts with timeouts is a Thread. Consumers are best events
+// that TryGet and schedule their next poll: an event must not wait on the
+// clock, nobody would move it on. Threads other than these that block on
+// the clock, a Get of the test itself say, run whenever they're woken.
+class SimRun {
+public:
+    using time_point = SplitterClock::time_point;
+
+    explicit SimRun(std::shared_ptr<SimClock> clock);
+    // joins the threads, they must have returned or be about to
+    ~SimRun();
+
+    SimRun(const SimRun&) = delete;
+    SimRun& operator=(const SimRun&) = delete;
+
+    SimClock& Clock();
+    // events of the same time run in the order they were added, may be
+    // called by events and threads
+    void At(time_point _tTime, std::function<void()> _fEvent);
+    // runs the function on a thread of its own, started by Run in the order
+    // added
+    void Thread(std::function<void()> _fRun);
+
+    // plays the timeline until the events are done and the threads have
+    // returned. false when the threads wait with no deadline and no event
+    // left to wake them.
+    bool Run();
+    // same up to _tEnd, the clock is left at _tEnd
+    bool RunUntil(time_point _tEnd);
+
+private:
+    struct Event {
+        time_point time;
+        uint64_t order;
+        std::function<void()> run;
+
+        bool operator>(const Event& other) const {
+            return (time != other.time) ? (time > other.time) : (order > other.order);
+        }
+    };
+
+    void StartThreads();
+
+    std::shared_ptr<SimClock> clock_;
+    std::mutex events_mtx_;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;
+    uint64_t events_added_;
+    std::vector<std::function<void()>> pending_;  // threads not started yet
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> threads_done_;
+};
+
+inline std::shared_ptr<SimClock> SimClockCreate() {
+    return std::make_shared<SimClock>();
+}
@@ -0,0 +1,201 @@
+#include <gtest/gtest.h>
+
+#include "Splitter.h"
+#include "SplitterSim.h"
+#include "TestFrames.h"
+
+using namespace std::chrono_literals;
+
+static SplitterOptions SimOptions(const std::shared_ptr<SimClock>& clock) {
+    SplitterOptions options;
+    options.clock = clock;
+    return options;
+}
+
+TEST(PutTimeout, Sim) {
+    auto clock = SimClockCreate();
+    ISplitter s(1, 1, SimOptions(clock));
+    ClientID id;
+    ASSERT_TRUE(s.ClientAdd(&id));
+
+    SimRun run(clock);
+    SimRun::time_point timed_out;
+    run.Thread([&]() {
+        EXPECT_EQ(s.Put(MakeFrame(0), 1000), ISplitterError::NO_ERROR);
+        EXPECT_EQ(s.Put(MakeFrame(1), 1000), ISplitterError::TIMEOUT);
+        timed_out = clock->Now();
+    });
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(run.Run());
+    EXPECT_EQ(timed_out, SimRun::time_point(1s));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 500ms);
+}
+
+TEST(GetTimeoutAndWake, Sim) {
+    auto clock = SimClockCreate();
+    ISplitter s(4, 1, SimOptions(clock));
+    ClientID id;
+    ASSERT_TRUE(s.ClientAdd(&id));
+
+    SimRun run(clock);
+    std::vector<SimRun::time_point> got;
+    run.Thread([&]() {
+        FrameBuffer fb;
+        EXPECT_EQ(s.Get(id, fb, 5000), ISplitterError::NO_ERROR);
+        got.push_back(clock->Now());
+        EXPECT_EQ(s.Get(id, fb, 5000), ISplitterError::TIMEOUT);
+        got.push_back(clock->Now());
+        EXPECT_EQ(s.Get(id, fb, 5000), ISplitterError::EOS);
+        got.push_back(clock->Now());
+    });
+    run.At(SimRun::time_point(3s), [&]() {
+        s.Put(MakeFrame(0), 0);
+    });
+    run.At(SimRun::time_point(10s), [&]() {
+        s.ClientRemove(id);
+    });
+    EXPECT_TRUE(run.Run());
+    EXPECT_EQ(got, (std::vector<SimRun::time_point>{SimRun::time_point(3s), SimRun::time_point(8s),
+        SimRun::time_point(10s)}));
+}
+
+TEST(StuckThreads, Sim) {
+    auto clock = SimClockCreate();
+    ClientOptions block;
+    block.overflow = OverflowPolicy::BLOCK;
+    ISplitter s(1, 1, SimOptions(clock));
+    ClientID id;
+    ASSERT_TRUE(s.ClientAdd(&id, block));
+
+    SimRun run(clock);
+    run.Thread([&]() {
+        s.Put(MakeFrame(0), 0);
+        EXPECT_EQ(s.Put(MakeFrame(1), 0), ISplitterError::CLOSED);
+    });
+    // nothing wakes the BLOCK client's Put
+    EXPECT_FALSE(run.Run());
+    s.Close();
+}
+
+TEST(BackgroundDeliveryDeadline, Sim) {
+    auto clock = SimClockCreate();
+    auto options = SimOptions(clock);
+    options.background_delivery = true;
+    ISplitter s(1, 1, options);
+    ClientID id;
+    ASSERT_TRUE(s.ClientAdd(&id));
+    s.Put(MakeFrame(0), 0);
+
+    // the full client gets the frame at its deadline, 50ms on
+    EXPECT_EQ(s.Put(MakeFrame(1), 50), ISplitterError::NO_ERROR);
+    SimRun run(clock);
+    std::vector<ClientStats> stats;
+    EXPECT_TRUE(run.RunUntil(SimRun::time_point(49ms)));
+    s.ClientsStatsGet(&stats);
+    EXPECT_EQ(stats[0].dropped, 0u);
+    EXPECT_TRUE(run.RunUntil(SimRun::time_point(50ms)));
+    s.ClientsStatsGet(&stats);
+    EXPECT_EQ(stats[0].dropped, 1u);
+
+    std::vector<ClientID> timed_out;
+    run.At(SimRun::time_point(60ms), [&]() {
+        EXPECT_EQ(s.Put(MakeFrame(2), 10, &timed_out), ISplitterError::TIMEOUT);
+    });
+    // frame 2 is forced in at 70ms in turn
+    EXPECT_TRUE(run.Run());
+    EXPECT_EQ(clock->Now(), SimRun::time_point(70ms));
+    EXPECT_EQ(timed_out, std::vector<ClientID>{id});
+    FrameBuffer fb;
+    EXPECT_EQ(s.TryGet(id, fb), ISplitterError::NO_ERROR);
+    EXPECT_EQ(fb->front(), 2);
+}
+
+struct SlowClientsResult {
+    uint64_t timeouts = 0;
+    std::vector<ClientStats> stats;
+    std::vector<int64_t> max_latency_ms;
+
+    bool operator==(const SlowClientsResult& other) const {
+        if ((timeouts != other.timeouts) || (max_latency_ms != other.max_latency_ms) ||
+                (stats.size() != other.stats.size())) {
+            return false;
+        }
+        for (size_t i = 0; i < stats.size(); ++i) {
+            if ((stats[i].delivered != other.stats[i].delivered) || (stats[i].dropped != other.stats[i].dropped)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// a 30fps producer and clients that poll in turn with the periods given;
+// each poll takes what is queued
+static SlowClientsResult SlowClients(size_t clients, std::chrono::seconds length,
+        const std::vector<std::chrono::milliseconds>& periods) {
+    auto clock = SimClockCreate();
+    ISplitter s(8, clients, SimOptions(clock));
+    std::vector<ClientID> ids(clients);
+    for (auto& id : ids) {
+        s.ClientAdd(&id);
+    }
+
+    SlowClientsResult res;
+    res.max_latency_ms.resize(clients);
+    SimRun run(clock);
+    auto end = SimRun::time_point(length);
+    run.Thread([&]() {
+        for (auto next = SimRun::time_point(); next < end; next += 33ms) {
+            clock->SleepUntil(next);
+            // the payload is the time put
+            auto fb = std::make_shared<std::vector<uint8_t>>(sizeof(int64_t));
+            auto stamp = next.time_since_epoch().count();
+            memcpy(fb->data(), &stamp, sizeof(stamp));
+            if (s.Put(fb, 5) == ISplitterError::TIMEOUT) {
+                ++res.timeouts;
+            }
+        }
+    });
+    std::vector<std::function<void()>> polls(clients);
+    for (size_t i = 0; i < clients; ++i) {
+        polls[i] = [&, i]() {
+            std::vector<FrameBuffer> frames;
+            s.GetBatch(ids[i], frames, 8, 0);
+            auto now = clock->Now().time_since_epoch().count();
+            for (auto& fb : frames) {
+                int64_t stamp;
+                memcpy(&stamp, fb->data(), sizeof(stamp));
+                res.max_latency_ms[i] = std::max(res.max_latency_ms[i], (now - stamp) / 1000000);
+            }
+            if (clock->Now() < end) {
+                run.At(clock->Now() + periods[i % periods.size()], polls[i]);
+            }
+        };
+        run.At(SimRun::time_point(std::chrono::milliseconds(i % 5)), polls[i]);
+    }
+    EXPECT_TRUE(run.Run());
+    s.ClientsStatsGet(&res.stats);
+    return res;
+}
+
+TEST(SlowClientsDeterministic, Sim) {
+    auto first = SlowClients(30, 20s, {5ms, 50ms, 1000ms});
+    auto second = SlowClients(30, 20s, {5ms, 50ms, 1000ms});
+    EXPECT_TRUE(first == second);
+
+    uint64_t frames = (20000 + 32) / 33;
+    for (size_t i = 0; i < first.stats.size(); ++i) {
+        auto& stats = first.stats[i];
+        EXPECT_EQ(stats.delivered + stats.dropped + stats.latency, frames);
+        if (i % 3 == 2) {
+            // 30 frames a second into 8 buffers
+            EXPECT_GT(stats.dropped, frames / 2);
+            EXPECT_LE(first.max_latency_ms[i], 1000 + 5);
+        } else {
+            EXPECT_EQ(stats.dropped, 0u);
+            EXPECT_LE(first.max_latency_ms[i], (i % 3) ? 50 : 5);
+        }
+    }
+    // the 1s clients are full most of the time, a Put waits its 5ms for them
+    EXPECT_GT(first.timeouts, frames / 2);
+}
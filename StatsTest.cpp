@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include "Splitter.h"
+#include <thread>
+
+TEST(Snapshot, Stats) {
+    for (auto engine : {SplitterEngine::QUEUE, SplitterEngine::RING}) {
+        SplitterOptions options;
+        options.engine = engine;
+        ISplitter s(2, 2, options);
+
+        ClientID client1;
+        ClientID client2;
+        EXPECT_TRUE(s.ClientAdd(&client1));
+        EXPECT_TRUE(s.ClientAdd(&client2));
+
+        for (int i = 0; i < 3; ++i) {
+            s.Put(std::make_shared<std::vector<uint8_t>>(100), 0);
+        }
+        FrameBuffer fb;
+        EXPECT_EQ(s.Get(client1, fb, 0), ISplitterError::NO_ERROR);
+
+        std::vector<ClientStats> stats;
+        EXPECT_TRUE(s.ClientsStatsGet(&stats));
+        ASSERT_EQ(stats.size(), 2);
+        EXPECT_EQ(stats[0].id, client1);
+        EXPECT_EQ(stats[0].latency, 1);
+        EXPECT_EQ(stats[0].dropped, 1);
+        EXPECT_EQ(stats[0].delivered, 1);
+        EXPECT_EQ(stats[1].id, client2);
+        EXPECT_EQ(stats[1].latency, 2);
+        EXPECT_EQ(stats[1].dropped, 1);
+        EXPECT_EQ(stats[1].delivered, 0);
+    }
+}
+
+TEST(PollWhileStreaming, Stats) {
+    int num_bufs = 1000;
+    ISplitter s(4, 2);
+
+    ClientID client1;
+    EXPECT_TRUE(s.ClientAdd(&client1));
+
+    std::atomic_bool done(false);
+    std::thread monitor_thread([&]() {
+        std::vector<ClientStats> stats;
+        while (!done) {
+            EXPECT_TRUE(s.ClientsStatsGet(&stats));
+            ASSERT_EQ(stats.size(), 1);
+            EXPECT_LE(stats[0].latency, 4);
+        }
+    });
+
+    std::thread pop_thread([&]() {
+        FrameBuffer fb;
+        for (int i = 0; i < num_bufs; ++i) {
+            EXPECT_EQ(s.Get(client1, fb, 1000), ISplitterError::NO_ERROR);
+        }
+    });
+
+    auto fb = std::make_shared<std::vector<uint8_t>>(100);
+    for (int i = 0; i < num_bufs; ++i) {
+        EXPECT_EQ(s.Put(fb, 1000), ISplitterError::NO_ERROR);
+    }
+    pop_thread.join();
+    done = true;
+    monitor_thread.join();
+
+    std::vector<ClientStats> stats;
+    EXPECT_TRUE(s.ClientsStatsGet(&stats));
+    EXPECT_EQ(stats[0].delivered, num_bufs);
+    EXPECT_EQ(stats[0].dropped, 0);
+}
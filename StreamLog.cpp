@@ -0,0 +1,392 @@
+#include "StreamLog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint32_t kRecordMagic = 0x4c524543;  // "LREC"
+
+// in front of every frame of a segment file, records are 8 byte aligned and
+// a segment ends at the first record without the magic
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t size;
+    uint64_t seq;
+    int64_t stamp;
+};
+
+size_t RecordBytes(size_t size) {
+    return (sizeof(RecordHeader) + size + 7) & ~size_t(7);
+}
+
+std::string SegmentPath(const std::string& dir, uint64_t first) {
+    char name[64];
+    snprintf(name, sizeof(name), "/segment-%020" PRIu64 ".log", first);
+    return dir + name;
+}
+
+}
+
+struct StreamLog::Segment {
+    std::string path;
+    int fd = -1;
+    size_t capacity = 0;   // file size
+    uint64_t first = 0;    // sequence number of the first frame
+    // guarded by StreamLog::mtx_
+    size_t used = 0;       // bytes of published records
+    std::vector<std::pair<int64_t, size_t>> index;  // stamp and offset of every frame
+
+    ~Segment() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+};
+
+StreamLog::StreamLog(const std::string& dir, const StreamLogOptions& options):
+  dir_(dir),
+  options_(options),
+  valid_(false),
+  end_(0),
+  bytes_(0),
+  skipped_(0),
+  active_map_(nullptr) {
+    if ((mkdir(dir_.c_str(), 0755) < 0) && (errno != EEXIST)) {
+        return;
+    }
+    auto dp = opendir(dir_.c_str());
+    if (!dp) {
+        return;
+    }
+    std::vector<std::string> names;
+    while (auto entry = readdir(dp)) {
+        std::string name = entry->d_name;
+        if (name.starts_with("segment-") && name.ends_with(".log")) {
+            names.push_back(name);
+        }
+    }
+    closedir(dp);
+    // zero padded, so by name is by sequence number
+    std::sort(names.begin(), names.end());
+    for (auto& name : names) {
+        Load(dir_ + "/" + name);
+    }
+    valid_ = options_.segment_bytes && options_.max_segments;
+}
+
+StreamLog::~StreamLog() {
+    if (active_map_) {
+        munmap(active_map_, active_->capacity);
+    }
+}
+
+bool StreamLog::Valid() const {
+    return valid_;
+}
+
+int64_t StreamLog::Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool StreamLog::Load(const std::string& path) {
+    auto segment = std::make_shared<Segment>();
+    segment->path = path;
+    segment->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if ((segment->fd < 0) || (fstat(segment->fd, &st) < 0) || (size_t(st.st_size) < sizeof(RecordHeader))) {
+        unlink(path.c_str());
+        return false;
+    }
+    segment->capacity = static_cast<size_t>(st.st_size);
+    auto map = static_cast<const uint8_t*>(mmap(nullptr, segment->capacity, PROT_READ, MAP_SHARED, segment->fd, 0));
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    RecordHeader header;
+    while (segment->used + sizeof(header) <= segment->capacity) {
+        memcpy(&header, map + segment->used, sizeof(header));
+        if (segment->index.empty()) {
+            segment->first = header.seq;
+        }
+        // a record cut short by a crash ends the segment
+        if ((header.magic != kRecordMagic) || (header.seq != segment->first + segment->index.size()) ||
+                (RecordBytes(header.size) > segment->capacity - segment->used)) {
+            break;
+        }
+        segment->index.emplace_back(header.stamp, segment->used);
+        segment->used += RecordBytes(header.size);
+        bytes_ += header.size;
+    }
+    munmap(const_cast<uint8_t*>(map), segment->capacity);
+    if (segment->index.empty()) {
+        unlink(path.c_str());
+        return false;
+    }
+    // the frames must follow each other, a segment not continuing the ones
+    // before it starts the log over
+    if (!segments_.empty() && (segment->first != end_)) {
+        for (auto& old : segments_) {
+            unlink(old->path.c_str());
+        }
+        segments_.clear();
+    }
+    end_ = segment->first + segment->index.size();
+    segments_.push_back(std::move(segment));
+    return true;
+}
+
+bool StreamLog::Roll() {
+    auto segment = std::make_shared<Segment>();
+    segment->path = SegmentPath(dir_, end_);
+    segment->capacity = options_.segment_bytes;
+    segment->first = end_;
+    segment->fd = open(segment->path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    // blocks are reserved rather than left sparse: a full disk fails here
+    // instead of faulting the copy into the mapping under the push lock
+    if ((segment->fd < 0) || (posix_fallocate(segment->fd, 0, static_cast<off_t>(segment->capacity)) != 0)) {
+        unlink(segment->path.c_str());
+        return false;
+    }
+    auto map = mmap(nullptr, segment->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+    if (map == MAP_FAILED) {
+        unlink(segment->path.c_str());
+        return false;
+    }
+
+    if (active_map_) {
+        // start writing back the full segment now, so its pages are clean
+        // and can be dropped from the page cache at the next roll
+        sync_file_range(active_->fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+        munmap(active_map_, active_->capacity);
+    }
+    std::lock_guard lck(mtx_);
+    if (segments_.size() >= 2) {
+        auto& old = segments_[segments_.size() - 2];
+        posix_fadvise(old->fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    active_ = segment;
+    active_map_ = static_cast<uint8_t*>(map);
+    segments_.push_back(std::move(segment));
+    // a reader keeps a segment let go of open and mapped until it is done
+    while (segments_.size() > options_.max_segments) {
+        unlink(segments_.front()->path.c_str());
+        segments_.pop_front();
+    }
+    return true;
+}
+
+bool StreamLog::Append(const FrameBuffer& _pVecPut) {
+    size_t size = _pVecPut ? _pVecPut->size() : 0;
+    auto bytes = RecordBytes(size);
+    if ((size > UINT32_MAX) || (bytes > options_.segment_bytes) ||
+            ((!active_ || (active_->used + bytes > active_->capacity)) && !Roll())) {
+        std::lock_guard lck(mtx_);
+        ++skipped_;
+        return false;
+    }
+
+    // past the published records, readers don't look there
+    auto offset = active_->used;
+    RecordHeader header = {kRecordMagic, static_cast<uint32_t>(size), end_, Now()};
+    memcpy(active_map_ + offset, &header, sizeof(header));
+    if (size) {
+        memcpy(active_map_ + offset + sizeof(header), _pVecPut->data(), size);
+    }
+
+    std::lock_guard lck(mtx_);
+    active_->index.emplace_back(header.stamp, offset);
+    active_->used += bytes;
+    ++end_;
+    bytes_ += size;
+    return true;
+}
+
+uint64_t StreamLog::Begin() const {
+    std::lock_guard lck(mtx_);
+    return segments_.empty() ? end_ : segments_.front()->first;
+}
+
+uint64_t StreamLog::End() const {
+    std::lock_guard lck(mtx_);
+    return end_;
+}
+
+uint64_t StreamLog::Find(int64_t _nStamp) const {
+    std::lock_guard lck(mtx_);
+    for (auto& segment : segments_) {
+        if (segment->index.empty() || (segment->index.back().first < _nStamp)) {
+            continue;
+        }
+        auto it = std::lower_bound(segment->index.begin(), segment->index.end(), _nStamp,
+            [](const auto& entry, int64_t stamp) {
+                return entry.first < stamp;
+            });
+        return segment->first + static_cast<uint64_t>(it - segment->index.begin());
+    }
+    return end_;
+}
+
+bool StreamLog::StatsGet(StreamLogStats* _pStats) const {
+    std::lock_guard lck(mtx_);
+    _pStats->begin = segments_.empty() ? end_ : segments_.front()->first;
+    _pStats->end = end_;
+    _pStats->segments = segments_.size();
+    _pStats->bytes = bytes_;
+    _pStats->skipped = skipped_;
+    return true;
+}
+
+bool StreamLog::Locate(uint64_t _unSeq, std::shared_ptr<Segment>* _pSegment, size_t* _pzOffset,
+        int64_t* _pnStamp) const {
+    std::lock_guard lck(mtx_);
+    if (segments_.empty() || (_unSeq < segments_.front()->first) || (_unSeq >= end_)) {
+        return false;
+    }
+    // last segment starting at or before _unSeq
+    auto it = std::upper_bound(segments_.begin(), segments_.end(), _unSeq,
+        [](uint64_t seq, const auto& segment) {
+            return seq < segment->first;
+        });
+    auto& segment = *std::prev(it);
+    auto& entry = segment->index[_unSeq - segment->first];
+    *_pSegment = segment;
+    *_pnStamp = entry.first;
+    *_pzOffset = entry.second;
+    return true;
+}
+
+StreamLogReader::StreamLogReader(std::shared_ptr<ISplitter> splitter, const ClientOptions& options):
+  splitter_(std::move(splitter)),
+  log_(splitter_->LogGet()),
+  options_(options),
+  next_seq_(log_ ? log_->End() : 0),
+  skipped_(0),
+  live_(false),
+  client_(0),
+  map_(nullptr) {
+}
+
+StreamLogReader::~StreamLogReader() {
+    Leave();
+    Unmap();
+}
+
+bool StreamLogReader::Seek(uint64_t _unSeq) {
+    if (!log_ || (_unSeq < log_->Begin()) || (_unSeq > log_->End())) {
+        return false;
+    }
+    Leave();
+    next_seq_ = _unSeq;
+    return true;
+}
+
+bool StreamLogReader::SeekTime(int64_t _nStamp) {
+    if (!log_) {
+        return false;
+    }
+    Leave();
+    next_seq_ = log_->Find(_nStamp);
+    return true;
+}
+
+void StreamLogReader::Leave() {
+    if (live_) {
+        splitter_->ClientRemove(client_);
+        live_frame_.reset();
+        live_ = false;
+    }
+}
+
+ISplitterError StreamLogReader::Get(LogFrame* _pFrame, int32_t _nTimeOutMsec) {
+    if (!log_) {
+        return ISplitterError::UNKNOWN_CLIENT;
+    }
+    while (!live_) {
+        std::shared_ptr<StreamLog::Segment> segment;
+        size_t offset;
+        int64_t stamp;
+        if (log_->Locate(next_seq_, &segment, &offset, &stamp)) {
+            if ((segment != segment_) && !Map(segment)) {
+                return ISplitterError::UNKNOWN_CLIENT;
+            }
+            RecordHeader header;
+            memcpy(&header, map_ + offset, sizeof(header));
+            _pFrame->data = map_ + offset + sizeof(header);
+            _pFrame->size = header.size;
+            _pFrame->seq = next_seq_++;
+            _pFrame->stamp = stamp;
+            _pFrame->live = false;
+            return ISplitterError::NO_ERROR;
+        }
+        auto begin = log_->Begin();
+        if (next_seq_ < begin) {
+            skipped_ += begin - next_seq_;
+            next_seq_ = begin;
+            continue;
+        }
+        // caught up: join unless a Put got in since
+        if (splitter_->ClientAddAt(next_seq_, &client_, options_)) {
+            live_ = true;
+            Unmap();
+        } else if (log_->End() == next_seq_) {
+            return ISplitterError::UNKNOWN_CLIENT;
+        }
+    }
+
+    auto res = splitter_->Get(client_, live_frame_, _nTimeOutMsec);
+    if (res == ISplitterError::NO_ERROR) {
+        _pFrame->data = live_frame_ ? live_frame_->data() : nullptr;
+        _pFrame->size = live_frame_ ? live_frame_->size() : 0;
+        _pFrame->seq = 0;
+        _pFrame->stamp = 0;
+        _pFrame->live = true;
+    }
+    return res;
+}
+
+bool StreamLogReader::Map(const std::shared_ptr<StreamLog::Segment>& segment) {
+    // read through a segment, its pages won't be needed again
+    auto done = (segment_ && (segment->first > segment_->first)) ? segment_ : nullptr;
+    Unmap();
+    if (done) {
+        posix_fadvise(done->fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    auto map = mmap(nullptr, segment->capacity, PROT_READ, MAP_SHARED, segment->fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    madvise(map, segment->capacity, MADV_SEQUENTIAL);
+    map_ = static_cast<const uint8_t*>(map);
+    segment_ = segment;
+    return true;
+}
+
+void StreamLogReader::Unmap() {
+    if (map_) {
+        munmap(const_cast<uint8_t*>(map_), segment_->capacity);
+        map_ = nullptr;
+    }
+    segment_.reset();
+}
+
+bool StreamLogReader::Live() const {
+    return live_;
+}
+
+bool StreamLogReader::ClientGet(ClientID* _punClientID) const {
+    *_punClientID = client_;
+    return live_;
+}
+
+uint64_t StreamLogReader::SkippedGet() const {
+    return skipped_;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "Splitter.h"
+
+#include <deque>
+#include <string>
+
+// Append-only log of the frames put, for clients that join in the past
+// (time-shift). Frames go into segment files of segment_bytes in a directory,
+// written through a shared mapping of the newest segment; only the newest
+// max_segments are kept. The index of sequence numbers and timestamps is in
+// memory and rebuilt from the segment files when a directory is opened again.
+//
+// A splitter appends every frame it puts while SplitterOptions::log is set.
+// StreamLogReader reads the log in place and becomes a live client of the
+// splitter once it has caught up.
+
+struct StreamLogOptions {
+    size_t segment_bytes = 64 << 20;
+    size_t max_segments = 16;
+};
+
+struct StreamLogStats {
+    uint64_t begin = 0;     // oldest frame kept
+    uint64_t end = 0;       // next frame appended
+    size_t segments = 0;
+    uint64_t bytes = 0;     // payload bytes appended
+    uint64_t skipped = 0;   // frames that didn't fit a segment or the disk
+};
+
+class StreamLog {
+public:
+    StreamLog(const std::string& dir, const StreamLogOptions& options = StreamLogOptions());
+    ~StreamLog();
+
+    StreamLog(const StreamLog&) = delete;
+    StreamLog& operator=(const StreamLog&) = delete;
+
+    bool Valid() const;
+
+    // Copies the frame to the end of the log, false when it doesn't fit a
+    // segment or no new segment could be reserved on disk. A single writer
+    // at a time, the splitter calls it under its push lock.
+    bool Append(const FrameBuffer& _pVecPut);
+
+    // sequence numbers of the oldest frame kept and of the next one appended
+    uint64_t Begin() const;
+    uint64_t End() const;
+    // first frame stamped at or after _nStamp, End() when there is none
+    uint64_t Find(int64_t _nStamp) const;
+    bool StatsGet(StreamLogStats* _pStats) const;
+
+    // clock of the frame stamps, system_clock ns so they outlive the process
+    static int64_t Now();
+
+private:
+    friend class StreamLogReader;
+    struct Segment;
+
+    // segment holding frame _unSeq and the frame's place in it, false when
+    // the frame isn't in the log
+    bool Locate(uint64_t _unSeq, std::shared_ptr<Segment>* _pSegment, size_t* _pzOffset, int64_t* _pnStamp) const;
+    bool Load(const std::string& path);
+    bool Roll();
+
+    const std::string dir_;
+    const StreamLogOptions options_;
+    bool valid_;
+    // guards the segments, their index and the counters. Append copies the
+    // frame without it and then publishes it.
+    mutable std::mutex mtx_;
+    std::deque<std::shared_ptr<Segment>> segments_;
+    uint64_t end_;
+    uint64_t bytes_;
+    uint64_t skipped_;
+    // newest segment, mapped writable, only touched by the writer
+    std::shared_ptr<Segment> active_;
+    uint8_t* active_map_;
+};
+
+inline std::shared_ptr<StreamLog> StreamLogCreate(const std::string& _sDir,
+        const StreamLogOptions& _rOptions = StreamLogOptions()) {
+    auto log = std::make_shared<StreamLog>(_sDir, _rOptions);
+    return log->Valid() ? log : nullptr;
+}
+
+// Frame of StreamLogReader::Get, points into the log mapping or into the
+// FrameBuffer of a live frame
+struct LogFrame {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    uint64_t seq = 0;     // sequence number in the log, not set once live
+    int64_t stamp = 0;    // StreamLog::Now of the Put, not set once live
+    bool live = false;    // taken from the splitter queue
+};
+
+// Client of a splitter with a log that starts in the past. Seek picks the
+// first frame, Get returns frames from the log without a copy until it
+// reaches the end of the log; then the reader becomes a regular client of
+// the splitter with _rOptions and gets the frames put after the last one
+// it read, none twice or missing. Frames the log lets go of before the
+// reader gets to them are skipped.
+//
+// Only the segment being read is mapped, and the pages of a segment read
+// through are dropped from the page cache, so a reader costs a segment of
+// memory at most. Used by one thread at a time.
+class StreamLogReader {
+public:
+    StreamLogReader(std::shared_ptr<ISplitter> splitter, const ClientOptions& options = ClientOptions());
+    ~StreamLogReader();
+
+    StreamLogReader(const StreamLogReader&) = delete;
+    StreamLogReader& operator=(const StreamLogReader&) = delete;
+
+    // false when the splitter has no log or the frame isn't in it. Seeking
+    // a live reader takes it back to the log.
+    bool Seek(uint64_t _unSeq);
+    // first frame stamped at or after _nStamp, the oldest one kept when it is
+    // older than that
+    bool SeekTime(int64_t _nStamp);
+
+    // Next frame; it stays valid until the next Get or Seek. UNKNOWN_CLIENT
+    // when the reader has no log or can't join the splitter.
+    ISplitterError Get(LogFrame* _pFrame, int32_t _nTimeOutMsec);
+
+    bool Live() const;
+    // client of the splitter once live
+    bool ClientGet(ClientID* _punClientID) const;
+    // frames of the log let go of before the reader got to them
+    uint64_t SkippedGet() const;
+
+private:
+    void Leave();
+    bool Map(const std::shared_ptr<StreamLog::Segment>& segment);
+    void Unmap();
+
+    const std::shared_ptr<ISplitter> splitter_;
+    const std::shared_ptr<StreamLog> log_;
+    const ClientOptions options_;
+    uint64_t next_seq_;
+    uint64_t skipped_;
+    bool live_;
+    ClientID client_;
+    FrameBuffer live_frame_;
+    std::shared_ptr<StreamLog::Segment> segment_;
+    const uint8_t* map_;
+};
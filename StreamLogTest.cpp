@@ -0,0 +1,253 @@
+#include <gtest/gtest.h>
+
+#include "StreamLog.h"
+#include "TestFrames.h"
+#include <csignal>
+#include <filesystem>
+#include <sys/resource.h>
+#include <thread>
+
+// directory removed with its segments at the end of the test
+class LogDir {
+public:
+    LogDir() {
+        char path[] = "/tmp/stream_log_XXXXXX";
+        path_ = mkdtemp(path);
+    }
+    ~LogDir() {
+        std::filesystem::remove_all(path_);
+    }
+    const std::string& Path() const {
+        return path_;
+    }
+
+private:
+    std::string path_;
+};
+
+static bool Same(const LogFrame& frame, uint8_t value, size_t size = 1000) {
+    return (frame.size == size) && (std::count(frame.data, frame.data + frame.size, value) == ptrdiff_t(size));
+}
+
+static std::shared_ptr<ISplitter> LoggedSplitter(std::shared_ptr<StreamLog> log, size_t max_buffers = 16) {
+    SplitterOptions options;
+    options.log = std::move(log);
+    return SplitterCreate(max_buffers, 4, options);
+}
+
+TEST(AppendRollRetain, StreamLog) {
+    LogDir dir;
+    // three frames per segment, four segments kept
+    auto log = StreamLogCreate(dir.Path(), StreamLogOptions{3200, 4});
+    ASSERT_TRUE(log);
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_TRUE(log->Append(MakeFrame(i, 1000)));
+    }
+    EXPECT_FALSE(log->Append(MakeFrame(0, 4000)));
+
+    StreamLogStats stats;
+    EXPECT_TRUE(log->StatsGet(&stats));
+    EXPECT_EQ(stats.end, 20u);
+    EXPECT_EQ(stats.begin, 9u);
+    EXPECT_EQ(stats.segments, 4u);
+    EXPECT_EQ(stats.bytes, 20000u);
+    EXPECT_EQ(stats.skipped, 1u);
+    size_t files = std::distance(std::filesystem::directory_iterator(dir.Path()), {});
+    EXPECT_EQ(files, 4u);
+}
+
+TEST(Reopen, StreamLog) {
+    LogDir dir;
+    {
+        auto log = StreamLogCreate(dir.Path(), StreamLogOptions{3200, 4});
+        for (int i = 0; i < 5; ++i) {
+            log->Append(MakeFrame(i, 1000));
+        }
+    }
+    auto log = StreamLogCreate(dir.Path(), StreamLogOptions{3200, 4});
+    ASSERT_TRUE(log);
+    EXPECT_EQ(log->Begin(), 0u);
+    EXPECT_EQ(log->End(), 5u);
+    log->Append(MakeFrame(5, 1000));
+
+    auto s = LoggedSplitter(log);
+    StreamLogReader reader(s);
+    ASSERT_TRUE(reader.Seek(0));
+    for (int i = 0; i < 6; ++i) {
+        LogFrame frame;
+        ASSERT_EQ(reader.Get(&frame, 0), ISplitterError::NO_ERROR);
+        EXPECT_EQ(frame.seq, uint64_t(i));
+        EXPECT_TRUE(Same(frame, i));
+    }
+}
+
+TEST(CatchUpAndGoLive, StreamLog) {
+    LogDir dir;
+    auto log = StreamLogCreate(dir.Path(), StreamLogOptions{3200, 8});
+    auto s = LoggedSplitter(log);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(s->Put(MakeFrame(i, 1000), 0), ISplitterError::NO_ERROR);
+    }
+
+    StreamLogReader reader(s);
+    ASSERT_TRUE(reader.Seek(3));
+    LogFrame frame;
+    for (int i = 3; i < 8; ++i) {
+        ASSERT_EQ(reader.Get(&frame, 0), ISplitterError::NO_ERROR);
+        EXPECT_FALSE(frame.live);
+        EXPECT_TRUE(Same(frame, i));
+    }
+    // frames put while behind come from the log as well
+    s->Put(MakeFrame(10, 1000), 0);
+    for (int i : {8, 9, 10}) {
+        ASSERT_EQ(reader.Get(&frame, 0), ISplitterError::NO_ERROR);
+        EXPECT_FALSE(frame.live);
+        EXPECT_TRUE(Same(frame, i));
+    }
+    EXPECT_FALSE(reader.Live());
+
+    // the end of the log, the next frames come from the splitter
+    EXPECT_EQ(reader.Get(&frame, 0), ISplitterError::TIMEOUT);
+    EXPECT_TRUE(reader.Live());
+    size_t count;
+    s->ClientGetCount(&count);
+    EXPECT_EQ(count, 1u);
+    s->Put(MakeFrame(11, 1000), 0);
+    ASSERT_EQ(reader.Get(&frame, 0), ISplitterError::NO_ERROR);
+    EXPECT_TRUE(frame.live);
+    EXPECT_TRUE(Same(frame, 11));
+    EXPECT_EQ(reader.Get(&frame, 0), ISplitterError::TIMEOUT);
+
+    // back to the past
+    ASSERT_TRUE(reader.Seek(11));
+    EXPECT_FALSE(reader.Live());
+    s->ClientGetCount(&count);
+    EXPECT_EQ(count, 0u);
+    ASSERT_EQ(reader.Get(&frame, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(frame.seq, 11u);
+    EXPECT_TRUE(Same(frame, 11));
+}
+
+TEST(ClientAddAtPastLog, StreamLog) {
+    LogDir dir;
+    auto log = StreamLogCreate(dir.Path());
+    auto s = LoggedSplitter(log);
+    s->Put(MakeFrame(0, 1000), 0);
+    ClientID id;
+    EXPECT_FALSE(s->ClientAddAt(0, &id, ClientOptions()));
+    EXPECT_TRUE(s->ClientAddAt(1, &id, ClientOptions()));
+    EXPECT_FALSE(SplitterCreate(4, 4)->ClientAddAt(0, &id, ClientOptions()));
+}
+
+TEST(SeekTime, StreamLog) {
+    LogDir dir;
+    auto log = StreamLogCreate(dir.Path(), StreamLogOptions{3200, 8});
+    auto s = LoggedSplitter(log);
+    int64_t mark = 0;
+    for (int i = 0; i < 10; ++i) {
+        if (i == 6) {
+            mark = StreamLog::Now();
+        }
+        s->Put(MakeFrame(i, 1000), 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    StreamLogReader reader(s);
+    LogFrame frame;
+    ASSERT_TRUE(reader.SeekTime(mark));
+    ASSERT_EQ(reader.Get(&frame, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(frame.seq, 6u);
+    EXPECT_GE(frame.stamp, mark);
+
+    ASSERT_TRUE(reader.SeekTime(0));
+    ASSERT_EQ(reader.Get(&frame, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(frame.seq, 0u);
+
+    // in the future is live
+    ASSERT_TRUE(reader.SeekTime(StreamLog::Now() + 1000000000));
+    EXPECT_EQ(reader.Get(&frame, 0), ISplitterError::TIMEOUT);
+    EXPECT_TRUE(reader.Live());
+}
+
+TEST(RetentionOvertakesReader, StreamLog) {
+    LogDir dir;
+    auto log = StreamLogCreate(dir.Path(), StreamLogOptions{3200, 2});
+    auto s = LoggedSplitter(log);
+    for (int i = 0; i < 3; ++i) {
+        s->Put(MakeFrame(i, 1000), 0);
+    }
+    StreamLogReader reader(s);
+    ASSERT_TRUE(reader.Seek(0));
+    LogFrame frame;
+    ASSERT_EQ(reader.Get(&frame, 0), ISplitterError::NO_ERROR);
+    EXPECT_TRUE(Same(frame, 0));
+
+    // the segment read stays mapped while the log lets it go
+    for (int i = 3; i < 12; ++i) {
+        s->Put(MakeFrame(i, 1000), 0);
+    }
+    EXPECT_TRUE(Same(frame, 0));
+    EXPECT_EQ(log->Begin(), 6u);
+    ASSERT_EQ(reader.Get(&frame, 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(frame.seq, 6u);
+    EXPECT_TRUE(Same(frame, 6));
+    EXPECT_EQ(reader.SkippedGet(), 5u);
+}
+
+// a segment the file size limit doesn't let reserve is not written, the
+// splitter goes on without the log
+TEST(SegmentNotReserved, StreamLog) {
+    LogDir dir;
+    auto log = StreamLogCreate(dir.Path(), StreamLogOptions{64 * 1024, 4});
+    auto s = LoggedSplitter(log);
+    ClientID client;
+    ASSERT_TRUE(s->ClientAdd(&client));
+
+    rlimit old_limit;
+    ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &old_limit), 0);
+    rlimit limit = old_limit;
+    limit.rlim_cur = 16 * 1024;
+    auto old_handler = signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limit), 0);
+    EXPECT_EQ(s->Put(MakeFrame(1, 1000), 0), ISplitterError::NO_ERROR);
+    setrlimit(RLIMIT_FSIZE, &old_limit);
+    signal(SIGXFSZ, old_handler);
+
+    FrameBuffer got;
+    EXPECT_EQ(s->Get(client, got, 0), ISplitterError::NO_ERROR);
+    StreamLogStats stats;
+    EXPECT_TRUE(log->StatsGet(&stats));
+    EXPECT_EQ(stats.end, 0u);
+    EXPECT_EQ(stats.segments, 0u);
+    EXPECT_EQ(stats.skipped, 1u);
+    EXPECT_TRUE(std::filesystem::is_empty(dir.Path()));
+
+    // with room again the next frame starts a segment
+    EXPECT_EQ(s->Put(MakeFrame(2, 1000), 0), ISplitterError::NO_ERROR);
+    EXPECT_EQ(log->End(), 1u);
+}
+
+TEST(ConcurrentPutNoGapOrDuplicate, StreamLog) {
+    LogDir dir;
+    auto log = StreamLogCreate(dir.Path(), StreamLogOptions{64 * 1024, 64});
+    auto s = LoggedSplitter(log, 1000);
+    constexpr int kFrames = 2000;
+    for (int i = 0; i < 100; ++i) {
+        s->Put(MakeFrame(i % 251, 64), 0);
+    }
+    auto producer = std::thread([&]() {
+        for (int i = 100; i < kFrames; ++i) {
+            s->Put(MakeFrame(i % 251, 64), 1000);
+        }
+    });
+
+    StreamLogReader reader(s);
+    ASSERT_TRUE(reader.Seek(0));
+    LogFrame frame;
+    for (int i = 0; i < kFrames; ++i) {
+        ASSERT_EQ(reader.Get(&frame, 1000), ISplitterError::NO_ERROR);
+        ASSERT_TRUE(Same(frame, i % 251, 64)) << i;
+    }
+    producer.join();
+    EXPECT_EQ(reader.Get(&frame, 0), ISplitterError::TIMEOUT);
+}
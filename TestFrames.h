@@ -0,0 +1,43 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include "Splitter.h"
+
+// Frames and clients shared by the tests
+
+// size bytes of value. A keyframe has no FrameHeader, as from a producer that
+// doesn't use it; the others carry one without kKeyFrame over their first
+// bytes, so back() still holds value.
+inline FrameBuffer MakeFrame(uint8_t value = 0, size_t size = 16, bool key = true) {
+    auto fb = std::make_shared<std::vector<uint8_t>>(size, value);
+    if (!key) {
+        FrameHeaderSet(fb, 0);
+    }
+    return fb;
+}
+
+inline ClientID AddClient(ISplitter& s, const ClientOptions& options = ClientOptions()) {
+    ClientID client = 0;
+    EXPECT_TRUE(s.ClientAdd(&client, options));
+    return client;
+}
+
+// frames the client has queued, taken without waiting
+inline std::vector<FrameBuffer> Drain(ISplitter& s, ClientID client) {
+    std::vector<FrameBuffer> res;
+    FrameBuffer fb;
+    while (s.TryGet(client, fb) == ISplitterError::NO_ERROR) {
+        res.push_back(fb);
+    }
+    return res;
+}
+
+// values of the frames Drain takes
+inline std::vector<uint8_t> DrainValues(ISplitter& s, ClientID client) {
+    std::vector<uint8_t> res;
+    for (auto& fb : Drain(s, client)) {
+        res.push_back(fb->back());
+    }
+    return res;
+}
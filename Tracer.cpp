@@ -0,0 +1,246 @@
+#include "Tracer.h"
+#include "Metrics.h"
+
+#include <array>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// fields are relaxed atomics, so Json may read a slot being written
+struct TraceSlot {
+    std::atomic<int64_t> stamp;
+    std::atomic<uint64_t> client;
+    std::atomic<uint64_t> value;
+    std::atomic<uint8_t> event;
+    std::atomic<char> phase;
+};
+
+// a single writer, its thread. Readers trust the slots below head that are
+// still there after the copy.
+struct TraceRing {
+    std::array<TraceSlot, Tracer::kRingEvents> slots;
+    std::atomic<uint64_t> head = 0;
+    std::atomic<uint64_t> cleared = 0;  // head when Clear was called
+    long tid = 0;
+    // guarded by the registry lock
+    uint64_t retired = 0;  // order of the thread exit, 0 while it runs
+    uint64_t dumped = 0;   // head when Json read the ring
+};
+
+// rings outlive their threads, the events of a thread that exited are kept
+// until they were read or cleared
+struct TraceRegistry {
+    std::mutex mtx;
+    std::vector<std::unique_ptr<TraceRing>> rings;
+    uint64_t exits = 0;
+};
+
+TraceRegistry& Registry() {
+    // never destroyed, threads may still trace during static destruction
+    static auto registry = new TraceRegistry;
+    return *registry;
+}
+
+// the thread of a retired ring is gone, so its head is final
+bool Drained(const TraceRing& ring) {
+    auto head = ring.head.load(std::memory_order_relaxed);
+    return ring.retired && ((ring.cleared.load(std::memory_order_relaxed) == head) || (ring.dumped == head));
+}
+
+TraceRing* AcquireRing() {
+    auto& registry = Registry();
+    std::lock_guard lck(registry.mtx);
+    TraceRing* ring = nullptr;
+    for (auto& retired : registry.rings) {
+        if (Drained(*retired)) {
+            ring = retired.get();
+            break;
+        }
+    }
+    if (!ring) {
+        ring = registry.rings.emplace_back(std::make_unique<TraceRing>()).get();
+    }
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->cleared.store(0, std::memory_order_relaxed);
+    ring->tid = syscall(SYS_gettid);
+    ring->retired = 0;
+    ring->dumped = 0;
+    return ring;
+}
+
+// past kRetiredRings rings nobody read the oldest is freed
+void RetireRing(TraceRing* ring) {
+    auto& registry = Registry();
+    std::lock_guard lck(registry.mtx);
+    ring->retired = ++registry.exits;
+    size_t kept = 0;
+    auto oldest = registry.rings.end();
+    for (auto it = registry.rings.begin(); it != registry.rings.end(); ++it) {
+        if ((*it)->retired && !Drained(**it)) {
+            ++kept;
+            if ((oldest == registry.rings.end()) || ((*it)->retired < (*oldest)->retired)) {
+                oldest = it;
+            }
+        }
+    }
+    if (kept > Tracer::kRetiredRings) {
+        registry.rings.erase(oldest);
+    }
+}
+
+struct ThreadRingOwner {
+    ~ThreadRingOwner() {
+        if (ring) {
+            RetireRing(std::exchange(ring, nullptr));
+        }
+    }
+
+    TraceRing* ring = nullptr;
+};
+
+TraceRing* ThreadRing() {
+    thread_local ThreadRingOwner owner;
+    if (!owner.ring) {
+        owner.ring = AcquireRing();
+    }
+    return owner.ring;
+}
+
+struct TraceEventInfo {
+    const char* name;
+    const char* value;      // name of the value arg, nullptr for none
+    const char* end_value;  // same for the end of a span
+};
+
+constexpr TraceEventInfo kEventInfo[] = {
+    {"Put", "frames", "result"},
+    {"Stall", "seq", nullptr},
+    {"Push", "seq", nullptr},
+    {"Pop", "seq", nullptr},
+    {"Drop", "frames", nullptr},
+    {"ClientAdd", nullptr, nullptr},
+    {"ClientRemove", nullptr, nullptr},
+    {"GetTimeout", nullptr, nullptr},
+    {"GetEos", nullptr, nullptr},
+    {"Flush", nullptr, nullptr},
+    {"Close", nullptr, nullptr},
+};
+
+static_assert(std::size(kEventInfo) == size_t(TraceEvent::CLOSE) + 1);
+
+void AppendEvent(std::string& out, const TraceSlot& slot, long tid, int pid) {
+    auto phase = slot.phase.load(std::memory_order_relaxed);
+    auto event = slot.event.load(std::memory_order_relaxed);
+    auto client = slot.client.load(std::memory_order_relaxed);
+    auto value = slot.value.load(std::memory_order_relaxed);
+    auto stamp = slot.stamp.load(std::memory_order_relaxed);
+    if (event >= std::size(kEventInfo)) {
+        return;
+    }
+    auto& info = kEventInfo[event];
+    bool end = (phase == 'E') || (phase == 'e');
+    auto value_name = end ? info.end_value : info.value;
+
+    char buf[320];
+    int len = snprintf(buf, sizeof(buf),
+        "%s{\"name\":\"%s\",\"cat\":\"splitter\",\"ph\":\"%c\",\"ts\":%" PRId64 ".%03d,\"pid\":%d,\"tid\":%ld",
+        out.empty() ? "" : ",\n", info.name, phase, stamp / 1000, int(stamp % 1000), pid, tid);
+    if ((phase == 'b') || (phase == 'e')) {
+        len += snprintf(buf + len, sizeof(buf) - len, ",\"id\":\"0x%" PRIx64 "\"", client);
+    } else if (phase == 'i') {
+        len += snprintf(buf + len, sizeof(buf) - len, ",\"s\":\"t\"");
+    }
+    len += snprintf(buf + len, sizeof(buf) - len, ",\"args\":{");
+    const char* sep = "";
+    if (client) {
+        len += snprintf(buf + len, sizeof(buf) - len, "\"client\":\"0x%" PRIx64 "\"", client);
+        sep = ",";
+    }
+    if (value_name) {
+        len += snprintf(buf + len, sizeof(buf) - len, "%s\"%s\":%" PRIu64, sep, value_name, value);
+    }
+    snprintf(buf + len, sizeof(buf) - len, "}}");
+    out += buf;
+}
+
+}
+
+void Tracer::Write(char phase, TraceEvent event, uint64_t client, uint64_t value) {
+    auto ring = ThreadRing();
+    auto head = ring->head.load(std::memory_order_relaxed);
+    auto& slot = ring->slots[head % kRingEvents];
+    slot.stamp.store(Metrics::Now(), std::memory_order_relaxed);
+    slot.client.store(client, std::memory_order_relaxed);
+    slot.value.store(value, std::memory_order_relaxed);
+    slot.event.store(static_cast<uint8_t>(event), std::memory_order_relaxed);
+    slot.phase.store(phase, std::memory_order_relaxed);
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+std::string Tracer::Json() {
+    auto pid = static_cast<int>(getpid());
+    std::string events;
+    auto& registry = Registry();
+    std::lock_guard lck(registry.mtx);
+    for (auto& ring : registry.rings) {
+        auto head = ring->head.load(std::memory_order_acquire);
+        ring->dumped = head;
+        auto first = std::max(ring->cleared.load(std::memory_order_relaxed),
+            head - std::min<uint64_t>(head, kRingEvents));
+        std::string ring_events;
+        std::vector<size_t> offsets;
+        for (auto seq = first; seq < head; ++seq) {
+            offsets.push_back(ring_events.size());
+            AppendEvent(ring_events, ring->slots[seq % kRingEvents], ring->tid, pid);
+        }
+        // slots the thread overwrote while they were copied are torn. An RMW
+        // rather than a load: release keeps the copy before it.
+        auto overwritten = ring->head.fetch_add(0, std::memory_order_acq_rel);
+        auto valid = overwritten - std::min<uint64_t>(overwritten, kRingEvents);
+        if (valid > first) {
+            auto skip = std::min<uint64_t>(valid - first, offsets.size());
+            ring_events.erase(0, skip < offsets.size() ? offsets[skip] : ring_events.size());
+            if (!ring_events.empty() && (ring_events[0] == ',')) {
+                ring_events.erase(0, 2);
+            }
+        }
+        if (!ring_events.empty()) {
+            if (!events.empty()) {
+                events += ",\n";
+            }
+            events += ring_events;
+        }
+    }
+    return "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n" + events + "\n]}\n";
+}
+
+bool Tracer::Dump(const std::string& _sPath) {
+    auto json = Json();
+    auto file = fopen(_sPath.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+    bool res = fwrite(json.data(), 1, json.size(), file) == json.size();
+    return (fclose(file) == 0) && res;
+}
+
+void Tracer::Clear() {
+    auto& registry = Registry();
+    std::lock_guard lck(registry.mtx);
+    for (auto& ring : registry.rings) {
+        ring->cleared.store(ring->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+size_t Tracer::RingCount() {
+    auto& registry = Registry();
+    std::lock_guard lck(registry.mtx);
+    return registry.rings.size();
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Timeline of splitter operations for debugging stalls: Put begin and end,
+// the Puts stalled on each client, pushes, pops and drops of the client
+// queues, clients added and removed, Get timeouts and EOS, Flush and Close.
+// Dump writes it as Chrome trace JSON, for chrome://tracing or Perfetto.
+//
+// Every thread records into a ring of its own, the newest kRingEvents events
+// are kept. The ring of a thread that exited is reused once Json or Clear
+// went over its events; until then the rings of the last kRetiredRings
+// threads that exited are kept. Enabled, an event costs a clock read and a
+// few stores; disabled, a relaxed load. Built with SPLITTER_TRACE=0 the calls
+// compile to nothing.
+
+#ifndef SPLITTER_TRACE
+#define SPLITTER_TRACE 1
+#endif
+
+enum class TraceEvent : uint8_t {
+    PUT = 0,        // span of a Put, PutBatch or PutFrames
+    STALL,          // async span of a Put stalled on a client
+    PUSH,
+    POP,
+    DROP,
+    CLIENT_ADD,
+    CLIENT_REMOVE,
+    GET_TIMEOUT,
+    GET_EOS,
+    FLUSH,
+    CLOSE,
+};
+
+class Tracer {
+public:
+    static constexpr bool kCompiled = SPLITTER_TRACE;
+    static constexpr size_t kRingEvents = 1 << 14;
+    static constexpr size_t kRetiredRings = 64;
+
+    static void Enable(bool _bEnable) {
+        enabled_.store(_bEnable, std::memory_order_relaxed);
+    }
+
+    static bool Enabled() {
+        if constexpr (kCompiled) {
+            return enabled_.load(std::memory_order_relaxed);
+        } else {
+            return false;
+        }
+    }
+
+    // spans nest per thread
+    static void Begin(TraceEvent _eEvent, uint64_t _unClient = 0, uint64_t _unValue = 0) {
+        Record('B', _eEvent, _unClient, _unValue);
+    }
+    static void End(TraceEvent _eEvent, uint64_t _unClient = 0, uint64_t _unValue = 0) {
+        Record('E', _eEvent, _unClient, _unValue);
+    }
+    static void Instant(TraceEvent _eEvent, uint64_t _unClient = 0, uint64_t _unValue = 0) {
+        Record('i', _eEvent, _unClient, _unValue);
+    }
+    // async spans belong to the client, they may start and end on any thread
+    static void AsyncBegin(TraceEvent _eEvent, uint64_t _unClient, uint64_t _unValue = 0) {
+        Record('b', _eEvent, _unClient, _unValue);
+    }
+    static void AsyncEnd(TraceEvent _eEvent, uint64_t _unClient, uint64_t _unValue = 0) {
+        Record('e', _eEvent, _unClient, _unValue);
+    }
+
+    // Chrome trace JSON of the events kept. Exact when tracing is disabled or
+    // the traced threads are idle, otherwise the events being overwritten
+    // meanwhile are left out.
+    static std::string Json();
+    // false when the file can't be written
+    static bool Dump(const std::string& _sPath);
+    // forgets the events recorded so far
+    static void Clear();
+    // rings of the running threads and retired ones kept
+    static size_t RingCount();
+
+private:
+    static void Record(char phase, TraceEvent event, uint64_t client, uint64_t value) {
+        if constexpr (kCompiled) {
+            if (Enabled()) {
+                Write(phase, event, client, value);
+            }
+        }
+    }
+
+    static void Write(char phase, TraceEvent event, uint64_t client, uint64_t value);
+
+    inline static std::atomic_bool enabled_ = false;
+};
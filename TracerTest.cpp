@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+
+#include "Splitter.h"
+#include "Tracer.h"
+#include "TestFrames.h"
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <thread>
+
+static size_t Count(const std::string& json, const std::string& what) {
+    size_t count = 0;
+    for (auto pos = json.find(what); pos != std::string::npos; pos = json.find(what, pos + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+static std::string Event(const std::string& name, char phase) {
+    return "\"name\":\"" + name + "\",\"cat\":\"splitter\",\"ph\":\"" + phase + "\"";
+}
+
+// enables the tracer for a test, the events of other tests are cleared. The
+// file is built only with SPLITTER_TRACE on.
+struct TraceSession {
+    TraceSession() {
+        Tracer::Clear();
+        Tracer::Enable(true);
+    }
+
+    ~TraceSession() {
+        Tracer::Enable(false);
+        Tracer::Clear();
+    }
+};
+
+TEST(SplitterOperations, Tracer) {
+    TraceSession session;
+    ISplitter s(1, 1);
+    ClientID id;
+    ASSERT_TRUE(s.ClientAdd(&id));
+    s.Put(MakeFrame(0), 0);
+    s.Put(MakeFrame(1), 0);
+    FrameBuffer fb;
+    EXPECT_EQ(s.TryGet(id, fb), ISplitterError::NO_ERROR);
+    EXPECT_EQ(s.TryGet(id, fb), ISplitterError::TIMEOUT);
+    s.Flush();
+    EXPECT_TRUE(s.ClientRemove(id));
+    s.Close();
+    Tracer::Enable(false);
+
+    auto json = Tracer::Json();
+    EXPECT_EQ(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["), 0u);
+    EXPECT_EQ(Count(json, Event("Put", 'B')), 2u);
+    EXPECT_EQ(Count(json, Event("Put", 'E')), 2u);
+    EXPECT_EQ(Count(json, Event("Push", 'i')), 2u);
+    // the second frame stalls on the full client for no time and drops the
+    // first
+    EXPECT_EQ(Count(json, Event("Stall", 'b')), 1u);
+    EXPECT_EQ(Count(json, Event("Stall", 'e')), 1u);
+    EXPECT_EQ(Count(json, Event("Drop", 'i')), 1u);
+    EXPECT_EQ(Count(json, Event("Pop", 'i')), 1u);
+    EXPECT_EQ(Count(json, Event("GetTimeout", 'i')), 1u);
+    EXPECT_EQ(Count(json, Event("ClientAdd", 'i')), 1u);
+    EXPECT_EQ(Count(json, Event("ClientRemove", 'i')), 1u);
+    EXPECT_EQ(Count(json, Event("Flush", 'i')), 1u);
+    EXPECT_EQ(Count(json, Event("Close", 'i')), 1u);
+    std::ostringstream client;
+    client << "\"client\":\"0x" << std::hex << id << "\"";
+    EXPECT_EQ(Count(json, client.str()), 9u);
+}
+
+TEST(StallPerClient, Tracer) {
+    TraceSession session;
+    ISplitter s(1, 2);
+    ClientID slow;
+    ClientID fast;
+    ASSERT_TRUE(s.ClientAdd(&slow));
+    ASSERT_TRUE(s.ClientAdd(&fast));
+    s.Put(MakeFrame(0), 0);
+    FrameBuffer fb;
+    s.TryGet(fast, fb);
+    EXPECT_EQ(s.Put(MakeFrame(1), 10), ISplitterError::TIMEOUT);
+    Tracer::Enable(false);
+
+    auto json = Tracer::Json();
+    std::ostringstream id;
+    id << "\"id\":\"0x" << std::hex << slow << "\"";
+    EXPECT_EQ(Count(json, Event("Stall", 'b') + ",\"ts\""), 1u);
+    EXPECT_EQ(Count(json, Event("Stall", 'e') + ",\"ts\""), 1u);
+    EXPECT_EQ(Count(json, id.str()), 2u);
+    EXPECT_NE(json.find("\"result\":" + std::to_string(int(ISplitterError::TIMEOUT))), std::string::npos);
+}
+
+TEST(Disabled, Tracer) {
+    TraceSession session;
+    Tracer::Enable(false);
+    ISplitter s(1, 1);
+    ClientID id;
+    ASSERT_TRUE(s.ClientAdd(&id));
+    s.Put(MakeFrame(0), 0);
+    EXPECT_EQ(Count(Tracer::Json(), "\"name\""), 0u);
+}
+
+TEST(RingPerThreadKeepsNewest, Tracer) {
+    TraceSession session;
+    constexpr size_t kExtra = 10;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; ++t) {
+        threads.emplace_back([]() {
+            for (size_t i = 0; i < Tracer::kRingEvents + kExtra; ++i) {
+                Tracer::Instant(TraceEvent::DROP, 0, i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto json = Tracer::Json();
+    EXPECT_EQ(Count(json, Event("Drop", 'i')), 2 * Tracer::kRingEvents);
+    EXPECT_EQ(Count(json, "\"frames\":" + std::to_string(kExtra - 1) + "}"), 0u);
+    EXPECT_EQ(Count(json, "\"frames\":" + std::to_string(kExtra) + "}"), 2u);
+    std::set<std::string> tids;
+    for (auto pos = json.find("\"tid\":"); pos != std::string::npos; pos = json.find("\"tid\":", pos + 1)) {
+        tids.insert(json.substr(pos, json.find(',', pos) - pos));
+    }
+    EXPECT_EQ(tids.size(), 2u);
+
+    Tracer::Clear();
+    EXPECT_EQ(Count(Tracer::Json(), "\"name\""), 0u);
+}
+
+TEST(RetiredRingsReused, Tracer) {
+    TraceSession session;
+    auto rings = Tracer::RingCount();
+    for (int i = 0; i < 10; ++i) {
+        std::thread([]() {
+            Tracer::Instant(TraceEvent::FLUSH);
+        }).join();
+        // read once, the ring of the thread is free for the next one
+        EXPECT_EQ(Count(Tracer::Json(), Event("Flush", 'i')), 1u);
+    }
+    EXPECT_LE(Tracer::RingCount(), rings + 1);
+
+    // rings nobody reads are kept for the last threads only
+    for (size_t i = 0; i < 2 * Tracer::kRetiredRings; ++i) {
+        std::thread([]() {
+            Tracer::Instant(TraceEvent::FLUSH);
+        }).join();
+    }
+    EXPECT_LE(Tracer::RingCount(), rings + Tracer::kRetiredRings);
+    EXPECT_EQ(Count(Tracer::Json(), Event("Flush", 'i')), Tracer::kRetiredRings);
+}
+
+TEST(Dump, Tracer) {
+    TraceSession session;
+    Tracer::Instant(TraceEvent::FLUSH);
+    auto path = testing::TempDir() + "splitter_trace.json";
+    ASSERT_TRUE(Tracer::Dump(path));
+    std::ifstream file(path);
+    std::stringstream content;
+    content << file.rdbuf();
+    EXPECT_EQ(content.str(), Tracer::Json());
+    std::remove(path.c_str());
+    EXPECT_FALSE(Tracer::Dump("/nonexistent/trace.json"));
+}
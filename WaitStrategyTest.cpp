@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+
+#include "Splitter.h"
+#include "TestFrames.h"
+#include <thread>
+
+static const WaitStrategy kStrategies[] = {WaitStrategy::PARK, WaitStrategy::SPIN_THEN_PARK,
+    WaitStrategy::BUSY_POLL, WaitStrategy::ADAPTIVE};
+
+TEST(Delivers, WaitStrategy) {
+    for (auto wait : kStrategies) {
+        ISplitter s(4, 1);
+        ClientOptions options;
+        options.wait = wait;
+        ClientID id;
+        ASSERT_TRUE(s.ClientAdd(&id, options));
+        auto consumer = std::thread([&]() {
+            FrameBuffer fb;
+            for (int i = 0; i < 50; ++i) {
+                ASSERT_EQ(s.Get(id, fb, 1000), ISplitterError::NO_ERROR);
+                EXPECT_EQ(fb->front(), i);
+            }
+        });
+        for (int i = 0; i < 50; ++i) {
+            EXPECT_EQ(s.Put(MakeFrame(i), 1000), ISplitterError::NO_ERROR);
+            std::this_thread::sleep_for(std::chrono::microseconds(i % 5 * 100));
+        }
+        consumer.join();
+    }
+}
+
+TEST(Timeout, WaitStrategy) {
+    for (auto wait : kStrategies) {
+        ISplitter s(4, 1);
+        ClientOptions options;
+        options.wait = wait;
+        options.spin_usec = 5000;
+        ClientID id;
+        ASSERT_TRUE(s.ClientAdd(&id, options));
+        FrameBuffer fb;
+        auto start = std::chrono::steady_clock::now();
+        EXPECT_EQ(s.Get(id, fb, 20), ISplitterError::TIMEOUT);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        EXPECT_GE(elapsed, std::chrono::milliseconds(20));
+        EXPECT_LT(elapsed, std::chrono::milliseconds(500));
+    }
+}
+
+TEST(RemoveEndsSpin, WaitStrategy) {
+    for (auto wait : kStrategies) {
+        ISplitter s(4, 1);
+        ClientOptions options;
+        options.wait = wait;
+        ClientID id;
+        ASSERT_TRUE(s.ClientAdd(&id, options));
+        auto consumer = std::thread([&]() {
+            FrameBuffer fb;
+            EXPECT_EQ(s.Get(id, fb, 5000), ISplitterError::EOS);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        auto start = std::chrono::steady_clock::now();
+        s.ClientRemove(id);
+        consumer.join();
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+    }
+}
+
+TEST(GetBatchSpins, WaitStrategy) {
+    ISplitter s(8, 1);
+    ClientOptions options;
+    options.wait = WaitStrategy::BUSY_POLL;
+    ClientID id;
+    ASSERT_TRUE(s.ClientAdd(&id, options));
+    auto producer = std::thread([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        s.Put(MakeFrame(1), 0);
+    });
+    std::vector<FrameBuffer> frames;
+    EXPECT_EQ(s.GetBatch(id, frames, 8, 1000), ISplitterError::NO_ERROR);
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0]->front(), 1);
+    producer.join();
+}